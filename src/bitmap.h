@@ -111,6 +111,17 @@ protected:
     }
   }
 
+  inline void ATTRIBUTE_ALWAYS_INLINE unsetMask(const size_t *mask, size_t *wereSet) {
+    constexpr size_t wordCnt = wordCount(representationSize(maxBits));
+    for (size_t i = 0; i < wordCnt; i++) {
+      if (mask[i] == 0) {
+        wereSet[i] = 0;
+        continue;
+      }
+      wereSet[i] = _bits[i].fetch_and(~mask[i], std::memory_order_release) & mask[i];
+    }
+  }
+
 public:
   inline bool ATTRIBUTE_ALWAYS_INLINE setAt(uint32_t item, uint32_t position) {
     const auto mask = getMask(position);
@@ -565,6 +576,13 @@ public:
     Super::setAndExchangeAll(oldBits, newBits);
   }
 
+  /// Clears every bit set in mask (an array of as many words as the
+  /// bitmap) with one atomic op per word, and stores the bits of mask
+  /// that had been set in wereSet.
+  inline void unsetMask(const size_t *mask, size_t *wereSet) {
+    Super::unsetMask(mask, wereSet);
+  }
+
 private:
   /// Given an index, compute its item (word) and position within the word.
   inline void ATTRIBUTE_ALWAYS_INLINE computeItemPosition(uint64_t index, uint32_t &item, uint32_t &position) const {
@@ -57,6 +57,16 @@
 #define MESH_HAVE_TLS 1
 #endif
 
+// MESH_PERCPU_HEAPS selects per-CPU rather than per-thread shuffle
+// vectors (see cpu_local_heap.h).  It relies on sched_getcpu, so is
+// Linux-only.
+#ifndef MESH_PERCPU_HEAPS
+#define MESH_PERCPU_HEAPS 0
+#endif
+#if MESH_PERCPU_HEAPS && !defined(__linux__)
+#error MESH_PERCPU_HEAPS is only supported on Linux
+#endif
+
 #ifdef __FreeBSD__
 // This flag is unsupported since this is the default behavior on FreeBSD
 #define MAP_NORESERVE 0
@@ -65,6 +75,7 @@
 namespace mesh {
 
 static constexpr bool kMeshingEnabled = MESHING_ENABLED == 1;
+static constexpr bool kPerCpuHeaps = MESH_PERCPU_HEAPS == 1;
 
 #if defined(_WIN32)
 // FIXME(EDB)
@@ -127,7 +138,19 @@ inline size_t getPageSize() {
 }
 #endif
 
+// freed large allocations up to kMaxFastLargeSize are kept in a
+// per-thread cache, bucketed by page count, and reused without taking
+// the global heap's large-alloc and arena locks.
 static constexpr size_t kMaxFastLargeSize = 256 * 1024;  // 256Kb
+static constexpr size_t kLargeCacheDepth = 4;            // spans per page count
+static constexpr size_t kDefaultLargeCacheBytes = 1024 * 1024;  // per thread
+// spans cached for a page count that goes unused for this long are
+// handed back to the global heap
+static constexpr std::chrono::milliseconds kLargeCacheIdleInterval{1000};
+// frees of objects in miniheaps a thread doesn't own are buffered and
+// handed to the global heap up to this many at a time (the default
+// for, and upper bound of, mesh.remote_free_batch)
+static constexpr size_t kRemoteFreeBatch = 64;
 
 static constexpr size_t kMaxSplitListSize = 16384;
 static constexpr size_t kMaxMergeSets = 4096;
@@ -154,11 +177,13 @@ static constexpr size_t kMaxMeshesPerIteration = 2500;
 static constexpr size_t kMaxDirtyPageThreshold = 1 << 14;  // 16384 pages
 static constexpr size_t kMinDirtyPageThreshold = 32;       // 32 pages
 
-static constexpr uint32_t kSpanClassCount = 256;
-
 static constexpr int kNumBins = 25;  // 16Kb max object size
 static constexpr int kDefaultMeshPeriod = 10000;
 
+// NUMA nodes the arena keeps free pages apart for; pages on any
+// higher-numbered node are treated as being on the last one
+static constexpr size_t kMaxNumaNodes = 8;
+
 static constexpr size_t kMinArenaExpansion = 4096;  // 4096 pages (16 MB on 4KB systems, 64 MB on 16KB systems)
 
 // ensures we amortize the cost of going to the global heap enough
@@ -170,6 +195,24 @@ static constexpr size_t kMiniheapRefillGoalSize = 16 * 1024;
 // More attached miniheaps means more capacity before needing global refills.
 // For small objects (256/miniheap): 48 miniheaps = 12K allocations before refill.
 static constexpr size_t kMaxMiniheapsPerShuffleVector = 48;
+// free space (and at most how many miniheaps) kept pre-attached per
+// size class, so that most thread refills are a CAS rather than a
+// trip through _miniheapLocks
+static constexpr size_t kMiniheapDepotSize = 4 * kMiniheapRefillGoalSize;
+static constexpr size_t kMiniheapDepotCount = 16;
+// each thread adapts its per-size-class refill goal between these
+// bounds: classes that refill again within kRefillHotInterval double
+// their goal, and classes idle for longer than kRefillColdInterval
+// halve it.  Goal bytes above kMiniheapRefillGoalSize, summed over all
+// threads, are capped by mesh.thread_cache_bytes.
+static constexpr size_t kMinRefillGoalSize = 1024;
+static constexpr size_t kMaxRefillGoalSize = 256 * 1024;
+static constexpr std::chrono::milliseconds kRefillHotInterval{10};
+static constexpr std::chrono::milliseconds kRefillColdInterval{1000};
+static constexpr size_t kDefaultThreadCacheBytes = 32 * 1024 * 1024;
+// number of per-CPU heaps when built with MESH_PERCPU_HEAPS; CPUs
+// beyond this share a heap with cpu % kMaxCpuHeaps
+static constexpr size_t kMaxCpuHeaps = 256;
 
 // shuffle vector features
 static constexpr int16_t kMaxShuffleVectorLength = 1024;  // increased to support 16KB pages with 16-byte objects
@@ -182,21 +225,89 @@ static constexpr bool kAdviseDump = false;
 static constexpr std::chrono::milliseconds kZeroMs{0};
 static constexpr std::chrono::milliseconds kMeshPeriodMs{100};  // 100 ms
 
+// incremental meshing releases the per-size-class locks between
+// slices of a pass.  A slice stops once it has held its locks for
+// longer than the pause budget, or after kMeshSliceMergeSets merge
+// sets, whichever comes first.
+static constexpr size_t kDefaultMaxMeshPauseUs = 1000;  // 1 ms
+static constexpr size_t kMeshSliceMergeSets = 64;
+
+// how much CPU time per second of wall-clock time the background
+// mesher thread may spend meshing (see Runtime::bgThread)
+static constexpr size_t kDefaultBgMeshBudgetMs = 50;
+
+// with background meshing on, dirty pages are scavenged on the
+// background thread, this many pages per arena lock hold
+static constexpr size_t kScavengeSlicePages = 1024;
+
+// decay-based purging (see decay.h): freed pages move from dirty to
+// muzzy (MADV_FREE) to clean (hole punched) over the mesh.dirty_decay_ms
+// and mesh.muzzy_decay_ms decay periods, each split into kDecayEpochs
+// epochs.  Both default to 0, which leaves dirty pages to the
+// threshold-based scavenge.
+static constexpr size_t kDecayEpochs = 10;
+static constexpr size_t kDefaultDirtyDecayMs = 0;
+static constexpr size_t kDefaultMuzzyDecayMs = 0;
+
+// upper bound on the mesh.mesh_threads mallctl: the number of threads
+// (including the one running the pass) that mesh size classes in
+// parallel.  There are only kNumBins size classes to go around.
+static constexpr size_t kMaxMeshThreads = 16;
+
+// algorithms for finding pairs of spans to mesh, selected with the
+// mesh.algorithm mallctl
+namespace algorithm {
+// SplitMesher from the paper: randomly split candidates in half and
+// probe a window of the right half for each span on the left
+static constexpr size_t Split = 0;
+// greedy matching over candidates sorted by occupancy: the fullest
+// spans, which are hardest to mesh, pick partners first
+static constexpr size_t Greedy = 1;
+static constexpr size_t Max = 2;
+}  // namespace algorithm
+
 // controls aspects of miniheaps
-static constexpr size_t kMaxMeshes = 256;  // 1 per bit
+// meshed miniheaps are linked in a ring, so this only bounds how many
+// physical spans may alias one set of pages; it is not tied to any
+// bitmap width.
+static constexpr size_t kMaxMeshes = 1024;
+// histogram buckets for mesh group sizes: 2, 3-4, 5-8, ..., up to kMaxMeshes
+static constexpr size_t kMeshGroupBuckets = 10;
+// meshes are applied in batches, so the mprotect, remap and
+// hole-punching syscalls for adjacent spans can be coalesced.  A pair's
+// src may already be meshed, so a batch also tracks how many spans it
+// will remap; the src of any one pair has at most kMaxMeshes / 2.
+static constexpr size_t kMeshBatchSize = 32;
+static constexpr size_t kMeshBatchSpans = kMaxMeshes / 2;
+static_assert(kMaxMeshes <= UINT16_MAX + 1, "mesh group sizes are stored in 16 bits");
+static_assert(size_t{1} << kMeshGroupBuckets == kMaxMeshes, "one histogram bucket per power of two");
+// the arena's default address space reservation, overridden at
+// startup by MESH_ARENA_SIZE.  The file backing the arena only grows
+// as the arena is used.
 #ifdef __APPLE__
 static constexpr size_t kArenaSize = 32ULL * 1024ULL * 1024ULL * 1024ULL;  // 32 GB
 #else
 static constexpr size_t kArenaSize = 64ULL * 1024ULL * 1024ULL * 1024ULL;  // 64 GB
 #endif
+static constexpr size_t kMinArenaSize = 64ULL * 1024ULL * 1024ULL;  // 64 MB
+// with 4K pages this keeps miniheap IDs (one per page at most) under 2^30
+static constexpr size_t kMaxArenaSize = 4ULL * 1024ULL * 1024ULL * 1024ULL * 1024ULL;  // 4 TB
 static constexpr size_t kAltStackSize = 16 * 1024UL;  // 16KB sigaltstacks
 #define SIGQUIESCE (SIGRTMIN + 7)
 #define SIGDUMP (SIGRTMIN + 8)
 
 // BinnedTracker
-static constexpr size_t kBinnedTrackerBinCount = 1;
+// partial freelists are split into this many occupancy buckets (at
+// most 4, the bucket index is stored in 2 bits of MiniHeap flags)
+static constexpr size_t kBinnedTrackerBinCount = 4;
 static constexpr size_t kBinnedTrackerMaxEmpty = 128;
 
+// bytes of empty miniheaps each size class keeps on its empty list
+// across mesh passes (mesh.empty_retain_bytes), rather than returning
+// their spans to the arena.  Reusing one skips both refaulting its
+// pages and constructing a new MiniHeap.  0 returns them all.
+static constexpr size_t kDefaultEmptyRetainBytes = 0;
+
 // Runtime page count calculation
 static inline size_t PageCount(size_t sz) {
   const auto pageSize = getPageSize();
@@ -352,6 +463,28 @@ inline time_point ATTRIBUTE_ALWAYS_INLINE now() {
   return std::chrono::high_resolution_clock::now();
 #endif
 }
+
+// like now(), but without the coarse clock's multi-millisecond
+// granularity.  Used to measure how long meshing holds locks.
+inline time_point ATTRIBUTE_ALWAYS_INLINE preciseNow() {
+#ifdef __linux__
+  using namespace std::chrono;
+  struct timespec tp;
+  auto err = clock_gettime(CLOCK_MONOTONIC, &tp);
+  hard_assert(err == 0);
+  return time_point(seconds(tp.tv_sec) + nanoseconds(tp.tv_nsec));
+#else
+  return std::chrono::high_resolution_clock::now();
+#endif
+}
+
+// CPU time consumed so far by the calling thread
+inline std::chrono::nanoseconds threadCpuTime() {
+  struct timespec tp;
+  auto err = clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp);
+  hard_assert(err == 0);
+  return std::chrono::seconds(tp.tv_sec) + std::chrono::nanoseconds(tp.tv_nsec);
+}
 }  // namespace time
 
 #define PREDICT_TRUE likely
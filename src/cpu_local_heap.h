@@ -0,0 +1,157 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#pragma once
+#ifndef MESH_CPU_LOCAL_HEAP_H
+#define MESH_CPU_LOCAL_HEAP_H
+
+#ifdef __linux__
+#include <sched.h>
+#if __has_include(<sys/rseq.h>)
+#include <sys/rseq.h>
+#endif
+#endif
+
+#include "common.h"
+#include "internal.h"
+#include "thread_local_heap.h"
+
+namespace mesh {
+
+// Per-CPU heaps are an alternative to per-thread heaps (built with
+// MESH_PERCPU_HEAPS).  Each CPU gets one set of shuffle vectors, so
+// the memory sitting in attached miniheaps is bounded by the number of
+// cores rather than threads, and miniheaps aren't pinned by idle
+// threads where the mesher can't touch them.
+//
+// Unlike tcmalloc we don't run the fast path inside an rseq critical
+// section: a shuffle vector malloc or free is far more than a single
+// committing store.  rseq just gives us a cheap CPU id, and each CPU's
+// heap is guarded by a mutex that is uncontended unless a thread is
+// preempted or migrated while holding it.
+
+// owner ids for per-CPU heaps count down from here, below
+// GlobalHeap::kDepotOwner and any real tid
+static constexpr pid_t kCpuHeapOwner = -2;
+
+inline int currentCpu() {
+#if defined(__linux__) && defined(RSEQ_SIG)
+  // glibc registers an rseq area for every thread, which the kernel
+  // keeps updated with the CPU we're running on
+  if (likely(__rseq_size > 0)) {
+    const auto rs = reinterpret_cast<const volatile struct rseq *>(
+        reinterpret_cast<const char *>(__builtin_thread_pointer()) + __rseq_offset);
+    const int32_t cpu = rs->cpu_id;
+    if (likely(cpu >= 0)) {
+      return cpu;
+    }
+  }
+#endif
+#ifdef __linux__
+  const int cpu = sched_getcpu();
+  return cpu < 0 ? 0 : cpu;
+#else
+  return 0;
+#endif
+}
+
+// RAII handle to the current CPU's heap, locked for the lifetime of the
+// handle.
+template <size_t PageSize>
+class CpuLocalHeap {
+private:
+  DISALLOW_COPY_AND_ASSIGN(CpuLocalHeap);
+
+public:
+  using ThreadLocalHeapT = ThreadLocalHeap<PageSize>;
+
+  CpuLocalHeap() {
+    const size_t cpu = static_cast<size_t>(currentCpu()) % kMaxCpuHeaps;
+    if (likely(_depth == 0)) {
+      _slot = &_slots[cpu];
+      _slot->lock.lock();
+    } else {
+      // we re-entered malloc while holding a CPU heap (e.g. a mesh
+      // worker being started from the free path).  Rather than
+      // deadlocking on our own slot, borrow the next free one.
+      for (size_t i = 1;; i++) {
+        _slot = &_slots[(cpu + i) % kMaxCpuHeaps];
+        if (_slot->lock.try_lock()) {
+          break;
+        }
+      }
+    }
+    _depth++;
+
+    if (unlikely(_slot->heap == nullptr)) {
+      _slot->heap = NewHeap(_slot - _slots);
+    }
+  }
+
+  ~CpuLocalHeap() {
+    _depth--;
+    _slot->lock.unlock();
+  }
+
+  inline ThreadLocalHeapT *operator->() const {
+    return _slot->heap;
+  }
+
+  static pid_t OwnerFor(size_t cpu) {
+    return kCpuHeapOwner - static_cast<pid_t>(cpu);
+  }
+
+  // return every CPU heap's attached miniheaps to the global heap
+  static void ReleaseAll() {
+    for (auto &slot : _slots) {
+      lock_guard<mutex> lock(slot.lock);
+      if (slot.heap != nullptr) {
+        slot.heap->releaseAll();
+      }
+    }
+  }
+
+  // used around fork, so that the child doesn't inherit a CPU heap
+  // locked by a thread that no longer exists
+  static void LockAll() {
+    for (auto &slot : _slots) {
+      slot.lock.lock();
+    }
+  }
+
+  static void UnlockAll() {
+    for (auto &slot : _slots) {
+      slot.lock.unlock();
+    }
+  }
+
+private:
+  struct CACHELINE_ALIGNED CpuSlot {
+    mutex lock{};
+    ThreadLocalHeapT *heap{nullptr};
+  };
+
+  static ThreadLocalHeapT *NewHeap(size_t cpu) {
+    void *buf = mesh::internal::Heap().malloc(sizeof(ThreadLocalHeapT));
+    hard_assert(buf != nullptr);
+    hard_assert(reinterpret_cast<uintptr_t>(buf) % CACHELINE_SIZE == 0);
+
+    return new (buf) ThreadLocalHeapT(&mesh::runtime<PageSize>().heap(), pthread_t{}, OwnerFor(cpu));
+  }
+
+  CpuSlot *_slot{nullptr};
+
+  static CpuSlot _slots[kMaxCpuHeaps];
+  // how many CPU heaps this thread currently holds
+  static __thread uint32_t _depth ATTR_INITIAL_EXEC;
+};
+
+template <size_t PageSize>
+typename CpuLocalHeap<PageSize>::CpuSlot CpuLocalHeap<PageSize>::_slots[kMaxCpuHeaps];
+template <size_t PageSize>
+__thread uint32_t CpuLocalHeap<PageSize>::_depth;
+}  // namespace mesh
+
+#endif  // MESH_CPU_LOCAL_HEAP_H
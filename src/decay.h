@@ -0,0 +1,108 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#pragma once
+#ifndef MESH_DECAY_H
+#define MESH_DECAY_H
+
+#include <algorithm>
+#include <chrono>
+
+#include "common.h"
+
+namespace mesh {
+
+// Decides how many free pages may stay in one purge stage (dirty or
+// muzzy), in the style of jemalloc's decay.  Time is split into
+// kDecayEpochs epochs per decay period.  Pages that entered the stage
+// i epochs ago are allowed to stay in proportion (kDecayEpochs - i) /
+// kDecayEpochs, so a burst of frees drains out linearly over the
+// decay period instead of all at once.
+//
+// A decay time of 0 disables decay for the stage.  Not thread safe:
+// the arena serializes access under its lock.
+class Decay {
+private:
+  DISALLOW_COPY_AND_ASSIGN(Decay);
+
+public:
+  Decay() {
+  }
+
+  bool enabled() const {
+    return _decayMs > 0;
+  }
+
+  size_t decayMs() const {
+    return _decayMs;
+  }
+
+  std::chrono::milliseconds epochLength() const {
+    return std::chrono::milliseconds{std::max(_decayMs / kDecayEpochs, static_cast<size_t>(1))};
+  }
+
+  // takes effect from the next epoch.  Pages already in the stage are
+  // treated as if they had just entered it.
+  void setDecayMs(size_t decayMs, time::time_point now, size_t currentPages) {
+    _decayMs = decayMs;
+    _epochStart = now;
+    for (size_t i = 0; i < kDecayEpochs; i++) {
+      _backlog[i] = 0;
+    }
+    _entered = currentPages;
+  }
+
+  // pageCount pages entered the stage
+  inline void record(size_t pageCount) {
+    _entered += pageCount;
+  }
+
+  // advances to now, and returns how many of the currentPages pages in
+  // the stage are past their time and should move on.  Only returns
+  // non-zero at epoch boundaries.
+  size_t update(time::time_point now, size_t currentPages) {
+    if (!enabled() || now < _epochStart) {
+      return 0;
+    }
+
+    const auto epoch = epochLength();
+    const size_t elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - _epochStart) / epoch;
+    if (elapsed == 0) {
+      return 0;
+    }
+    _epochStart += epoch * elapsed;
+
+    const size_t shift = std::min(elapsed, kDecayEpochs);
+    for (size_t i = kDecayEpochs; i-- > shift;) {
+      _backlog[i] = _backlog[i - shift];
+    }
+    for (size_t i = 0; i < shift; i++) {
+      _backlog[i] = 0;
+    }
+    if (shift < kDecayEpochs) {
+      _backlog[shift - 1] = _entered;
+    }
+    _entered = 0;
+
+    size_t limit = 0;
+    for (size_t i = 0; i < kDecayEpochs; i++) {
+      limit += _backlog[i] * (kDecayEpochs - i) / kDecayEpochs;
+    }
+
+    return currentPages > limit ? currentPages - limit : 0;
+  }
+
+private:
+  size_t _decayMs{0};
+  time::time_point _epochStart{};
+  // pages that entered the stage in each of the last kDecayEpochs
+  // epochs, most recent first
+  size_t _backlog[kDecayEpochs]{};
+  // pages that entered the stage in the current epoch
+  size_t _entered{0};
+};
+}  // namespace mesh
+
+#endif  // MESH_DECAY_H
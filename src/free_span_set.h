@@ -0,0 +1,227 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#pragma once
+#ifndef MESH_FREE_SPAN_SET_H
+#define MESH_FREE_SPAN_SET_H
+
+#include <limits>
+#include <utility>
+
+#include "internal.h"
+
+namespace mesh {
+
+// A set of free spans of arena pages, indexed both by address (to
+// coalesce a freed span with its free neighbours) and by length (for
+// best-fit allocation).  Adding, taking and coalescing are all
+// O(log n) in the number of free spans, so unlike a fixed array of
+// span-class lists, a fragmented arena doesn't make every allocation
+// walk a long list of too-small spans.
+//
+// Not thread safe: the arena serializes access under its lock.
+class FreeSpanSet {
+private:
+  DISALLOW_COPY_AND_ASSIGN(FreeSpanSet);
+
+public:
+  static constexpr Offset kNoBound = std::numeric_limits<Offset>::max();
+
+  FreeSpanSet() {
+  }
+
+  // adds span to the set, merging it with any adjacent free spans that
+  // lie entirely within [lo, hi).
+  void add(Span span, Offset lo = 0, Offset hi = kNoBound) {
+    d_assert(!span.empty());
+    d_assert(span.offset >= lo && span.offset + span.length <= hi);
+    _pageCount += span.length;
+
+    auto next = _byOffset.lower_bound(span.offset);
+    d_assert(next == _byOffset.end() || next->first >= span.offset + span.length);
+
+    if (next != _byOffset.begin()) {
+      auto prev = std::prev(next);
+      d_assert(prev->first + prev->second <= span.offset);
+      if (prev->first + prev->second == span.offset && prev->first >= lo) {
+        span = Span(prev->first, prev->second + span.length);
+        eraseFromLength(prev->first, prev->second);
+        _byOffset.erase(prev);
+      }
+    }
+
+    if (next != _byOffset.end() && next->first == span.offset + span.length &&
+        next->first + next->second <= hi) {
+      span.length += next->second;
+      eraseFromLength(next->first, next->second);
+      _byOffset.erase(next);
+    }
+
+    insert(span);
+  }
+
+  // removes the smallest span of at least pageCount pages (the lowest
+  // addressed one on a tie), and returns its first pageCount pages in
+  // result.  The rest of the span stays in the set.
+  bool take(size_t pageCount, Span &result) {
+    d_assert(pageCount > 0);
+    auto it = _byLength.lower_bound(std::make_pair(static_cast<Length>(pageCount), Offset{0}));
+    if (it == _byLength.end()) {
+      return false;
+    }
+
+    Span span(it->second, it->first);
+    _byLength.erase(it);
+    _byOffset.erase(span.offset);
+    _pageCount -= span.length;
+
+    // the rest was already coalesced as far as it could be
+    Span rest = span.splitAfter(pageCount);
+    if (!rest.empty()) {
+      insert(rest);
+      _pageCount += rest.length;
+    }
+
+    result = span;
+    return true;
+  }
+
+  // removes the lowest addressed span, returning it in result
+  bool pop(Span &result) {
+    if (_byOffset.empty()) {
+      return false;
+    }
+
+    auto it = _byOffset.begin();
+    result = Span(it->first, it->second);
+    eraseFromLength(it->first, it->second);
+    _pageCount -= it->second;
+    _byOffset.erase(it);
+    return true;
+  }
+
+  // removes every span lying entirely within [begin, end)
+  void removeRange(Offset begin, Offset end) {
+    auto it = _byOffset.lower_bound(begin);
+    while (it != _byOffset.end() && it->first + it->second <= end) {
+      eraseFromLength(it->first, it->second);
+      _pageCount -= it->second;
+      it = _byOffset.erase(it);
+    }
+  }
+
+  void clear() {
+    _byOffset.clear();
+    _byLength.clear();
+    _pageCount = 0;
+  }
+
+  bool empty() const {
+    return _byOffset.empty();
+  }
+
+  // number of spans in the set
+  size_t size() const {
+    return _byOffset.size();
+  }
+
+  // total pages across all spans
+  size_t pageCount() const {
+    return _pageCount;
+  }
+
+  // calls func on each span in address order
+  template <typename Func>
+  void forEach(const Func func) const {
+    for (const auto &entry : _byOffset) {
+      func(Span(entry.first, entry.second));
+    }
+  }
+
+private:
+  inline void insert(const Span &span) {
+    _byOffset.emplace(span.offset, span.length);
+    _byLength.emplace(span.length, span.offset);
+  }
+
+  inline void eraseFromLength(Offset off, Length len) {
+    const auto n = _byLength.erase(std::make_pair(len, off));
+    d_assert(n == 1);
+    (void)n;
+  }
+
+  internal::map<Offset, Length> _byOffset{};
+  internal::set<std::pair<Length, Offset>> _byLength{};
+  size_t _pageCount{0};
+};
+
+// Free spans whose pages were faulted in on a known NUMA node, kept in
+// a FreeSpanSet per node so reuse can prefer local memory.  Spans on
+// different nodes never coalesce.
+//
+// Not thread safe: the arena serializes access under its lock.
+class NodeSpanSets {
+private:
+  DISALLOW_COPY_AND_ASSIGN(NodeSpanSets);
+
+public:
+  NodeSpanSets() {
+  }
+
+  inline FreeSpanSet &operator[](size_t node) {
+    d_assert(node < kMaxNumaNodes);
+    return _sets[node];
+  }
+
+  inline const FreeSpanSet &operator[](size_t node) const {
+    d_assert(node < kMaxNumaNodes);
+    return _sets[node];
+  }
+
+  // removes the lowest addressed span of the first node that has one,
+  // returning it and its node
+  bool pop(Span &result, size_t &node) {
+    for (size_t i = 0; i < kMaxNumaNodes; i++) {
+      if (_sets[i].pop(result)) {
+        node = i;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void clear() {
+    for (auto &set : _sets) {
+      set.clear();
+    }
+  }
+
+  bool empty() const {
+    return pageCount() == 0;
+  }
+
+  // total pages across all nodes
+  size_t pageCount() const {
+    size_t count = 0;
+    for (const auto &set : _sets) {
+      count += set.pageCount();
+    }
+    return count;
+  }
+
+  // calls func on each span, node by node
+  template <typename Func>
+  void forEach(const Func func) const {
+    for (const auto &set : _sets) {
+      set.forEach(func);
+    }
+  }
+
+private:
+  FreeSpanSet _sets[kMaxNumaNodes]{};
+};
+}  // namespace mesh
+
+#endif  // MESH_FREE_SPAN_SET_H
@@ -11,9 +11,14 @@
 #include <array>
 #include <mutex>
 
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
 #include "internal.h"
 #include "meshable_arena.h"
 #include "mini_heap.h"
+#include "worker_pool.h"
 
 #include "heaplayers.h"
 
@@ -32,6 +37,23 @@ static_assert(sizeof(CachelinePaddedAtomicMiniHeapID) == CACHELINE_SIZE,
 static_assert(alignof(CachelinePaddedAtomicMiniHeapID) == CACHELINE_SIZE,
               "CachelinePaddedAtomicMiniHeapID must be cache-line aligned");
 
+// A size class's depot: a lock-free stack of miniheaps, linked through
+// _pendingNext, that thread-local heaps can refill from without taking
+// _miniheapLocks.  Unlike the pending list (which is only ever drained
+// whole), entries are popped one at a time, so the head packs a tag
+// that is bumped on every update next to the MiniHeapID to avoid ABA.
+struct alignas(CACHELINE_SIZE) MiniHeapDepot {
+  // low 32 bits: MiniHeapID of the top entry, high 32 bits: tag
+  std::atomic<uint64_t> head{0};
+  std::atomic<uint32_t> count{0};
+};
+static_assert(sizeof(MiniHeapDepot) == CACHELINE_SIZE, "MiniHeapDepot must be exactly one cache line");
+
+// miniheaps in a depot are attached to this (never a real thread id),
+// so frees treat them like any other thread's miniheap and meshing
+// leaves them alone
+static constexpr pid_t kDepotOwner = -1;
+
 class EpochLock {
 private:
   DISALLOW_COPY_AND_ASSIGN(EpochLock);
@@ -72,8 +94,34 @@ class GlobalHeapStats {
 public:
   atomic_size_t meshCount;
   size_t mhFreeCount;
-  size_t mhAllocCount;
+  // size classes may be meshed in parallel, and meshing decrements this
+  atomic_size_t mhAllocCount;
   size_t mhHighWaterMark;
+  // longest time, in microseconds, that a mesh pass (or a slice of an
+  // incremental pass) held size-class locks
+  atomic_size_t maxMeshPauseUs;
+  // passes run by (and CPU time spent in) the background mesher thread
+  size_t bgMeshPassCount;
+  size_t bgMeshCpuUs;
+  // slices the background thread has scavenged the arena in
+  size_t bgScavengeSliceCount;
+  // physical pages released by meshing
+  atomic_size_t meshPagesFreed;
+  // mprotect, mmap and hole-punching syscalls made to apply meshes
+  atomic_size_t meshSyscalls;
+  // large allocations served from (and bytes sitting in) thread-local
+  // large span caches, and cacheable allocations that missed
+  atomic_size_t largeCacheHits;
+  atomic_size_t largeCacheMisses;
+  atomic_size_t largeCachedBytes;
+  // objects freed through freeBatch, and the batches they came in
+  atomic_size_t batchedFrees;
+  atomic_size_t freeBatches;
+  // refill goal bytes threads hold above kMiniheapRefillGoalSize
+  atomic_size_t threadCacheBytes;
+  // mesh passes, and pages they freed, per mesh algorithm
+  atomic_size_t meshPasses[algorithm::Max];
+  atomic_size_t meshPassPagesFreed[algorithm::Max];
 };
 
 template <size_t PageSize>
@@ -122,6 +170,9 @@ public:
   };
 
   GlobalHeap() : Super(), _maxObjectSize(SizeMap::ByteSizeForClass(kNumBins - 1)), _lastMesh{time::now()} {
+    for (auto &buckets : _partialFreelist) {
+      buckets.fill({MiniHeapListEntryT{list::Head, list::Head}, 0});
+    }
   }
 
   inline void dumpStrings() const {
@@ -135,7 +186,7 @@ public:
 
   inline void flushAllBins() {
     for (size_t sizeClass = 0; sizeClass < kNumBins; sizeClass++) {
-      flushBinLocked(sizeClass);
+      flushBinLocked(sizeClass, false);
     }
   }
 
@@ -149,19 +200,24 @@ public:
 
   // must be called with _arenaLock AND appropriate size-class lock held
   inline MiniHeapT *ATTRIBUTE_ALWAYS_INLINE allocMiniheapLocked(int sizeClass, size_t pageCount, size_t objectCount,
-                                                                size_t objectSize, size_t pageAlignment = 1) {
+                                                                size_t objectSize, size_t pageAlignment = 1,
+                                                                bool huge = false) {
     d_assert(0 < pageCount);
+    d_assert(!huge || pageAlignment == 1);
 
     void *buf = this->_mhAllocator.alloc();
     d_assert(buf != nullptr);
 
     // allocate out of the arena
     Span span{0, 0};
-    char *spanBegin = Super::pageAlloc(span, pageCount, pageAlignment);
+    char *spanBegin = huge ? Super::hugePageAlloc(span, pageCount) : Super::pageAlloc(span, pageCount, pageAlignment);
     d_assert(spanBegin != nullptr);
     d_assert((reinterpret_cast<uintptr_t>(spanBegin) / getPageSize()) % pageAlignment == 0);
 
     MiniHeapT *mh = new (buf) MiniHeapT(this->arenaBegin(), span, objectCount, objectSize);
+    if (huge) {
+      mh->setHuge();
+    }
 
     const auto miniheapID = MiniHeapID{this->_mhAllocator.offsetFor(buf)};
     Super::trackMiniHeap(span, miniheapID);
@@ -200,12 +256,13 @@ public:
     return ptr;
   }
 
-  inline MiniHeapListEntryT *freelistFor(uint8_t freelistId, int sizeClass) {
-    switch (freelistId) {
+  inline MiniHeapListEntryT *freelistFor(const MiniHeapT *mh) {
+    const auto sizeClass = mh->sizeClass();
+    switch (mh->freelistId()) {
     case list::Empty:
       return &_emptyFreelist[sizeClass].first;
     case list::Partial:
-      return &_partialFreelist[sizeClass].first;
+      return &_partialFreelist[sizeClass][mh->partialBucket()].first;
     case list::Full:
       // Full miniheaps are not on any list (lock-free transition path)
       return nullptr;
@@ -214,6 +271,27 @@ public:
     return nullptr;
   }
 
+  // the occupancy bucket a partially-full miniheap belongs in; bucket
+  // 0 holds the emptiest miniheaps
+  static inline uint8_t partialBucketFor(size_t inUse, size_t max) {
+    d_assert(inUse > 0 && inUse < max);
+    return static_cast<uint8_t>(inUse * kBinnedTrackerBinCount / max);
+  }
+
+  // add mh to the partial bucket matching its current occupancy,
+  // removing it from currFreelist (if it is on one) first.  Buckets
+  // are only recomputed when a miniheap is re-added under the
+  // size-class lock, so frees that don't take the lock leave
+  // miniheaps in a bucket that is fuller than they are -- the order
+  // is a heuristic, not an invariant.
+  inline void addPartialLocked(MiniHeapT *mh, int sizeClass, MiniHeapListEntryT *currFreelist, size_t inUse) {
+    const auto bucket = partialBucketFor(inUse, mh->maxCount());
+    auto &list = _partialFreelist[sizeClass][bucket];
+    list.first.add(currFreelist, list::Partial, list::Head, mh);
+    mh->setPartialBucket(bucket);
+    list.second++;
+  }
+
   // Drain the lock-free pending partial list into the actual partial freelist.
   // Must be called with _miniheapLocks[sizeClass] held.
   inline void drainPendingPartialLocked(int sizeClass) {
@@ -247,8 +325,7 @@ public:
         // transition complete even though it's already Full.
       } else {
         // Common case: add to partial freelist
-        _partialFreelist[sizeClass].first.add(nullptr, list::Partial, list::Head, mh);
-        _partialFreelist[sizeClass].second++;
+        addPartialLocked(mh, sizeClass, nullptr, inUse);
       }
 
       // Clear pending AFTER freelistId is updated. This closes the race window.
@@ -277,6 +354,97 @@ public:
                                                                         std::memory_order_relaxed));
   }
 
+  static inline uint64_t depotHead(MiniHeapID top, uint64_t oldHead) {
+    return ((oldHead >> 32) + 1) << 32 | top.value();
+  }
+
+  // push a chain of miniheaps (already attached to kDepotOwner) onto
+  // the size class's depot.  Called with _miniheapLocks[sizeClass]
+  // held, which makes us the only pusher.
+  template <uint32_t Size>
+  inline void pushDepotLocked(int sizeClass, FixedArray<MiniHeapT, Size> &miniheaps) {
+    if (miniheaps.size() == 0) {
+      return;
+    }
+
+    for (size_t i = 1; i < miniheaps.size(); i++) {
+      miniheaps[i - 1]->setPendingNext(GetMiniHeapID(miniheaps[i]));
+    }
+
+    auto &depot = _depot[sizeClass];
+    MiniHeapT *last = miniheaps[miniheaps.size() - 1];
+    uint64_t oldHead = depot.head.load(std::memory_order_relaxed);
+    uint64_t newHead;
+    do {
+      last->setPendingNext(MiniHeapID{static_cast<uint32_t>(oldHead)});
+      newHead = depotHead(GetMiniHeapID(miniheaps[0]), oldHead);
+    } while (!depot.head.compare_exchange_weak(oldHead, newHead, std::memory_order_release,
+                                               std::memory_order_relaxed));
+    depot.count.fetch_add(miniheaps.size(), std::memory_order_relaxed);
+    miniheaps.clear();
+  }
+
+  // pop a single miniheap from the size class's depot, or return
+  // nullptr if it is empty.  Lock-free.
+  inline MiniHeapT *popDepot(int sizeClass) {
+    auto &depot = _depot[sizeClass];
+    uint64_t oldHead = depot.head.load(std::memory_order_acquire);
+    while (true) {
+      const MiniHeapID top{static_cast<uint32_t>(oldHead)};
+      if (!top.hasValue()) {
+        return nullptr;
+      }
+      // top may be popped + reused by another thread after we read
+      // the head; the tag makes our CAS fail if so, which makes this
+      // (possibly stale) read of its link harmless.
+      MiniHeapT *mh = GetMiniHeap<MiniHeapT>(top);
+      const uint64_t newHead = depotHead(mh->pendingNext(), oldHead);
+      if (depot.head.compare_exchange_weak(oldHead, newHead, std::memory_order_acquire,
+                                           std::memory_order_acquire)) {
+        depot.count.fetch_sub(1, std::memory_order_relaxed);
+        mh->setPendingNext(MiniHeapID{});
+        d_assert(mh->current() == kDepotOwner);
+        return mh;
+      }
+    }
+  }
+
+  // return everything in the size class's depot to the freelists, so
+  // that it can be meshed or flushed.  Must be called with
+  // _miniheapLocks[sizeClass] held.
+  inline void drainDepotLocked(int sizeClass) {
+    auto &depot = _depot[sizeClass];
+    uint64_t oldHead = depot.head.load(std::memory_order_acquire);
+    while (!depot.head.compare_exchange_weak(oldHead, depotHead(MiniHeapID{}, oldHead), std::memory_order_acquire,
+                                             std::memory_order_acquire)) {
+    }
+
+    MiniHeapID next{static_cast<uint32_t>(oldHead)};
+    while (next.hasValue()) {
+      MiniHeapT *mh = GetMiniHeap<MiniHeapT>(next);
+      next = mh->pendingNext();
+      mh->setPendingNext(MiniHeapID{});
+      depot.count.fetch_sub(1, std::memory_order_relaxed);
+      releaseMiniheapLocked(mh, sizeClass);
+    }
+  }
+
+  // detach a thread's miniheap without holding _miniheapLocks.  We
+  // mark it Full while it is still attached (so a concurrent free
+  // can't move it onto a freelist underneath us), detach it, and if it
+  // turns out not to be full hand it to the pending partial list, to
+  // be sorted onto the partial or empty freelist by the next locked
+  // operation on this size class.
+  inline void releaseMiniheapLockFree(MiniHeapT *mh, int sizeClass) {
+    d_assert(mh->isAttached());
+    d_assert(mh->freelistId() == list::Attached);
+    mh->setFreelistId(list::Full);
+    mh->unsetAttached();
+    if (mh->inUseCount() < mh->maxCount()) {
+      tryPushPendingPartial(mh, sizeClass);
+    }
+  }
+
   // Must call drainPendingPartialLocked before this if not already drained.
   inline bool postFreeLocked(MiniHeapT *mh, int sizeClass, size_t inUse) {
     // its possible we raced between reading isAttached + grabbing a lock.
@@ -292,7 +460,7 @@ public:
     }
 
     const auto currFreelistId = mh->freelistId();
-    auto currFreelist = freelistFor(currFreelistId, sizeClass);
+    auto currFreelist = freelistFor(mh);
     const auto max = mh->maxCount();
 
     std::pair<MiniHeapListEntryT, size_t> *list;
@@ -319,11 +487,20 @@ public:
       mh->getFreelist()->setPrev(MiniHeapID{});
       return false;
     } else {
+      const auto bucket = partialBucketFor(inUse, max);
       if (currFreelistId == list::Partial) {
-        return false;
+        // already partial, but it may belong in a different
+        // occupancy bucket now
+        const auto currBucket = mh->partialBucket();
+        if (currBucket == bucket) {
+          return false;
+        }
+        d_assert(_partialFreelist[sizeClass][currBucket].second > 0);
+        _partialFreelist[sizeClass][currBucket].second--;
       }
       newListId = list::Partial;
-      list = &_partialFreelist[sizeClass];
+      list = &_partialFreelist[sizeClass][bucket];
+      mh->setPartialBucket(bucket);
     }
 
     list->first.add(currFreelist, newListId, list::Head, mh);
@@ -360,13 +537,14 @@ public:
 
   template <uint32_t Size>
   size_t fillFromList(FixedArray<MiniHeapT, Size> &miniheaps, pid_t current,
-                      std::pair<MiniHeapListEntryT, size_t> &freelist, size_t bytesFree) {
+                      std::pair<MiniHeapListEntryT, size_t> &freelist, size_t bytesFree, size_t goalSize,
+                      size_t maxMiniheaps) {
     if (freelist.first.empty()) {
       return bytesFree;
     }
 
     auto nextId = freelist.first.next();
-    while (nextId != list::Head && bytesFree < kMiniheapRefillGoalSize && !miniheaps.full()) {
+    while (nextId != list::Head && bytesFree < goalSize && miniheaps.size() < maxMiniheaps) {
       auto mh = GetMiniHeap<MiniHeapT>(nextId);
       d_assert(mh != nullptr);
       nextId = mh->getFreelist()->next();
@@ -379,7 +557,7 @@ public:
       // thread-local cache, things perform better!
       // bytesFree += mh->bytesFree();
       d_assert(!mh->isAttached());
-      mh->setAttached(current, freelistFor(mh->freelistId(), mh->sizeClass()));
+      mh->setAttached(current, freelistFor(mh));
       d_assert(mh->isAttached() && mh->current() == current);
       hard_assert(!miniheaps.full());
       miniheaps.append(mh);
@@ -391,21 +569,33 @@ public:
   }
 
   template <uint32_t Size>
-  size_t selectForReuse(int sizeClass, FixedArray<MiniHeapT, Size> &miniheaps, pid_t current) {
-    size_t bytesFree = fillFromList(miniheaps, current, _partialFreelist[sizeClass], 0);
-
-    if (bytesFree >= kMiniheapRefillGoalSize || miniheaps.full()) {
-      return bytesFree;
+  size_t selectForReuse(int sizeClass, FixedArray<MiniHeapT, Size> &miniheaps, pid_t current, size_t goalSize,
+                        size_t maxMiniheaps) {
+    // hand out the fullest partial miniheaps first: they have the
+    // fewest free slots to fragment, and leave the emptiest ones
+    // behind as meshing candidates
+    size_t bytesFree = 0;
+    for (size_t i = kBinnedTrackerBinCount; i > 0; i--) {
+      bytesFree =
+          fillFromList(miniheaps, current, _partialFreelist[sizeClass][i - 1], bytesFree, goalSize, maxMiniheaps);
+
+      if (bytesFree >= goalSize || miniheaps.size() >= maxMiniheaps) {
+        return bytesFree;
+      }
     }
 
     // we've exhausted all of our partially full MiniHeaps, but there
     // might still be empty ones we could reuse.
-    return fillFromList(miniheaps, current, _emptyFreelist[sizeClass], bytesFree);
+    return fillFromList(miniheaps, current, _emptyFreelist[sizeClass], bytesFree, goalSize, maxMiniheaps);
   }
 
+  // goalSize and maxMiniheaps bound how much is handed out: new
+  // miniheaps stop once goalSize bytes are free, and reuse stops at
+  // maxMiniheaps miniheaps.
   template <uint32_t Size>
   inline void allocSmallMiniheaps(int sizeClass, uint32_t objectSize, FixedArray<MiniHeapT, Size> &miniheaps,
-                                  pid_t current) {
+                                  pid_t current, bool fillDepot = false, size_t goalSize = kMiniheapRefillGoalSize,
+                                  size_t maxMiniheaps = Size) {
     d_assert(sizeClass >= 0);
     d_assert(sizeClass < kNumBins);
     d_assert(objectSize <= _maxObjectSize);
@@ -431,9 +621,73 @@ public:
 
     d_assert(miniheaps.size() == 0);
 
+    fillSmallMiniheapsLocked(sizeClass, objectSize, miniheaps, current, goalSize, maxMiniheaps);
+
+    // another thread may have refilled the depot while we waited
+    if (fillDepot && _depot[sizeClass].count.load(std::memory_order_relaxed) == 0) {
+      FixedArray<MiniHeapT, kMiniheapDepotCount> spare{};
+      fillSmallMiniheapsLocked(sizeClass, objectSize, spare, kDepotOwner, kMiniheapDepotSize);
+      pushDepotLocked(sizeClass, spare);
+    }
+  }
+
+  // like allocSmallMiniheaps, but for thread-local heaps: if the size
+  // class's depot has miniheaps we take those with a CAS instead of
+  // taking _miniheapLocks.  When we do take the lock we top the depot
+  // back up, so the next refill on any thread doesn't need to.
+  template <uint32_t Size>
+  inline void refillSmallMiniheaps(int sizeClass, uint32_t objectSize, FixedArray<MiniHeapT, Size> &miniheaps,
+                                   pid_t current, size_t goalSize = kMiniheapRefillGoalSize,
+                                   size_t maxMiniheaps = Size) {
+    if (_depot[sizeClass].count.load(std::memory_order_relaxed) > 0) {
+      MiniHeapT *mh = popDepot(sizeClass);
+      if (likely(mh != nullptr)) {
+        for (MiniHeapT *oldMH : miniheaps) {
+          releaseMiniheapLockFree(oldMH, sizeClass);
+        }
+        miniheaps.clear();
+
+        // like selectForReuse, hand over as much as we have rather
+        // than stopping at goalSize
+        do {
+          mh->setAttached(current, nullptr);
+          miniheaps.append(mh);
+        } while (miniheaps.size() < maxMiniheaps && (mh = popDepot(sizeClass)) != nullptr);
+
+        return;
+      }
+    }
+
+    allocSmallMiniheaps(sizeClass, objectSize, miniheaps, current, true, goalSize, maxMiniheaps);
+  }
+
+  // a size class is dense if none of its partial spans are less than
+  // half full: what gets freed is refilled, rather than fragmenting.
+  // With hugepages enabled, new spans for dense size classes go to
+  // hugepage chunks; the others stay meshable.  Must be called with
+  // _miniheapLocks[sizeClass] held.
+  inline bool isDenseLocked(int sizeClass) const {
+    const auto &partial = _partialFreelist[sizeClass];
+    for (size_t i = 0; i < kBinnedTrackerBinCount / 2; i++) {
+      if (partial[i].first.next() != list::Head) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // fill miniheaps, first with partial + empty miniheaps we can reuse
+  // and then with new ones, until we have goalSize bytes free.  Must
+  // be called with _miniheapLocks[sizeClass] held.
+  template <uint32_t Size>
+  inline void fillSmallMiniheapsLocked(int sizeClass, uint32_t objectSize, FixedArray<MiniHeapT, Size> &miniheaps,
+                                       pid_t current, size_t goalSize, size_t maxMiniheaps = Size) {
+    // decide before reuse drains the partial lists
+    const bool huge = Super::hugePages() && isDenseLocked(sizeClass);
+
     // Fast path: check our bins for a miniheap to reuse (no arena lock needed)
-    auto bytesFree = selectForReuse(sizeClass, miniheaps, current);
-    if (bytesFree >= kMiniheapRefillGoalSize || miniheaps.full()) {
+    auto bytesFree = selectForReuse(sizeClass, miniheaps, current, goalSize, maxMiniheaps);
+    if (bytesFree >= goalSize || miniheaps.size() >= maxMiniheaps) {
       return;
     }
 
@@ -450,10 +704,10 @@ public:
         min(max(getPageSize() / objectSize, static_cast<size_t>(kMinStringLen)), static_cast<size_t>(bitmapLimit));
     const size_t pageCount = PageCount(objectSize * objectCount);
 
-    while (bytesFree < kMiniheapRefillGoalSize && !miniheaps.full()) {
-      auto mh = allocMiniheapLocked(sizeClass, pageCount, objectCount, objectSize);
+    while (bytesFree < goalSize && miniheaps.size() < maxMiniheaps) {
+      auto mh = allocMiniheapLocked(sizeClass, pageCount, objectCount, objectSize, 1, huge);
       d_assert(!mh->isAttached());
-      mh->setAttached(current, freelistFor(mh->freelistId(), sizeClass));
+      mh->setAttached(current, freelistFor(mh));
       d_assert(mh->isAttached() && mh->current() == current);
       miniheaps.append(mh);
       bytesFree += mh->bytesFree();
@@ -488,10 +742,20 @@ public:
   void untrackMiniheapLocked(MiniHeapT *mh) {
     // mesh::debug("%p (%u) untracked!\n", mh, GetMiniHeapID(mh));
     _stats.mhAllocCount -= 1;
-    mh->getFreelist()->remove(freelistFor(mh->freelistId(), mh->sizeClass()));
+    mh->getFreelist()->remove(freelistFor(mh));
   }
 
   void freeFor(MiniHeapT *mh, void *ptr, size_t startEpoch);
+  // frees count objects.  Objects in the same miniheap share one
+  // atomic update of its bitmap, and miniheaps the batch empties share
+  // one acquisition of their size class's lock.
+  void freeBatch(void *const *ptrs, size_t count);
+  // the slow halves of freeFor: finishing a free that may have raced
+  // with meshing (returns true if meshing might now pay off), and
+  // releasing the miniheap of a free that emptied it, with its size
+  // class's lock held
+  bool freeRacedWithMesh(MiniHeapT *origMh, void *ptr, int sizeClass, bool wasSet);
+  void postFreeEmptiedLocked(MiniHeapT *origMh, void *ptr, int sizeClass);
 
   // called with lock held
   void freeMiniheapAfterMeshLocked(MiniHeapT *mh, bool untrack = true) {
@@ -526,48 +790,94 @@ public:
   // must be called with _arenaLock AND appropriate size-class lock held
   void freeMiniheapLocked(MiniHeapT *&mh, bool untrack) {
     const auto spanSize = mh->spanSize();
-    MiniHeapT *toFree[kMaxMeshes];
-    size_t last = 0;
-
-    memset(toFree, 0, sizeof(*toFree) * kMaxMeshes);
 
-    // avoid use after frees while freeing
-    mh->forEachMeshed([&](MiniHeapT *mh) {
-      toFree[last++] = mh;
-      return false;
-    });
+    if (mh->hasMeshed()) {
+      const size_t groupSize = meshGroupSize(mh);
+      _meshGroupHistogram[mh->sizeClass()][meshGroupBucket(groupSize)]--;
+      _meshGroupSizes[miniheapIDFor(mh).value()] = 0;
+    }
 
-    for (size_t i = 0; i < last; i++) {
-      MiniHeapT *mh = toFree[i];
-      const bool isMeshed = mh->isMeshed();
+    // walk the ring, reading each next link before freeing the
+    // miniheap that holds it
+    MiniHeapT *const first = mh;
+    MiniHeapT *cur = first;
+    do {
+      MiniHeapT *next = cur->nextMeshed();
+      const bool isMeshed = cur->isMeshed();
       const auto type = isMeshed ? internal::PageType::Meshed : internal::PageType::Dirty;
-      Super::free(reinterpret_cast<void *>(mh->getSpanStart(this->arenaBegin())), spanSize, type);
+      Super::free(reinterpret_cast<void *>(cur->getSpanStart(this->arenaBegin())), spanSize, type);
       _stats.mhFreeCount++;
-      freeMiniheapAfterMeshLocked(mh, untrack);
-    }
+      freeMiniheapAfterMeshLocked(cur, untrack);
+      cur = next;
+    } while (cur != first);
 
     mh = nullptr;
   }
 
-  // flushBinLocked empties _emptyFreelist[sizeClass]
-  inline void flushBinLocked(size_t sizeClass) {
+  // the number of miniheaps meshed together with mh (1 if it isn't
+  // meshed), in O(1).  mh must be the group's primary miniheap -- the
+  // one that owns the span -- and the size-class lock must be held.
+  size_t meshGroupSize(const MiniHeapT *mh) const {
+    d_assert(!mh->isMeshed());
+    return _meshGroupSizes[miniheapIDFor(mh).value()] + 1;
+  }
+
+  // histogram bucket i counts mesh groups of (2^i, 2^(i+1)] miniheaps
+  static inline size_t meshGroupBucket(size_t groupSize) {
+    d_assert(groupSize > 1 && groupSize <= kMaxMeshes);
+    return 63 - __builtin_clzll(groupSize - 1);
+  }
+
+  // mesh groups of each size, bucketed by meshGroupBucket
+  void meshGroupHistogram(size_t sizeClass, size_t (&buckets)[kMeshGroupBuckets]) const {
+    d_assert(sizeClass < kNumBins);
+    lock_guard<mutex> lock(_miniheapLocks[sizeClass]);
+    for (size_t i = 0; i < kMeshGroupBuckets; i++) {
+      buckets[i] = _meshGroupHistogram[sizeClass][i];
+    }
+  }
+
+  // flushBinLocked empties _emptyFreelist[sizeClass], except that if
+  // retain is set the most recently emptied miniheaps are kept, up to
+  // emptyRetainBytes() bytes of them.  Only unmeshed miniheaps are
+  // kept: a meshed one still holds its extra virtual spans.
+  inline void flushBinLocked(size_t sizeClass, bool retain = true) {
     // mesh::debug("flush bin %zu\n", sizeClass);
     d_assert(!_emptyFreelist[sizeClass].first.empty());
     if (_emptyFreelist[sizeClass].first.next() == list::Head) {
       return;
     }
 
+    const size_t retainBytes = retain ? emptyRetainBytes() : 0;
+    size_t retainedBytes = 0;
+
+    // newly emptied miniheaps are added at the tail, so walk back
+    // from it to keep the most recent ones
     std::pair<MiniHeapListEntryT, size_t> &empty = _emptyFreelist[sizeClass];
-    MiniHeapID nextId = empty.first.next();
-    while (nextId != list::Head) {
-      auto mh = GetMiniHeap<MiniHeapT>(nextId);
-      nextId = mh->getFreelist()->next();
+    MiniHeapID prevId = empty.first.prev();
+    while (prevId != list::Head) {
+      auto mh = GetMiniHeap<MiniHeapT>(prevId);
+      prevId = mh->getFreelist()->prev();
+      if (!mh->hasMeshed() && retainedBytes + mh->spanSize() <= retainBytes) {
+        retainedBytes += mh->spanSize();
+        continue;
+      }
+      // untracking takes it off the empty list
       freeMiniheapLocked(mh, true);
       empty.second--;
     }
 
-    d_assert(empty.first.next() == list::Head);
-    d_assert(empty.first.prev() == list::Head);
+    d_assert(retainedBytes > 0 || empty.first.next() == list::Head);
+    d_assert(retainedBytes > 0 || empty.first.prev() == list::Head);
+  }
+
+  // bytes of empty miniheaps kept on a size class's empty list
+  size_t emptyRetainBytes() const {
+    return _emptyRetainBytes.load(std::memory_order_relaxed);
+  }
+
+  void setEmptyRetainBytes(size_t bytes) {
+    _emptyRetainBytes = bytes;
   }
 
   void ATTRIBUTE_NEVER_INLINE free(void *ptr);
@@ -612,27 +922,261 @@ public:
     _meshPeriodMs = period;
   }
 
+  // how many bytes of freed large allocations each thread may cache
+  // (0 disables the cache)
+  size_t largeCacheBytes() const {
+    return _largeCacheBytes.load(std::memory_order_relaxed);
+  }
+
+  void setLargeCacheBytes(size_t bytes) {
+    _largeCacheBytes = bytes;
+  }
+
+  inline void recordLargeCacheLookup(bool hit) {
+    if (hit) {
+      _stats.largeCacheHits.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      _stats.largeCacheMisses.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  inline void recordLargeCached(ssize_t bytes) {
+    _stats.largeCachedBytes.fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  // how many frees of objects in miniheaps it doesn't own each thread
+  // may buffer before handing them to freeBatch (0 frees them one at
+  // a time)
+  size_t remoteFreeBatch() const {
+    return _remoteFreeBatch.load(std::memory_order_relaxed);
+  }
+
+  void setRemoteFreeBatch(size_t count) {
+    _remoteFreeBatch = std::min(count, kRemoteFreeBatch);
+  }
+
+  // how many refill goal bytes above kMiniheapRefillGoalSize all
+  // threads together may hold.  Lowering it below what is in use
+  // only stops further growth; goals shrink back as classes go cold.
+  size_t threadCacheBytes() const {
+    return _threadCacheBytes.load(std::memory_order_relaxed);
+  }
+
+  void setThreadCacheBytes(size_t bytes) {
+    _threadCacheBytes = bytes;
+  }
+
+  // reserves bytes of the thread cache budget for a growing refill
+  // goal, returning false (and reserving nothing) if that would go
+  // over budget
+  inline bool reserveThreadCache(size_t bytes) {
+    const size_t budget = threadCacheBytes();
+    size_t used = _stats.threadCacheBytes.load(std::memory_order_relaxed);
+    do {
+      if (used + bytes > budget) {
+        return false;
+      }
+    } while (!_stats.threadCacheBytes.compare_exchange_weak(used, used + bytes, std::memory_order_relaxed));
+    return true;
+  }
+
+  inline void releaseThreadCache(size_t bytes) {
+    _stats.threadCacheBytes.fetch_sub(bytes, std::memory_order_relaxed);
+  }
+
+  // in incremental mode, meshing holds a single size class's lock at
+  // a time and drops it every few merge sets, rather than stopping
+  // the world for the whole pass.
+  void setMeshIncremental(bool incremental) {
+    _meshIncremental = incremental;
+  }
+
+  bool meshIncremental() const {
+    return _meshIncremental.load(std::memory_order_relaxed);
+  }
+
+  // one of the algorithm:: constants.  Takes effect from the next size
+  // class meshed.
+  void setMeshAlgorithm(size_t meshAlgorithm) {
+    if (meshAlgorithm < algorithm::Max) {
+      _meshAlgorithm = meshAlgorithm;
+    }
+  }
+
+  size_t meshAlgorithm() const {
+    return _meshAlgorithm.load(std::memory_order_relaxed);
+  }
+
+  // hand meshing off to the background thread: rather than meshing
+  // inline, a thread that notices the mesh period has elapsed posts a
+  // hint to meshHintFd(), which the background thread polls.  Only
+  // supported on Linux, where the background thread exists.
+  void enableBackgroundMeshing() {
+#ifdef __linux__
+    if (_meshHintFd < 0) {
+      _meshHintFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+      hard_assert(_meshHintFd >= 0);
+    }
+    _backgroundMeshing = true;
+
+    lock_guard<mutex> arenaLock(_arenaLock);
+    Super::enableBackgroundScavenging();
+#endif
+  }
+
+  int meshHintFd() const {
+    return _meshHintFd;
+  }
+
+  // go back to meshing inline, e.g. in the child of a fork (where the
+  // background thread no longer exists).
+  void disableBackgroundMeshing() {
+    _backgroundMeshing = false;
+    _meshHintPending = false;
+    if (_meshHintFd >= 0) {
+      close(_meshHintFd);
+      _meshHintFd = -1;
+    }
+
+    Super::disableBackgroundScavenging();
+  }
+
+  bool backgroundMeshing() const {
+    return _backgroundMeshing.load(std::memory_order_relaxed);
+  }
+
+  // mesh up to threadCount size classes at a time during a
+  // stop-the-world mesh pass.  1 (the default) meshes on the calling
+  // thread only.
+  void setMeshThreads(size_t threadCount) {
+    threadCount = std::min(std::max(threadCount, static_cast<size_t>(1)), kMaxMeshThreads);
+
+    if (threadCount == meshThreads()) {
+      return;
+    }
+
+    // starting threads allocates (and creates thread-local heaps,
+    // which takes every heap lock), so build the new pool and tear
+    // down the old one without holding _meshPoolLock.
+    WorkerPool *pool = nullptr;
+    if (threadCount > 1) {
+      void *buf = internal::Heap().malloc(sizeof(WorkerPool));
+      hard_assert(buf != nullptr);
+      pool = new (buf) WorkerPool(threadCount);
+    }
+
+    {
+      lock_guard<mutex> lock(_meshPoolLock);
+      std::swap(pool, _meshPool);
+    }
+
+    if (pool != nullptr) {
+      pool->~WorkerPool();
+      internal::Heap().free(pool);
+    }
+  }
+
+  size_t meshThreads() const {
+    lock_guard<mutex> lock(_meshPoolLock);
+    return meshThreadsLocked();
+  }
+
+  // the pool's threads don't exist in the child of a fork; forget
+  // about them (without joining) and go back to meshing serially.
+  void abandonMeshThreads() {
+    _meshPool = nullptr;
+  }
+
+  void setBackgroundMeshBudgetMs(size_t budgetMs) {
+    _bgMeshBudgetMs = budgetMs;
+  }
+
+  size_t backgroundMeshBudgetMs() const {
+    return _bgMeshBudgetMs.load(std::memory_order_relaxed);
+  }
+
+  // run a mesh pass on behalf of threads that posted a hint.  Called
+  // from the background thread; returns the CPU time the pass took.
+  std::chrono::nanoseconds backgroundMesh() {
+    const auto cpuStart = time::threadCpuTime();
+
+    if (meshIncremental()) {
+      lock_guard<mutex> passLock(_incrementalMeshLock);
+      meshAllSizeClassesIncremental();
+    } else {
+      AllLocksGuard allLocks(_miniheapLocks, _largeAllocLock, _arenaLock);
+      meshAllSizeClassesLocked();
+    }
+
+    _lastMesh = time::now();
+    // clear this only after updating _lastMesh, so that threads
+    // freeing while the pass ran don't immediately queue another one
+    _meshHintPending.store(false, std::memory_order_release);
+
+    const auto cpuUsed = time::threadCpuTime() - cpuStart;
+    {
+      lock_guard<mutex> arenaLock(_arenaLock);
+      _stats.bgMeshPassCount++;
+      _stats.bgMeshCpuUs += chrono::duration_cast<chrono::microseconds>(cpuUsed).count();
+    }
+
+    return cpuUsed;
+  }
+
+  // answer a scavenge hint: scavenge in slices of
+  // kScavengeSlicePages pages, dropping the arena lock in between so
+  // that allocation isn't held up behind the whole scavenge.
+  void backgroundScavenge() {
+    bool moreWork = true;
+    while (moreWork) {
+      lock_guard<mutex> arenaLock(_arenaLock);
+      // we may only have been woken to pick up new decay settings
+      if (!Super::scavengeHintPending()) {
+        break;
+      }
+      moreWork = Super::scavengeSlice(kScavengeSlicePages);
+      _stats.bgScavengeSliceCount++;
+    }
+  }
+
+  // age out dirty and muzzy pages on behalf of the background thread.
+  // Returns how long to wait before calling again, or a zero duration
+  // if decay is off.
+  std::chrono::milliseconds backgroundDecay() {
+    lock_guard<mutex> arenaLock(_arenaLock);
+    Super::decay(time::now());
+    return Super::decayInterval();
+  }
+
   void lock() {
+    // an in-progress incremental pass holds this while it takes
+    // size-class locks, so it comes first.
+    _incrementalMeshLock.lock();
     // Acquire all locks in consistent order: size-classes -> large -> arena
     for (size_t i = 0; i < kNumBins; i++) {
       _miniheapLocks[i].lock();
     }
     _largeAllocLock.lock();
     _arenaLock.lock();
+    _meshPoolLock.lock();
   }
 
   void unlock() {
     // Release in reverse order
+    _meshPoolLock.unlock();
     _arenaLock.unlock();
     _largeAllocLock.unlock();
     for (size_t i = kNumBins; i > 0; i--) {
       _miniheapLocks[i - 1].unlock();
     }
+    _incrementalMeshLock.unlock();
   }
 
   // PUBLIC ONLY FOR TESTING
   // after call to meshLocked() completes src is a nullptr
   void ATTRIBUTE_NEVER_INLINE meshLocked(MiniHeapT *dst, MiniHeapT *&src);
+  // meshes each (dst, src) pair, as a single batch
+  void ATTRIBUTE_NEVER_INLINE meshLocked(std::pair<MiniHeapT *, MiniHeapT *> *pairs, size_t count);
 
   inline void ATTRIBUTE_ALWAYS_INLINE maybeMesh() {
     if (!kMeshingEnabled) {
@@ -654,6 +1198,30 @@ public:
       return;
     }
 
+    if (backgroundMeshing()) {
+      postMeshHint();
+      return;
+    }
+
+    if (meshIncremental()) {
+      // only one incremental pass runs at a time; anyone else who
+      // noticed the period elapsed just goes back to work.
+      unique_lock<mutex> passLock(_incrementalMeshLock, std::try_to_lock);
+      if (!passLock.owns_lock()) {
+        return;
+      }
+
+      const auto lockedNow = time::now();
+      if (unlikely(chrono::duration_cast<chrono::milliseconds>(lockedNow - _lastMesh) < _meshPeriodMs)) {
+        return;
+      }
+
+      _lastMesh = now;
+
+      meshAllSizeClassesIncremental();
+      return;
+    }
+
     AllLocksGuard allLocks(_miniheapLocks, _largeAllocLock, _arenaLock);
 
     {
@@ -698,13 +1266,16 @@ public:
     // FIXME: duplicated with code in halfSplit
     internal::vector<MiniHeapT *> bucket{};
 
-    auto nextId = _partialFreelist[sizeClass].first.next();
-    while (nextId != list::Head) {
-      auto mh = GetMiniHeap<MiniHeapT>(nextId);
-      if (mh->isMeshingCandidate() && (mh->fullness() < kOccupancyCutoff)) {
-        bucket.push_back(mh);
+    // emptiest first
+    for (const auto &partial : _partialFreelist[sizeClass]) {
+      auto nextId = partial.first.next();
+      while (nextId != list::Head) {
+        auto mh = GetMiniHeap<MiniHeapT>(nextId);
+        if (mh->isMeshingCandidate() && (mh->fullness() < kOccupancyCutoff)) {
+          bucket.push_back(mh);
+        }
+        nextId = mh->getFreelist()->next();
       }
-      nextId = mh->getFreelist()->next();
     }
 
     return bucket;
@@ -713,13 +1284,98 @@ public:
 private:
   // check for meshes in all size classes -- must be called LOCKED
   void meshAllSizeClassesLocked();
+  // like meshAllSizeClassesLocked, but takes and releases the
+  // size-class and arena locks itself so that no single pause is
+  // longer than _maxMeshPauseUs (plus the cost of finding candidates
+  // in one size class).  must be called with _incrementalMeshLock held.
+  void meshAllSizeClassesIncremental();
   // meshSizeClassLocked returns the number of merged sets found
   size_t meshSizeClassLocked(size_t sizeClass, MergeSetArray<PageSize> &mergeSets, SplitArray<PageSize> &left,
-                             SplitArray<PageSize> &right);
+                             SplitArray<PageSize> &right, OccupancyArray<PageSize> &occupancy);
+  // like meshSizeClassLocked, but leaves freeing any now-empty
+  // miniheaps to the caller, as doing so touches shared arena state.
+  // This makes it safe to run for different size classes in parallel.
+  size_t meshSizeClassUnflushedLocked(MWC &prng, size_t sizeClass, MergeSetArray<PageSize> &mergeSets,
+                                      SplitArray<PageSize> &left, SplitArray<PageSize> &right,
+                                      OccupancyArray<PageSize> &occupancy);
+  // meshes every size class on the _meshPool workers, returning the number of meshes
+  size_t meshAllSizeClassesParallelLocked();
+  size_t meshSizeClassIncremental(size_t sizeClass, MergeSetArray<PageSize> &mergeSets, SplitArray<PageSize> &left,
+                                  SplitArray<PageSize> &right, OccupancyArray<PageSize> &occupancy);
+  // fills mergeSets with pairs of meshable miniheaps, returning the count
+  size_t findMergeSetsLocked(MWC &prng, size_t sizeClass, MergeSetArray<PageSize> &mergeSets,
+                             SplitArray<PageSize> &left, SplitArray<PageSize> &right,
+                             OccupancyArray<PageSize> &occupancy);
+  // pairs of miniheaps waiting to be meshed, along with the spans
+  // their remaps will touch
+  struct MeshBatch {
+    std::pair<MiniHeapT *, MiniHeapT *> pairs[kMeshBatchSize];
+    typename Super::MeshRemap remaps[kMeshBatchSpans];
+    size_t pairCount{0};
+    size_t remapCount{0};
+  };
+  // returns true if the pair was added to the batch (and false if it
+  // was skipped).  Meshes aren't applied until the batch is flushed,
+  // which must happen before the size-class lock and mesh epoch are
+  // released.
+  bool meshMergeSetLocked(size_t sizeClass, std::pair<MiniHeapT *, MiniHeapT *> &mergeSet, MeshBatch &batch);
+  // applies the batch first if it has no room for the pair
+  void addToMeshBatchLocked(MeshBatch &batch, MiniHeapT *dst, MiniHeapT *src);
+  void flushMeshBatchLocked(MeshBatch &batch);
+  // updates mesh group sizes (and the histogram) for src's group
+  // joining dst's; called just before dst consumes src
+  void mergeMeshGroupsLocked(MiniHeapT *dst, MiniHeapT *src);
+  // meshing moves objects into dst's physical pages, so only pair
+  // miniheaps whose pages are on the same NUMA node
+  inline bool sameNode(const MiniHeapT *a, const MiniHeapT *b) const {
+    return Super::spanNode(a->span()) == Super::spanNode(b->span());
+  }
+  // the size-class lock is dropped between slices of an incremental
+  // pass, so a pair chosen earlier in the pass must be re-checked
+  bool isStillMeshableLocked(size_t sizeClass, const MiniHeapT *dst, const MiniHeapT *src) const;
+
+  size_t meshThreadsLocked() const {
+    return _meshPool != nullptr ? _meshPool->size() : 1;
+  }
+
+  inline void postMeshHint() {
+    // only the first thread to notice the period elapsed pays for the
+    // write; check with a plain load first to keep the cacheline shared.
+    if (_meshHintPending.load(std::memory_order_relaxed) || _meshHintPending.exchange(true)) {
+      return;
+    }
+
+    const uint64_t hint = 1;
+    auto _ __attribute__((unused)) = write(_meshHintFd, &hint, sizeof(hint));
+  }
+
+  inline void recordMeshPause(time::time_point start) {
+    const size_t pauseUs = chrono::duration_cast<chrono::microseconds>(time::preciseNow() - start).count();
+    size_t prev = _stats.maxMeshPauseUs.load(std::memory_order_relaxed);
+    while (pauseUs > prev && !_stats.maxMeshPauseUs.compare_exchange_weak(prev, pauseUs, std::memory_order_relaxed)) {
+    }
+  }
+
+  inline void recordMeshPass(size_t meshAlgorithm, size_t pagesFreedBefore) {
+    _stats.meshPasses[meshAlgorithm]++;
+    _stats.meshPassPagesFreed[meshAlgorithm] += _stats.meshPagesFreed.load() - pagesFreedBefore;
+  }
 
   const size_t _maxObjectSize;
   atomic_size_t _meshPeriod{kDefaultMeshPeriod};
   std::chrono::milliseconds _meshPeriodMs{kMeshPeriodMs};
+  atomic<bool> _meshIncremental{false};
+  atomic_size_t _meshAlgorithm{algorithm::Split};
+  atomic_size_t _maxMeshPauseUs{kDefaultMaxMeshPauseUs};
+  atomic<bool> _backgroundMeshing{false};
+  atomic_size_t _bgMeshBudgetMs{kDefaultBgMeshBudgetMs};
+  atomic_size_t _largeCacheBytes{kDefaultLargeCacheBytes};
+  atomic_size_t _remoteFreeBatch{kRemoteFreeBatch};
+  atomic_size_t _threadCacheBytes{kDefaultThreadCacheBytes};
+  atomic_size_t _emptyRetainBytes{kDefaultEmptyRetainBytes};
+  int _meshHintFd{-1};
+
+  atomic<bool> ATTRIBUTE_ALIGNED(CACHELINE_SIZE) _meshHintPending{false};
 
   atomic_size_t ATTRIBUTE_ALIGNED(CACHELINE_SIZE) _lastMeshEffective{0};
 
@@ -736,24 +1392,45 @@ private:
   std::array<std::pair<MiniHeapListEntryT, size_t>, kNumBins> _emptyFreelist{
       Head, Head, Head, Head, Head, Head, Head, Head, Head, Head, Head, Head, Head,
       Head, Head, Head, Head, Head, Head, Head, Head, Head, Head, Head, Head};
-  std::array<std::pair<MiniHeapListEntryT, size_t>, kNumBins> _partialFreelist{
-      Head, Head, Head, Head, Head, Head, Head, Head, Head, Head, Head, Head, Head,
-      Head, Head, Head, Head, Head, Head, Head, Head, Head, Head, Head, Head};
+  // bucketed by occupancy, see addPartialLocked
+  std::array<PartialBuckets<PageSize>, kNumBins> _partialFreelist{};
 
   // Lock-free pending partial list: miniheaps transitioning from Full to Partial
   // are pushed here without holding locks. Drained to _partialFreelist under lock.
   // Each entry is cache-line-padded to avoid false sharing between size classes.
   std::array<CachelinePaddedAtomicMiniHeapID, kNumBins> _pendingPartialHead{};
 
+  // miniheaps pre-attached to kDepotOwner, handed to thread-local
+  // heaps by refillSmallMiniheaps without taking _miniheapLocks
+  std::array<MiniHeapDepot, kNumBins> _depot{};
+
   // Per-size-class locks to reduce contention on freelists
   mutable std::array<mutex, kNumBins> _miniheapLocks{};
   // Separate lock for large allocations (sizeClass == -1)
   mutable mutex _largeAllocLock{};
   // Lock for shared arena/allocator state (pageAlloc, trackMiniHeap, _mhAllocator)
   mutable mutex _arenaLock{};
+  // held for the duration of an incremental mesh pass (which, unlike
+  // a stop-the-world pass, doesn't hold every other lock)
+  mutex _incrementalMeshLock{};
+  // the arena's PRNG is only safe to use under _arenaLock, which an
+  // incremental pass doesn't hold while finding candidates.  guarded
+  // by _incrementalMeshLock.
+  MWC _incrementalPrng{internal::seed(), internal::seed()};
+  // guards _meshPool, which is only non-null if mesh.mesh_threads > 1
+  mutable mutex _meshPoolLock{};
+  WorkerPool *_meshPool{nullptr};
 
   GlobalHeapStats _stats{};
 
+  // mesh group size - 1, indexed by the MiniHeapID of the group's
+  // primary miniheap, so the untouched (zero) pages of this sparse
+  // table read as unmeshed.  Guarded by the size-class lock.
+  uint16_t *const _meshGroupSizes{
+      reinterpret_cast<uint16_t *>(OneWayMmapHeap().malloc(this->arenaSize() / PageSize * sizeof(uint16_t)))};
+  // per size class, also guarded by the size-class lock
+  size_t _meshGroupHistogram[kNumBins][kMeshGroupBuckets]{};
+
   // XXX: should be atomic, but has exception spec?
   time::time_point _lastMesh;
 };
@@ -112,53 +112,7 @@ void GlobalHeap<PageSize>::freeFor(MiniHeapT *mh, void *ptr, size_t startEpoch)
   // the miniheap; if that is true, or a meshing started between then
   // and now we can't be sure the above free was successful
   if (startEpoch % 2 == 1 || !_meshEpoch.isSame(startEpoch)) {
-    // a mesh was started in between when we looked up our miniheap
-    // and now.  synchronize to avoid races
-    d_assert(sizeClass >= 0 && sizeClass < kNumBins);
-    lock_guard<mutex> lock(_miniheapLocks[sizeClass]);
-    drainPendingPartialLocked(sizeClass);
-
-    const auto origMh = mh;
-    mh = miniheapForWithEpoch(ptr, startEpoch);
-    if (unlikely(mh == nullptr)) {
-      return;
-    }
-
-    if (unlikely(mh != origMh)) {
-      hard_assert(!mh->isMeshed());
-      if (mh->isRelated(origMh) && !wasSet) {
-        // we have confirmation that we raced with meshing, so free the pointer
-        // on the new miniheap
-        d_assert(sizeClass == mh->sizeClass());
-        mh->free(this->arenaBegin(), ptr);
-      } else {
-        // our MiniHeap is unrelated to whatever is here in memory now - get out of here.
-        return;
-      }
-    }
-
-    if (unlikely(mh->sizeClass() != sizeClass || mh->isLargeAlloc())) {
-      // TODO: This papers over a bug where the miniheap was freed
-      //  + reused out from under us while we were waiting for the mh lock.
-      //  It doesn't eliminate the problem (which should be solved
-      //  by storing the 'created epoch' on the MiniHeap), but it should
-      //  further reduce its probability
-      return;
-    }
-
-    remaining = mh->inUseCount();
-    freelistId = mh->freelistId();
-    isAttached = mh->isAttached();
-
-    if (!isAttached && (remaining == 0 || freelistId == list::Full)) {
-      // this may free the miniheap -- we can't safely access it after
-      // this point.
-      postFreeLocked(mh, sizeClass, remaining);
-      mh = nullptr;
-      // Note: flushBinLocked deferred to next mesh cycle (requires arena lock)
-    } else {
-      shouldMesh = true;
-    }
+    shouldMesh = freeRacedWithMesh(mh, ptr, sizeClass, wasSet);
   } else {
     // the free went through ok; if we _were_ full, or now _are_ empty,
     // make sure to update the littleheaps
@@ -175,68 +129,234 @@ void GlobalHeap<PageSize>::freeFor(MiniHeapT *mh, void *ptr, size_t startEpoch)
         // remaining == 0: need lock for Empty transition
         lock_guard<mutex> lock(_miniheapLocks[sizeClass]);
         drainPendingPartialLocked(sizeClass);
+        postFreeEmptiedLocked(mh, ptr, sizeClass);
+      }
+    } else {
+      shouldMesh = !isAttached;
+    }
+  }
+
+  if (shouldMesh) {
+    maybeMesh();
+  }
+}
+
+template <size_t PageSize>
+bool GlobalHeap<PageSize>::freeRacedWithMesh(MiniHeapT *origMh, void *ptr, int sizeClass, bool wasSet) {
+  // a mesh was started in between when we looked up our miniheap
+  // and now.  synchronize to avoid races
+  d_assert(sizeClass >= 0 && sizeClass < kNumBins);
+  lock_guard<mutex> lock(_miniheapLocks[sizeClass]);
+  drainPendingPartialLocked(sizeClass);
+
+  size_t epoch{0};
+  auto mh = miniheapForWithEpoch(ptr, epoch);
+  if (unlikely(mh == nullptr)) {
+    return false;
+  }
+
+  if (unlikely(mh != origMh)) {
+    hard_assert(!mh->isMeshed());
+    if (mh->isRelated(origMh) && !wasSet) {
+      // we have confirmation that we raced with meshing, so free the pointer
+      // on the new miniheap
+      d_assert(sizeClass == mh->sizeClass());
+      mh->free(this->arenaBegin(), ptr);
+    } else {
+      // our MiniHeap is unrelated to whatever is here in memory now - get out of here.
+      return false;
+    }
+  }
+
+  if (unlikely(mh->sizeClass() != sizeClass || mh->isLargeAlloc())) {
+    // TODO: This papers over a bug where the miniheap was freed
+    //  + reused out from under us while we were waiting for the mh lock.
+    //  It doesn't eliminate the problem (which should be solved
+    //  by storing the 'created epoch' on the MiniHeap), but it should
+    //  further reduce its probability
+    return false;
+  }
+
+  const auto remaining = mh->inUseCount();
+  const auto freelistId = mh->freelistId();
+  const auto isAttached = mh->isAttached();
+
+  if (!isAttached && (remaining == 0 || freelistId == list::Full)) {
+    // this may free the miniheap -- we can't safely access it after
+    // this point.
+    postFreeLocked(mh, sizeClass, remaining);
+    // Note: flushBinLocked deferred to next mesh cycle (requires arena lock)
+    return false;
+  }
+
+  return true;
+}
+
+template <size_t PageSize>
+void GlobalHeap<PageSize>::postFreeEmptiedLocked(MiniHeapT *origMh, void *ptr, int sizeClass) {
+  // there are 2 ways we could have raced with meshing:
+  //
+  // 1. when writing to the MiniHeap's bitmap (which callers check
+  //    for with !_meshEpoch.isSame(startEpoch), and hand to
+  //    freeRacedWithMesh).
+  //
+  // 2. this thread losing the race with acquiring _miniheapLocks[sizeClass]
+  //    (what we care about here).  for thi case, we know a) our
+  //    write to the MiniHeap's bitmap succeeded (or we would be
+  //    in freeRacedWithMesh), and b) our
+  //    MiniHeap could have been freed from under us while we were
+  //    waiting for this lock (if e.g. remaining == 0, a mesh
+  //    happened on another thread, and the other thread notices
+  //    this MiniHeap is empty (b.c. an empty MiniHeap meshes with
+  //    every other MiniHeap).  We need to be careful here.
+
+  // we have to reload the miniheap here because of the
+  // just-described possible race
+  size_t epoch{0};
+  auto mh = miniheapForWithEpoch(ptr, epoch);
+
+  // if the MiniHeap associated with the ptr we freed has changed,
+  // there are a few possibilities.
+  if (unlikely(mh != origMh)) {
+    // another thread took care of freeing this MiniHeap for us,
+    // super!  nothing else to do.
+    if (mh == nullptr) {
+      return;
+    }
+
+    // check to make sure the new MiniHeap is related (via a
+    // meshing relationship) to the one we had before grabbing the
+    // lock.
+    if (!mh->isRelated(origMh)) {
+      // the original miniheap was freed and a new (unrelated)
+      // Miniheap allocated for the address space.  nothing else
+      // for us to do.
+      return;
+    } else {
+      // TODO: we should really store 'created epoch' on mh and
+      // check those are the same here, too.
+    }
+  }
+
+  if (unlikely(mh->sizeClass() != sizeClass || mh->isLargeAlloc())) {
+    // TODO: This papers over a bug where the miniheap was freed
+    //  + reused out from under us while we were waiting for the mh lock.
+    //  It doesn't eliminate the problem (which should be solved
+    //  by storing the 'created epoch' on the MiniHeap), but it should
+    //  further reduce its probability
+    return;
+  }
+
+  // a lot could have happened between when we read this without
+  // the lock held and now; just recalculate it.
+  const auto remaining = mh->inUseCount();
+  postFreeLocked(mh, sizeClass, remaining);
+  // Note: flushBinLocked deferred to next mesh cycle (requires arena lock)
+}
 
-        // there are 2 ways we could have raced with meshing:
-        //
-        // 1. when writing to the MiniHeap's bitmap (which we check for
-        //    above with the !_meshEpoch.isSame(current)).  this is what
-        //    the outer if statement here takes care of.
-        //
-        // 2. this thread losing the race with acquiring _miniheapLocks[sizeClass]
-        //    (what we care about here).  for thi case, we know a) our
-        //    write to the MiniHeap's bitmap succeeded (or we would be
-        //    in the other side of the outer if statement), and b) our
-        //    MiniHeap could have been freed from under us while we were
-        //    waiting for this lock (if e.g. remaining == 0, a mesh
-        //    happened on another thread, and the other thread notices
-        //    this MiniHeap is empty (b.c. an empty MiniHeap meshes with
-        //    every other MiniHeap).  We need to be careful here.
-
-        const auto origMh = mh;
-        // we have to reload the miniheap here because of the
-        // just-described possible race
-        mh = miniheapForWithEpoch(ptr, startEpoch);
-
-        // if the MiniHeap associated with the ptr we freed has changed,
-        // there are a few possibilities.
-        if (unlikely(mh != origMh)) {
-          // another thread took care of freeing this MiniHeap for us,
-          // super!  nothing else to do.
-          if (mh == nullptr) {
-            return;
-          }
-
-          // check to make sure the new MiniHeap is related (via a
-          // meshing relationship) to the one we had before grabbing the
-          // lock.
-          if (!mh->isRelated(origMh)) {
-            // the original miniheap was freed and a new (unrelated)
-            // Miniheap allocated for the address space.  nothing else
-            // for us to do.
-            return;
-          } else {
-            // TODO: we should really store 'created epoch' on mh and
-            // check those are the same here, too.
-          }
+template <size_t PageSize>
+void GlobalHeap<PageSize>::freeBatch(void *const *ptrs, size_t count) {
+  struct Entry {
+    MiniHeapT *mh;
+    void *ptr;
+  };
+  struct Emptied {
+    MiniHeapT *mh;
+    void *ptr;
+    int sizeClass;
+  };
+  constexpr size_t kWords = MiniHeapT::kBitmapWords;
+
+  // objects being freed, grouped by miniheap, and the miniheaps this
+  // batch emptied, grouped by size class
+  Entry entries[kRemoteFreeBatch];
+  Emptied emptied[kRemoteFreeBatch];
+  bool shouldMesh = false;
+
+  if (_lastMeshEffective.load(std::memory_order::memory_order_acquire) == 0) {
+    _lastMeshEffective.store(1, std::memory_order::memory_order_release);
+  }
+
+  for (size_t base = 0; base < count; base += kRemoteFreeBatch) {
+    const size_t end = std::min(count, base + kRemoteFreeBatch);
+
+    // one epoch read covers every lookup below, as in freeFor
+    const size_t startEpoch = _meshEpoch.current();
+    size_t n = 0;
+    for (size_t i = base; i < end; i++) {
+      void *ptr = ptrs[i];
+      auto mh = miniheapFor(ptr);
+      if (unlikely(ptr == nullptr || mh == nullptr)) {
+        continue;
+      }
+      if (mh->isLargeAlloc()) {
+        freeFor(mh, ptr, startEpoch);
+        continue;
+      }
+      entries[n++] = Entry{mh, ptr};
+    }
+    _stats.batchedFrees.fetch_add(n, std::memory_order_relaxed);
+    _stats.freeBatches.fetch_add(1, std::memory_order_relaxed);
+
+    std::sort(entries, entries + n, [](const Entry &a, const Entry &b) { return a.mh < b.mh; });
+
+    size_t emptiedCount = 0;
+    for (size_t first = 0, last = 0; first < n; first = last) {
+      const auto mh = entries[first].mh;
+      size_t mask[kWords] = {};
+      for (last = first; last < n && entries[last].mh == mh; last++) {
+        const size_t off = mh->getOff(this->arenaBegin(), entries[last].ptr);
+        mask[off / bitmap::kWordBits] |= bitmap::getMask(off % bitmap::kWordBits);
+      }
+      size_t freed = 0;
+      for (size_t w = 0; w < kWords; w++) {
+        freed += __builtin_popcountl(mask[w]);
+      }
+
+      const auto freelistId = mh->freelistId();
+      const auto isAttached = mh->isAttached();
+      const auto sizeClass = mh->sizeClass();
+      const size_t inUse = mh->inUseCount();
+      const size_t remaining = inUse > freed ? inUse - freed : 0;
+
+      size_t wereSet[kWords];
+      mh->clearMask(mask, wereSet);
+
+      if (startEpoch % 2 == 1 || !_meshEpoch.isSame(startEpoch)) {
+        // we may have raced with meshing; sort each object out on its
+        // own, the same way freeFor does
+        for (size_t i = first; i < last; i++) {
+          const size_t off = mh->getOff(this->arenaBegin(), entries[i].ptr);
+          const bool wasSet = wereSet[off / bitmap::kWordBits] & bitmap::getMask(off % bitmap::kWordBits);
+          shouldMesh |= freeRacedWithMesh(mh, entries[i].ptr, sizeClass, wasSet);
         }
+        continue;
+      }
 
-        if (unlikely(mh->sizeClass() != sizeClass || mh->isLargeAlloc())) {
-          // TODO: This papers over a bug where the miniheap was freed
-          //  + reused out from under us while we were waiting for the mh lock.
-          //  It doesn't eliminate the problem (which should be solved
-          //  by storing the 'created epoch' on the MiniHeap), but it should
-          //  further reduce its probability
-          return;
+      if (!isAttached && (remaining == 0 || freelistId == list::Full)) {
+        d_assert(sizeClass >= 0 && sizeClass < kNumBins);
+        if (remaining > 0) {
+          tryPushPendingPartial(mh, sizeClass);
+          shouldMesh = true;
+        } else {
+          emptied[emptiedCount++] = Emptied{mh, entries[first].ptr, sizeClass};
         }
+      } else {
+        shouldMesh |= !isAttached;
+      }
+    }
 
-        // a lot could have happened between when we read this without
-        // the lock held and now; just recalculate it.
-        remaining = mh->inUseCount();
-        postFreeLocked(mh, sizeClass, remaining);
-        // Note: flushBinLocked deferred to next mesh cycle (requires arena lock)
+    // take each size class's lock once for all the miniheaps of that
+    // class the batch emptied
+    std::sort(emptied, emptied + emptiedCount,
+              [](const Emptied &a, const Emptied &b) { return a.sizeClass < b.sizeClass; });
+    for (size_t first = 0, last = 0; first < emptiedCount; first = last) {
+      const int sizeClass = emptied[first].sizeClass;
+      lock_guard<mutex> lock(_miniheapLocks[sizeClass]);
+      drainPendingPartialLocked(sizeClass);
+      for (last = first; last < emptiedCount && emptied[last].sizeClass == sizeClass; last++) {
+        postFreeEmptiedLocked(emptied[last].mh, emptied[last].ptr, sizeClass);
       }
-    } else {
-      shouldMesh = !isAttached;
     }
   }
 
@@ -253,11 +373,23 @@ int GlobalHeap<PageSize>::mallctl(const char *name, void *oldp, size_t *oldlenp,
   auto statp = reinterpret_cast<size_t *>(oldp);
 
   // Handle operations that need special lock handling first
-  if (strcmp(name, "mesh.scavenge") == 0) {
+  if (strcmp(name, "mesh.mesh_threads") == 0) {
+    // worker threads are started and stopped without heap locks held
+    *statp = meshThreads();
+    if (newp && newlen >= sizeof(size_t)) {
+      setMeshThreads(*reinterpret_cast<size_t *>(newp));
+    }
+    return 0;
+  } else if (strcmp(name, "mesh.scavenge") == 0) {
     // scavenge() acquires locks internally
     scavenge(true);
     return 0;
   } else if (strcmp(name, "mesh.compact") == 0) {
+    if (meshIncremental()) {
+      lock_guard<mutex> passLock(_incrementalMeshLock);
+      meshAllSizeClassesIncremental();
+      return 0;
+    }
     // Acquire all locks for meshing, then release for scavenge
     {
       AllLocksGuard allLocks(_miniheapLocks, _largeAllocLock, _arenaLock);
@@ -278,6 +410,163 @@ int GlobalHeap<PageSize>::mallctl(const char *name, void *oldp, size_t *oldlenp,
     auto newVal = reinterpret_cast<size_t *>(newp);
     _meshPeriod = *newVal;
     // resetNextMeshCheck();
+  } else if (strcmp(name, "mesh.incremental") == 0) {
+    *statp = meshIncremental();
+    if (newp && newlen >= sizeof(size_t)) {
+      setMeshIncremental(*reinterpret_cast<size_t *>(newp) != 0);
+    }
+  } else if (strcmp(name, "mesh.max_pause_us") == 0) {
+    *statp = _maxMeshPauseUs;
+    if (newp && newlen >= sizeof(size_t)) {
+      _maxMeshPauseUs = *reinterpret_cast<size_t *>(newp);
+    }
+  } else if (strcmp(name, "mesh.bg_budget_ms") == 0) {
+    *statp = backgroundMeshBudgetMs();
+    if (newp && newlen >= sizeof(size_t)) {
+      setBackgroundMeshBudgetMs(*reinterpret_cast<size_t *>(newp));
+    }
+  } else if (strcmp(name, "mesh.algorithm") == 0) {
+    *statp = meshAlgorithm();
+    if (newp && newlen >= sizeof(size_t)) {
+      const size_t newVal = *reinterpret_cast<size_t *>(newp);
+      if (newVal >= algorithm::Max) {
+        return -1;
+      }
+      setMeshAlgorithm(newVal);
+    }
+  } else if (strcmp(name, "mesh.huge_pages") == 0) {
+    *statp = Super::hugePages();
+    if (newp && newlen >= sizeof(size_t)) {
+      Super::setHugePages(*reinterpret_cast<size_t *>(newp) != 0);
+    }
+  } else if (strcmp(name, "mesh.large_cache_bytes") == 0) {
+    *statp = largeCacheBytes();
+    if (newp && newlen >= sizeof(size_t)) {
+      setLargeCacheBytes(*reinterpret_cast<size_t *>(newp));
+    }
+  } else if (strcmp(name, "stats.large_cache_hits") == 0) {
+    *statp = _stats.largeCacheHits;
+  } else if (strcmp(name, "stats.large_cache_misses") == 0) {
+    *statp = _stats.largeCacheMisses;
+  } else if (strcmp(name, "stats.large_cached_bytes") == 0) {
+    *statp = _stats.largeCachedBytes;
+  } else if (strcmp(name, "mesh.remote_free_batch") == 0) {
+    *statp = remoteFreeBatch();
+    if (newp && newlen >= sizeof(size_t)) {
+      const size_t newVal = *reinterpret_cast<size_t *>(newp);
+      if (newVal > kRemoteFreeBatch) {
+        return -1;
+      }
+      setRemoteFreeBatch(newVal);
+    }
+  } else if (strcmp(name, "stats.batched_frees") == 0) {
+    *statp = _stats.batchedFrees;
+  } else if (strcmp(name, "stats.free_batches") == 0) {
+    *statp = _stats.freeBatches;
+  } else if (strcmp(name, "mesh.thread_cache_bytes") == 0) {
+    *statp = threadCacheBytes();
+    if (newp && newlen >= sizeof(size_t)) {
+      setThreadCacheBytes(*reinterpret_cast<size_t *>(newp));
+    }
+  } else if (strcmp(name, "stats.thread_cache_bytes") == 0) {
+    *statp = _stats.threadCacheBytes;
+  } else if (strcmp(name, "mesh.uffd_barrier") == 0) {
+    *statp = Super::uffdBarrier();
+    if (newp && newlen >= sizeof(size_t)) {
+      if (!Super::setUffdBarrier(*reinterpret_cast<size_t *>(newp) != 0)) {
+        return -1;
+      }
+    }
+  } else if (strcmp(name, "mesh.empty_retain_bytes") == 0) {
+    *statp = emptyRetainBytes();
+    if (newp && newlen >= sizeof(size_t)) {
+      setEmptyRetainBytes(*reinterpret_cast<size_t *>(newp));
+    }
+  } else if (strcmp(name, "stats.empty_bytes") == 0) {
+    // empty miniheaps waiting to be flushed or retained for reuse
+    size_t emptyBytes = 0;
+    for (size_t sizeClass = 0; sizeClass < kNumBins; sizeClass++) {
+      auto nextId = _emptyFreelist[sizeClass].first.next();
+      while (nextId != list::Head) {
+        auto mh = GetMiniHeap<MiniHeapT>(nextId);
+        emptyBytes += mh->spanSize();
+        nextId = mh->getFreelist()->next();
+      }
+    }
+    *statp = emptyBytes;
+  } else if (strcmp(name, "mesh.dirty_decay_ms") == 0) {
+    *statp = Super::dirtyDecayMs();
+    if (newp && newlen >= sizeof(size_t)) {
+      Super::setDirtyDecayMs(*reinterpret_cast<size_t *>(newp));
+    }
+  } else if (strcmp(name, "mesh.muzzy_decay_ms") == 0) {
+    *statp = Super::muzzyDecayMs();
+    if (newp && newlen >= sizeof(size_t)) {
+      Super::setMuzzyDecayMs(*reinterpret_cast<size_t *>(newp));
+    }
+  } else if (strcmp(name, "stats.dirty_bytes") == 0) {
+    *statp = Super::dirtyPageCount() * PageSize;
+  } else if (strcmp(name, "stats.muzzy_bytes") == 0) {
+    *statp = Super::muzzyPageCount() * PageSize;
+  } else if (strcmp(name, "stats.huge_bytes") == 0) {
+    *statp = Super::hugeSpanPageCount() * PageSize;
+  } else if (strcmp(name, "stats.span_bytes") == 0) {
+    *statp = Super::spanPageCount() * PageSize;
+  } else if (strcmp(name, "stats.mesh_pages_freed") == 0) {
+    *statp = _stats.meshPagesFreed;
+  } else if (strcmp(name, "stats.mesh_syscalls") == 0) {
+    *statp = _stats.meshSyscalls;
+  } else if (strcmp(name, "stats.fork_count") == 0) {
+    *statp = Super::forkCount();
+  } else if (strcmp(name, "stats.fork_us") == 0) {
+    *statp = Super::forkTotalUs();
+  } else if (strcmp(name, "stats.fork_max_us") == 0) {
+    *statp = Super::forkMaxUs();
+  } else if (strcmp(name, "stats.split_mesh_passes") == 0) {
+    *statp = _stats.meshPasses[algorithm::Split];
+  } else if (strcmp(name, "stats.split_mesh_pages_freed") == 0) {
+    *statp = _stats.meshPassPagesFreed[algorithm::Split];
+  } else if (strcmp(name, "stats.greedy_mesh_passes") == 0) {
+    *statp = _stats.meshPasses[algorithm::Greedy];
+  } else if (strcmp(name, "stats.greedy_mesh_pages_freed") == 0) {
+    *statp = _stats.meshPassPagesFreed[algorithm::Greedy];
+  } else if (strcmp(name, "stats.max_mesh_pause_us") == 0) {
+    *statp = _stats.maxMeshPauseUs;
+  } else if (strcmp(name, "stats.bg_mesh_cpu_us") == 0) {
+    *statp = _stats.bgMeshCpuUs;
+  } else if (strcmp(name, "stats.bg_scavenge_slices") == 0) {
+    *statp = _stats.bgScavengeSliceCount;
+  } else if (strcmp(name, "mesh.arena_size") == 0) {
+    // the address space is reserved at startup, so this can only be
+    // set through MESH_ARENA_SIZE
+    *statp = Super::arenaSize();
+    if (newp && newlen >= sizeof(size_t)) {
+      return -1;
+    }
+  } else if (strcmp(name, "stats.arena_file_bytes") == 0) {
+    *statp = Super::arenaFileSize();
+  } else if (strcmp(name, "stats.numa_nodes") == 0) {
+    *statp = internal::numaNodeCount();
+  } else if (strcmp(name, "stats.numa_remote_spans") == 0) {
+    *statp = Super::remoteSpanCount();
+  } else if (strncmp(name, "stats.numa.", strlen("stats.numa.")) == 0) {
+    // stats.numa.<node>.{active,dirty,muzzy}_bytes
+    const char *nodeStr = name + strlen("stats.numa.");
+    char *end = nullptr;
+    const size_t node = strtoul(nodeStr, &end, 10);
+    if (end == nodeStr || *end != '.' || node >= internal::numaNodeCount()) {
+      return -1;
+    }
+    const char *stat = end + 1;
+    if (strcmp(stat, "active_bytes") == 0) {
+      *statp = Super::nodePageCount(node) * PageSize;
+    } else if (strcmp(stat, "dirty_bytes") == 0) {
+      *statp = Super::nodeDirtyPageCount(node) * PageSize;
+    } else if (strcmp(stat, "muzzy_bytes") == 0) {
+      *statp = Super::nodeMuzzyPageCount(node) * PageSize;
+    } else {
+      return -1;
+    }
   } else if (strcmp(name, "arena") == 0) {
     // not sure what this should do
   } else if (strcmp(name, "stats.resident") == 0) {
@@ -313,41 +602,97 @@ int GlobalHeap<PageSize>::mallctl(const char *name, void *oldp, size_t *oldlenp,
 
 template <size_t PageSize>
 void GlobalHeap<PageSize>::meshLocked(MiniHeapT *dst, MiniHeapT *&src) {
-  // mesh::debug("mesh dst:%p <- src:%p\n", dst, src);
-  // dst->dumpDebug();
-  // src->dumpDebug();
-  const size_t dstSpanSize = dst->spanSize();
-  const auto dstSpanStart = reinterpret_cast<void *>(dst->getSpanStart(this->arenaBegin()));
+  std::pair<MiniHeapT *, MiniHeapT *> pair{dst, src};
+  meshLocked(&pair, 1);
+}
+
+template <size_t PageSize>
+void GlobalHeap<PageSize>::meshLocked(std::pair<MiniHeapT *, MiniHeapT *> *pairs, size_t count) {
+  hard_assert(count <= kMeshBatchSize);
+
+  MeshBatch batch{};
+  for (size_t i = 0; i < count; i++) {
+    addToMeshBatchLocked(batch, pairs[i].first, pairs[i].second);
+  }
+  flushMeshBatchLocked(batch);
+}
+
+template <size_t PageSize>
+void GlobalHeap<PageSize>::addToMeshBatchLocked(MeshBatch &batch, MiniHeapT *dst, MiniHeapT *src) {
+  if (batch.pairCount == kMeshBatchSize || batch.remapCount + meshGroupSize(src) > kMeshBatchSpans) {
+    flushMeshBatchLocked(batch);
+  }
 
+  batch.pairs[batch.pairCount++] = {dst, src};
   src->forEachMeshed([&](const MiniHeapT *mh) {
-    // marks srcSpans read-only
-    const auto srcSpan = reinterpret_cast<void *>(mh->getSpanStart(this->arenaBegin()));
-    Super::beginMesh(dstSpanStart, srcSpan, dstSpanSize);
+    batch.remaps[batch.remapCount++] = {dst->span().offset, mh->span().offset, dst->span().length, mh == src};
     return false;
   });
+}
+
+template <size_t PageSize>
+void GlobalHeap<PageSize>::flushMeshBatchLocked(MeshBatch &batch) {
+  if (batch.pairCount == 0) {
+    return;
+  }
+
+  // marks src spans read-only
+  size_t syscalls = Super::beginMeshBatch(batch.remaps, batch.remapCount);
 
   // does the copying of objects and updating of span metadata
-  dst->consume(this->arenaBegin(), src);
-  d_assert(src->isMeshed());
+  size_t pagesFreed = 0;
+  for (size_t i = 0; i < batch.pairCount; i++) {
+    auto &pair = batch.pairs[i];
+    // src's span is what gets released (and src itself is freed)
+    pagesFreed += pair.second->spanSize() / PageSize;
+    mergeMeshGroupsLocked(pair.first, pair.second);
+    pair.first->consume(this->arenaBegin(), pair.second);
+    d_assert(pair.second->isMeshed());
+  }
 
-  src->forEachMeshed([&](const MiniHeapT *mh) {
-    d_assert(mh->isMeshed());
-    const auto srcSpan = reinterpret_cast<void *>(mh->getSpanStart(this->arenaBegin()));
-    // frees physical memory + re-marks srcSpans as read/write
-    Super::finalizeMesh(dstSpanStart, srcSpan, dstSpanSize);
-    return false;
-  });
-  Super::freePhys(reinterpret_cast<void *>(src->getSpanStart(this->arenaBegin())), dstSpanSize);
+  // points src spans at their dst's physical pages, re-marking them
+  // read/write, and frees the src's physical memory
+  syscalls += Super::finalizeMeshBatch(batch.remaps, batch.remapCount);
 
-  // make sure we adjust what bin the destination is in -- it might
-  // now be full and not a candidate for meshing
-  postFreeLocked(dst, dst->sizeClass(), dst->inUseCount());
-  untrackMiniheapLocked(src);
+  for (size_t i = 0; i < batch.pairCount; i++) {
+    auto &pair = batch.pairs[i];
+    // make sure we adjust what bin the destination is in -- it might
+    // now be full and not a candidate for meshing
+    postFreeLocked(pair.first, pair.first->sizeClass(), pair.first->inUseCount());
+    untrackMiniheapLocked(pair.second);
+  }
+
+  _stats.meshPagesFreed += pagesFreed;
+  _stats.meshSyscalls += syscalls;
+
+  batch.pairCount = 0;
+  batch.remapCount = 0;
 }
 
 template <size_t PageSize>
-size_t GlobalHeap<PageSize>::meshSizeClassLocked(size_t sizeClass, MergeSetArray<PageSize> &mergeSets,
-                                                 SplitArray<PageSize> &left, SplitArray<PageSize> &right) {
+void GlobalHeap<PageSize>::mergeMeshGroupsLocked(MiniHeapT *dst, MiniHeapT *src) {
+  const size_t dstSize = meshGroupSize(dst);
+  const size_t srcSize = meshGroupSize(src);
+  const size_t groupSize = dstSize + srcSize;
+  hard_assert(groupSize <= kMaxMeshes);
+
+  auto &histogram = _meshGroupHistogram[dst->sizeClass()];
+  if (dstSize > 1) {
+    histogram[meshGroupBucket(dstSize)]--;
+  }
+  if (srcSize > 1) {
+    histogram[meshGroupBucket(srcSize)]--;
+  }
+  histogram[meshGroupBucket(groupSize)]++;
+
+  _meshGroupSizes[miniheapIDFor(dst).value()] = groupSize - 1;
+  _meshGroupSizes[miniheapIDFor(src).value()] = 0;
+}
+
+template <size_t PageSize>
+size_t GlobalHeap<PageSize>::findMergeSetsLocked(MWC &prng, size_t sizeClass, MergeSetArray<PageSize> &mergeSets,
+                                                 SplitArray<PageSize> &left, SplitArray<PageSize> &right,
+                                                 OccupancyArray<PageSize> &occupancy) {
   size_t mergeSetCount = 0;
   // memset(reinterpret_cast<void *>(&mergeSets), 0, sizeof(mergeSets));
   // memset(&left, 0, sizeof(left));
@@ -355,14 +700,83 @@ size_t GlobalHeap<PageSize>::meshSizeClassLocked(size_t sizeClass, MergeSetArray
 
   auto meshFound =
       function<bool(std::pair<MiniHeapT *, MiniHeapT *> &&)>([&](std::pair<MiniHeapT *, MiniHeapT *> &&miniheaps) {
-        if (miniheaps.first->isMeshingCandidate() && miniheaps.second->isMeshingCandidate()) {
+        if (miniheaps.first->isMeshingCandidate() && miniheaps.second->isMeshingCandidate() &&
+            sameNode(miniheaps.first, miniheaps.second)) {
           mergeSets[mergeSetCount] = std::move(miniheaps);
           mergeSetCount++;
         }
         return mergeSetCount < kMaxMergeSets;
       });
 
-  method::shiftedSplitting(this->_fastPrng, &_partialFreelist[sizeClass].first, left, right, meshFound);
+  if (meshAlgorithm() == algorithm::Greedy) {
+    method::greedyMatching(_partialFreelist[sizeClass], occupancy, meshFound);
+  } else {
+    method::shiftedSplitting(prng, _partialFreelist[sizeClass], left, right, meshFound);
+  }
+
+  return mergeSetCount;
+}
+
+template <size_t PageSize>
+bool GlobalHeap<PageSize>::meshMergeSetLocked(size_t sizeClass, std::pair<MiniHeapT *, MiniHeapT *> &mergeSet,
+                                              MeshBatch &batch) {
+  MiniHeapT *dst = mergeSet.first;
+  MiniHeapT *src = mergeSet.second;
+  d_assert(dst != nullptr);
+  d_assert(src != nullptr);
+
+  // merge _into_ the one with a larger mesh count, potentially
+  // swapping the order of the pair
+  const auto dstCount = meshGroupSize(dst);
+  const auto srcCount = meshGroupSize(src);
+  if (dstCount + srcCount > kMaxMeshes) {
+    return false;
+  }
+  if (dstCount < srcCount) {
+    std::swap(dst, src);
+  }
+
+  // final check: if one of these miniheaps is now empty
+  // (e.g. because a parallel thread is freeing a bunch of objects
+  // in a row) save ourselves some work by just tracking this as a
+  // regular postFree
+  auto oneEmpty = false;
+  if (dst->inUseCount() == 0) {
+    postFreeLocked(dst, sizeClass, 0);
+    oneEmpty = true;
+  }
+  if (src->inUseCount() == 0) {
+    postFreeLocked(src, sizeClass, 0);
+    oneEmpty = true;
+  }
+
+  if (oneEmpty || this->aboveMeshThreshold()) {
+    return false;
+  }
+
+  addToMeshBatchLocked(batch, dst, src);
+  return true;
+}
+
+template <size_t PageSize>
+size_t GlobalHeap<PageSize>::meshSizeClassLocked(size_t sizeClass, MergeSetArray<PageSize> &mergeSets,
+                                                 SplitArray<PageSize> &left, SplitArray<PageSize> &right,
+                                                 OccupancyArray<PageSize> &occupancy) {
+  const size_t meshCount = meshSizeClassUnflushedLocked(this->_fastPrng, sizeClass, mergeSets, left, right, occupancy);
+
+  // flush things once more (since we may have called postFree instead
+  // of mesh above)
+  flushBinLocked(sizeClass);
+
+  return meshCount;
+}
+
+template <size_t PageSize>
+size_t GlobalHeap<PageSize>::meshSizeClassUnflushedLocked(MWC &prng, size_t sizeClass,
+                                                          MergeSetArray<PageSize> &mergeSets,
+                                                          SplitArray<PageSize> &left, SplitArray<PageSize> &right,
+                                                          OccupancyArray<PageSize> &occupancy) {
+  const size_t mergeSetCount = findMergeSetsLocked(prng, sizeClass, mergeSets, left, right, occupancy);
 
   if (mergeSetCount == 0) {
     // debug("nothing to mesh.");
@@ -370,87 +784,155 @@ size_t GlobalHeap<PageSize>::meshSizeClassLocked(size_t sizeClass, MergeSetArray
   }
 
   size_t meshCount = 0;
+  MeshBatch batch{};
 
   for (size_t i = 0; i < mergeSetCount; i++) {
-    std::pair<MiniHeapT *, MiniHeapT *> &mergeSet = mergeSets[i];
-    MiniHeapT *dst = mergeSet.first;
-    MiniHeapT *src = mergeSet.second;
-    d_assert(dst != nullptr);
-    d_assert(src != nullptr);
-
-    // merge _into_ the one with a larger mesh count, potentially
-    // swapping the order of the pair
-    const auto dstCount = dst->meshCount();
-    const auto srcCount = src->meshCount();
-    if (dstCount + srcCount > kMaxMeshes) {
-      continue;
-    }
-    if (dstCount < srcCount) {
-      std::swap(dst, src);
+    if (meshMergeSetLocked(sizeClass, mergeSets[i], batch)) {
+      meshCount++;
     }
+  }
+  flushMeshBatchLocked(batch);
+
+  return meshCount;
+}
 
-    // final check: if one of these miniheaps is now empty
-    // (e.g. because a parallel thread is freeing a bunch of objects
-    // in a row) save ourselves some work by just tracking this as a
-    // regular postFree
-    auto oneEmpty = false;
-    if (dst->inUseCount() == 0) {
-      postFreeLocked(dst, sizeClass, 0);
-      oneEmpty = true;
+template <size_t PageSize>
+bool GlobalHeap<PageSize>::isStillMeshableLocked(size_t sizeClass, const MiniHeapT *dst, const MiniHeapT *src) const {
+  if (dst == src) {
+    return false;
+  }
+
+  // while we weren't holding the lock either miniheap may have been
+  // attached to a thread, meshed, or emptied + freed (and its
+  // MiniHeap slot possibly reused).  Anything that is still an
+  // unattached, partially-full miniheap in this size class that owns
+  // its span is fair game, as long as the bitmaps still don't overlap.
+  auto ok = [&](const MiniHeapT *mh) {
+    if (mh->sizeClass() != static_cast<int>(sizeClass) || mh->freelistId() != list::Partial) {
+      return false;
     }
-    if (src->inUseCount() == 0) {
-      postFreeLocked(src, sizeClass, 0);
-      oneEmpty = true;
+    if (mh->isPending() || mh->isMeshed() || !mh->isMeshingCandidate()) {
+      return false;
     }
+    return miniheapFor(reinterpret_cast<void *>(mh->getSpanStart(this->arenaBegin()))) == mh;
+  };
 
-    if (!oneEmpty && !this->aboveMeshThreshold()) {
-      meshLocked(dst, src);
-      meshCount++;
+  if (!ok(dst) || !ok(src) || !sameNode(dst, src)) {
+    return false;
+  }
+
+  constexpr size_t nBytes = PageSize / kMinObjectSize / 8;
+  return mesh::bitmapsMeshable(dst->bitmap().bits(), src->bitmap().bits(), nBytes);
+}
+
+template <size_t PageSize>
+size_t GlobalHeap<PageSize>::meshSizeClassIncremental(size_t sizeClass, MergeSetArray<PageSize> &mergeSets,
+                                                      SplitArray<PageSize> &left, SplitArray<PageSize> &right,
+                                                      OccupancyArray<PageSize> &occupancy) {
+  size_t mergeSetCount = 0;
+
+  // finding candidates only reads this size class's partial list, so
+  // doesn't need the arena lock or an odd mesh epoch.
+  {
+    const auto start = time::preciseNow();
+    lock_guard<mutex> lock(_miniheapLocks[sizeClass]);
+    drainDepotLocked(sizeClass);
+    drainPendingPartialLocked(sizeClass);
+    {
+      lock_guard<mutex> arenaLock(_arenaLock);
+      flushBinLocked(sizeClass);
     }
+    mergeSetCount = findMergeSetsLocked(_incrementalPrng, sizeClass, mergeSets, left, right, occupancy);
+    recordMeshPause(start);
   }
 
-  // flush things once more (since we may have called postFree instead
-  // of mesh above)
-  flushBinLocked(sizeClass);
+  const auto maxPause = chrono::microseconds{_maxMeshPauseUs.load(std::memory_order_relaxed)};
+
+  size_t meshCount = 0;
+  size_t i = 0;
+  while (i < mergeSetCount) {
+    const auto start = time::preciseNow();
+    lock_guard<mutex> lock(_miniheapLocks[sizeClass]);
+    lock_guard<mutex> arenaLock(_arenaLock);
+
+    if (Super::aboveMeshThreshold()) {
+      break;
+    }
+
+    drainPendingPartialLocked(sizeClass);
+
+    {
+      lock_guard<EpochLock> epochLock(_meshEpoch);
+      MeshBatch batch{};
+
+      const size_t sliceEnd = min(i + kMeshSliceMergeSets, mergeSetCount);
+      while (i < sliceEnd) {
+        auto &mergeSet = mergeSets[i];
+        i++;
+
+        if (isStillMeshableLocked(sizeClass, mergeSet.first, mergeSet.second) &&
+            meshMergeSetLocked(sizeClass, mergeSet, batch)) {
+          meshCount++;
+        }
+
+        if (time::preciseNow() - start >= maxPause) {
+          break;
+        }
+      }
+
+      flushMeshBatchLocked(batch);
+    }
+
+    flushBinLocked(sizeClass);
+    recordMeshPause(start);
+  }
 
   return meshCount;
 }
 
+namespace {
+// scratch space for a mesh pass is big enough that we don't want it
+// on the stack or in the (dumped, and eagerly zeroed) data segment.
+template <typename T>
+T *newMeshScratch() {
+  void *ptr = mmap(nullptr, sizeof(T), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  hard_assert(ptr != MAP_FAILED);
+  d_assert((reinterpret_cast<uintptr_t>(ptr) & (getPageSize() - 1)) == 0);
+  return new (ptr) T();
+}
+
+template <typename T>
+void releaseMeshScratch(T &scratch) {
+  madvise(&scratch, sizeof(scratch), MADV_DONTNEED);
+}
+
+// everything a mesh worker needs to mesh a size class on its own
+template <size_t PageSize>
+struct MeshWorkerScratch {
+  MeshWorkerScratch() : prng(internal::seed(), internal::seed()) {
+  }
+
+  MergeSetArray<PageSize> mergeSets;
+  SplitArray<PageSize> left;
+  SplitArray<PageSize> right;
+  OccupancyArray<PageSize> occupancy;
+  MWC prng;
+};
+}  // namespace
+
 template <size_t PageSize>
 void GlobalHeap<PageSize>::meshAllSizeClassesLocked() {
-  static MergeSetArray<PageSize> *MergeSetsPtr = []() {
-    void *ptr =
-        mmap(nullptr, sizeof(MergeSetArray<PageSize>), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    hard_assert(ptr != MAP_FAILED);
-    return new (ptr) MergeSetArray<PageSize>();
-  }();
-  static MergeSetArray<PageSize> &MergeSets = *MergeSetsPtr;
-  // static_assert(sizeof(MergeSets) == sizeof(void *) * 2 * 4096, "array too big");
-  d_assert((reinterpret_cast<uintptr_t>(&MergeSets) & (getPageSize() - 1)) == 0);
-
-  static SplitArray<PageSize> *LeftPtr = []() {
-    void *ptr = mmap(nullptr, sizeof(SplitArray<PageSize>), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    hard_assert(ptr != MAP_FAILED);
-    return new (ptr) SplitArray<PageSize>();
-  }();
-  static SplitArray<PageSize> &Left = *LeftPtr;
-
-  static SplitArray<PageSize> *RightPtr = []() {
-    void *ptr = mmap(nullptr, sizeof(SplitArray<PageSize>), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    hard_assert(ptr != MAP_FAILED);
-    return new (ptr) SplitArray<PageSize>();
-  }();
-  static SplitArray<PageSize> &Right = *RightPtr;
-
-  // static_assert(sizeof(Left) == sizeof(void *) * 16384, "array too big");
-  // static_assert(sizeof(Right) == sizeof(void *) * 16384, "array too big");
-  d_assert((reinterpret_cast<uintptr_t>(&Left) & (getPageSize() - 1)) == 0);
-  d_assert((reinterpret_cast<uintptr_t>(&Right) & (getPageSize() - 1)) == 0);
+  static MergeSetArray<PageSize> &MergeSets = *newMeshScratch<MergeSetArray<PageSize>>();
+  static SplitArray<PageSize> &Left = *newMeshScratch<SplitArray<PageSize>>();
+  static SplitArray<PageSize> &Right = *newMeshScratch<SplitArray<PageSize>>();
+  static OccupancyArray<PageSize> &Occupancy = *newMeshScratch<OccupancyArray<PageSize>>();
+
+  const auto start = time::preciseNow();
 
   // if we have freed but not reset meshed mappings, this will reset
   // them to the identity mapping, ensuring we don't blow past our VMA
-  // limit (which is why we set the force flag to true)
-  Super::scavenge(true);
+  // limit
+  Super::meshScavenge();
 
   if (!_lastMeshEffective.load(std::memory_order::memory_order_acquire)) {
     return;
@@ -462,35 +944,142 @@ void GlobalHeap<PageSize>::meshAllSizeClassesLocked() {
 
   lock_guard<EpochLock> epochLock(_meshEpoch);
 
-  // const auto start = time::now();
+  const size_t meshAlgorithm = this->meshAlgorithm();
+  const size_t pagesFreedBefore = _stats.meshPagesFreed.load();
 
-  // first, drain pending partial lists and clear out any free memory we might have
+  // first, return depot miniheaps, drain pending partial lists and
+  // clear out any free memory we might have
   for (size_t sizeClass = 0; sizeClass < kNumBins; sizeClass++) {
+    drainDepotLocked(sizeClass);
     drainPendingPartialLocked(sizeClass);
     flushBinLocked(sizeClass);
   }
 
   size_t totalMeshCount = 0;
 
-  for (size_t sizeClass = 0; sizeClass < kNumBins; sizeClass++) {
-    totalMeshCount += meshSizeClassLocked(sizeClass, MergeSets, Left, Right);
-  }
+  // if someone is resizing the pool right now, just mesh serially
+  unique_lock<mutex> poolLock(_meshPoolLock, std::try_to_lock);
+  if (poolLock.owns_lock() && _meshPool != nullptr) {
+    totalMeshCount = meshAllSizeClassesParallelLocked();
+  } else {
+    for (size_t sizeClass = 0; sizeClass < kNumBins; sizeClass++) {
+      totalMeshCount += meshSizeClassLocked(sizeClass, MergeSets, Left, Right, Occupancy);
+    }
 
-  madvise(&Left, sizeof(Left), MADV_DONTNEED);
-  madvise(&Right, sizeof(Right), MADV_DONTNEED);
-  madvise(&MergeSets, sizeof(MergeSets), MADV_DONTNEED);
+    releaseMeshScratch(Left);
+    releaseMeshScratch(Right);
+    releaseMeshScratch(Occupancy);
+    releaseMeshScratch(MergeSets);
+  }
 
   _lastMeshEffective = totalMeshCount > 256;
   _stats.meshCount += totalMeshCount;
+  recordMeshPass(meshAlgorithm, pagesFreedBefore);
 
-  Super::scavenge(true);
+  Super::meshScavenge();
 
   _lastMesh = time::now();
 
+  recordMeshPause(start);
+
   // const std::chrono::duration<double> duration = _lastMesh - start;
   // debug("mesh took %f, found %zu", duration.count(), totalMeshCount);
 }
 
+template <size_t PageSize>
+size_t GlobalHeap<PageSize>::meshAllSizeClassesParallelLocked() {
+  static MeshWorkerScratch<PageSize> *Scratch[kMaxMeshThreads]{};
+
+  const size_t workerCount = _meshPool->size();
+  for (size_t i = 0; i < workerCount; i++) {
+    if (Scratch[i] == nullptr) {
+      Scratch[i] = newMeshScratch<MeshWorkerScratch<PageSize>>();
+    }
+  }
+
+  struct {
+    GlobalHeap *heap;
+    atomic_size_t nextSizeClass;
+    atomic_size_t meshCount;
+  } pass{this, {0}, {0}};
+
+  // we hold every lock, so each worker effectively owns the size
+  // classes it claims.  Keep the captures small enough that
+  // std::function doesn't allocate.
+  const function<void(size_t)> meshWorker = [&pass](size_t worker) {
+    auto &scratch = *Scratch[worker];
+    size_t meshCount = 0;
+    for (size_t sizeClass = pass.nextSizeClass++; sizeClass < kNumBins; sizeClass = pass.nextSizeClass++) {
+      meshCount += pass.heap->meshSizeClassUnflushedLocked(scratch.prng, sizeClass, scratch.mergeSets, scratch.left,
+                                                            scratch.right, scratch.occupancy);
+    }
+    pass.meshCount += meshCount;
+  };
+
+  _meshPool->run(meshWorker);
+
+  // freeing miniheaps touches the arena, so is done serially
+  for (size_t sizeClass = 0; sizeClass < kNumBins; sizeClass++) {
+    flushBinLocked(sizeClass);
+  }
+
+  for (size_t i = 0; i < workerCount; i++) {
+    releaseMeshScratch(Scratch[i]->mergeSets);
+    releaseMeshScratch(Scratch[i]->left);
+    releaseMeshScratch(Scratch[i]->right);
+    releaseMeshScratch(Scratch[i]->occupancy);
+  }
+
+  return pass.meshCount.load();
+}
+
+template <size_t PageSize>
+void GlobalHeap<PageSize>::meshAllSizeClassesIncremental() {
+  // separate from the stop-the-world pass's scratch space: a
+  // stop-the-world pass may run while we are between slices.
+  static MergeSetArray<PageSize> &MergeSets = *newMeshScratch<MergeSetArray<PageSize>>();
+  static SplitArray<PageSize> &Left = *newMeshScratch<SplitArray<PageSize>>();
+  static SplitArray<PageSize> &Right = *newMeshScratch<SplitArray<PageSize>>();
+  static OccupancyArray<PageSize> &Occupancy = *newMeshScratch<OccupancyArray<PageSize>>();
+
+  {
+    const auto start = time::preciseNow();
+    lock_guard<mutex> arenaLock(_arenaLock);
+    Super::meshScavenge();
+    recordMeshPause(start);
+  }
+
+  if (!_lastMeshEffective.load(std::memory_order::memory_order_acquire)) {
+    return;
+  }
+
+  const size_t meshAlgorithm = this->meshAlgorithm();
+  const size_t pagesFreedBefore = _stats.meshPagesFreed.load();
+  size_t totalMeshCount = 0;
+
+  for (size_t sizeClass = 0; sizeClass < kNumBins; sizeClass++) {
+    totalMeshCount += meshSizeClassIncremental(sizeClass, MergeSets, Left, Right, Occupancy);
+  }
+
+  releaseMeshScratch(Left);
+  releaseMeshScratch(Right);
+  releaseMeshScratch(Occupancy);
+  releaseMeshScratch(MergeSets);
+
+  _lastMeshEffective = totalMeshCount > 256;
+  _stats.meshCount += totalMeshCount;
+  recordMeshPass(meshAlgorithm, pagesFreedBefore);
+
+  {
+    const auto start = time::preciseNow();
+    lock_guard<mutex> arenaLock(_arenaLock);
+    Super::meshScavenge();
+    recordMeshPause(start);
+  }
+
+  _lastMesh = time::now();
+}
+
 template <size_t PageSize>
 void GlobalHeap<PageSize>::dumpStats(int level, bool beDetailed) const {
   if (level < 1)
@@ -508,6 +1097,85 @@ void GlobalHeap<PageSize>::dumpStats(int level, bool beDetailed) const {
   debug("MH Alloc Count:     %zu\n", (size_t)_stats.mhAllocCount);
   debug("MH Free  Count:     %zu\n", (size_t)_stats.mhFreeCount);
   debug("MH High Water Mark: %zu\n", (size_t)_stats.mhHighWaterMark);
+  debug("Max mesh pause us:  %zu\n", (size_t)_stats.maxMeshPauseUs);
+  debug("Mesh pages freed:   %zu\n", (size_t)_stats.meshPagesFreed);
+  if (_stats.meshCount > 0) {
+    debug("Mesh syscalls:      %zu (%.2f/mesh)\n", (size_t)_stats.meshSyscalls,
+          _stats.meshSyscalls / (double)_stats.meshCount);
+  }
+  const size_t splitPasses = _stats.meshPasses[algorithm::Split];
+  if (splitPasses > 0) {
+    debug("Split mesh passes:  %zu (%.1f pages freed/pass)\n", splitPasses,
+          _stats.meshPassPagesFreed[algorithm::Split] / (double)splitPasses);
+  }
+  const size_t greedyPasses = _stats.meshPasses[algorithm::Greedy];
+  if (greedyPasses > 0) {
+    debug("Greedy mesh passes: %zu (%.1f pages freed/pass)\n", greedyPasses,
+          _stats.meshPassPagesFreed[algorithm::Greedy] / (double)greedyPasses);
+  }
+  const size_t largeCacheLookups = _stats.largeCacheHits + _stats.largeCacheMisses;
+  if (largeCacheLookups > 0) {
+    debug("Large cache:        %.1f%% hits (%zu/%zu), %.1f MB cached\n",
+          100.0 * _stats.largeCacheHits / largeCacheLookups, (size_t)_stats.largeCacheHits, largeCacheLookups,
+          _stats.largeCachedBytes / 1024.0 / 1024.0);
+  }
+  if (_stats.freeBatches > 0) {
+    debug("Remote frees:       %zu in %zu batches (%.1f per batch)\n", (size_t)_stats.batchedFrees,
+          (size_t)_stats.freeBatches, (double)_stats.batchedFrees / _stats.freeBatches);
+  }
+  if (_stats.threadCacheBytes > 0) {
+    debug("Thread cache MB:    %.1f above default goals (%.1f budget)\n", _stats.threadCacheBytes / 1024.0 / 1024.0,
+          threadCacheBytes() / 1024.0 / 1024.0);
+  }
+  debug("Arena GB:           %.1f reserved, %.1f backed\n", Super::arenaSize() / 1024.0 / 1024.0 / 1024.0,
+        Super::arenaFileSize() / 1024.0 / 1024.0 / 1024.0);
+  const size_t numaNodes = internal::numaNodeCount();
+  if (numaNodes > 1) {
+    debug("NUMA remote spans:  %zu\n", Super::remoteSpanCount());
+    for (size_t node = 0; node < numaNodes; node++) {
+      debug("  node %zu MB:        %.1f active, %.1f dirty, %.1f muzzy\n", node,
+            Super::nodePageCount(node) * (double)PageSize / 1024.0 / 1024.0,
+            Super::nodeDirtyPageCount(node) * (double)PageSize / 1024.0 / 1024.0,
+            Super::nodeMuzzyPageCount(node) * (double)PageSize / 1024.0 / 1024.0);
+    }
+  }
+  if (Super::forkCount() > 0) {
+    debug("Fork pause (ms):    %.1f avg, %.1f max (%zu forks)\n",
+          Super::forkTotalUs() / 1000.0 / Super::forkCount(), Super::forkMaxUs() / 1000.0, Super::forkCount());
+  }
+  if (Super::hugePages() || Super::hugeSpanPageCount() > 0) {
+    const size_t spanPages = Super::spanPageCount();
+    const size_t hugePages = Super::hugeSpanPageCount();
+    debug("Hugepage span MB:   %.1f (%.1f%% of spans)\n", hugePages * (double)PageSize / 1024.0 / 1024.0,
+          spanPages > 0 ? 100.0 * hugePages / spanPages : 0.0);
+  }
+  if (Super::dirtyDecayMs() > 0) {
+    debug("Dirty MB:           %.1f\n", Super::dirtyPageCount() * (double)PageSize / 1024.0 / 1024.0);
+    debug("Muzzy MB:           %.1f\n", Super::muzzyPageCount() * (double)PageSize / 1024.0 / 1024.0);
+  }
+  if (backgroundMeshing()) {
+    debug("BG mesh passes:     %zu\n", _stats.bgMeshPassCount);
+    debug("BG mesh CPU ms:     %.1f\n", _stats.bgMeshCpuUs / 1000.0);
+    debug("BG scavenge slices: %zu\n", _stats.bgScavengeSliceCount);
+  }
+  if (_stats.meshCount > 0) {
+    // mesh group sizes per size class, in power-of-two buckets
+    debug("Mesh groups:        (2, 3-4, 5-8, ..., %zu-%zu)\n", kMaxMeshes / 2 + 1, kMaxMeshes);
+    for (size_t sizeClass = 0; sizeClass < kNumBins; sizeClass++) {
+      const auto &histogram = _meshGroupHistogram[sizeClass];
+      size_t groups = 0;
+      for (size_t i = 0; i < kMeshGroupBuckets; i++) {
+        groups += histogram[i];
+      }
+      if (groups == 0) {
+        continue;
+      }
+      static_assert(kMeshGroupBuckets == 10, "update the format below");
+      debug("  %6zu bytes: %zu %zu %zu %zu %zu %zu %zu %zu %zu %zu\n", SizeMap::ByteSizeForClass(sizeClass), histogram[0],
+            histogram[1], histogram[2], histogram[3], histogram[4], histogram[5], histogram[6], histogram[7],
+            histogram[8], histogram[9]);
+    }
+  }
   if (level > 1) {
     // for (size_t i = 0; i < kNumBins; i++) {
     //   _littleheaps[i].dumpStats(beDetailed);
@@ -518,25 +1186,28 @@ void GlobalHeap<PageSize>::dumpStats(int level, bool beDetailed) const {
 namespace method {
 
 template <size_t PageSize>
-void ATTRIBUTE_NEVER_INLINE halfSplit(MWC &prng, MiniHeapListEntry<PageSize> *miniheaps, SplitArray<PageSize> &left,
-                                      size_t &leftSize, SplitArray<PageSize> &right, size_t &rightSize) noexcept {
+void ATTRIBUTE_NEVER_INLINE halfSplit(MWC &prng, const PartialBuckets<PageSize> &miniheaps,
+                                      SplitArray<PageSize> &left, size_t &leftSize, SplitArray<PageSize> &right,
+                                      size_t &rightSize) noexcept {
   d_assert(leftSize == 0);
   d_assert(rightSize == 0);
-  MiniHeapID mhId = miniheaps->next();
-  while (mhId != list::Head && leftSize < kMaxSplitListSize && rightSize < kMaxSplitListSize) {
-    auto mh = GetMiniHeap<MiniHeap<PageSize>>(mhId);
-    mhId = mh->getFreelist()->next();
+  for (const auto &bucket : miniheaps) {
+    MiniHeapID mhId = bucket.first.next();
+    while (mhId != list::Head && leftSize < kMaxSplitListSize && rightSize < kMaxSplitListSize) {
+      auto mh = GetMiniHeap<MiniHeap<PageSize>>(mhId);
+      mhId = mh->getFreelist()->next();
 
-    if (!mh->isMeshingCandidate() || (mh->fullness() >= kOccupancyCutoff)) {
-      continue;
-    }
+      if (!mh->isMeshingCandidate() || (mh->fullness() >= kOccupancyCutoff)) {
+        continue;
+      }
 
-    if (leftSize <= rightSize) {
-      left[leftSize] = mh;
-      leftSize++;
-    } else {
-      right[rightSize] = mh;
-      rightSize++;
+      if (leftSize <= rightSize) {
+        left[leftSize] = mh;
+        leftSize++;
+      } else {
+        right[rightSize] = mh;
+        rightSize++;
+      }
     }
   }
 
@@ -546,14 +1217,10 @@ void ATTRIBUTE_NEVER_INLINE halfSplit(MWC &prng, MiniHeapListEntry<PageSize> *mi
 
 template <size_t PageSize>
 void ATTRIBUTE_NEVER_INLINE shiftedSplitting(
-    MWC &prng, MiniHeapListEntry<PageSize> *miniheaps, SplitArray<PageSize> &left, SplitArray<PageSize> &right,
+    MWC &prng, const PartialBuckets<PageSize> &miniheaps, SplitArray<PageSize> &left, SplitArray<PageSize> &right,
     const function<bool(std::pair<MiniHeap<PageSize> *, MiniHeap<PageSize> *> &&)> &meshFound) noexcept {
   constexpr size_t t = 64;
 
-  if (miniheaps->empty()) {
-    return;
-  }
-
   size_t leftSize = 0;
   size_t rightSize = 0;
 
@@ -569,40 +1236,143 @@ void ATTRIBUTE_NEVER_INLINE shiftedSplitting(
   const size_t limit = rightSize < t ? rightSize : t;
   d_assert(nBytes == left[0]->bitmap().byteCount());
 
+  static_assert(t <= kMeshableBatchMax, "probe window must fit in a single batch");
+  const uint64_t *candidateBits[t];
+  size_t candidateIdx[t];
+
   size_t foundCount = 0;
   for (size_t j = 0; j < leftSize; j++) {
-    const size_t idxLeft = j;
-    size_t idxRight = j;
+    auto h1 = left[j];
+    if (h1 == nullptr)
+      continue;
 
+    // gather the right-hand miniheaps in this left's probe window
+    // that haven't been meshed yet, and test them all at once
+    size_t candidateCount = 0;
+    size_t idxRight = j;
     for (size_t i = 0; i < limit; i++, idxRight++) {
       if (unlikely(idxRight >= rightSize)) {
         idxRight %= rightSize;
       }
-      auto h1 = left[idxLeft];
       auto h2 = right[idxRight];
-
-      if (h1 == nullptr || h2 == nullptr)
+      if (h2 == nullptr)
         continue;
 
-      const auto bitmap1 = h1->bitmap().bits();
-      const auto bitmap2 = h2->bitmap().bits();
+      candidateBits[candidateCount] = reinterpret_cast<const uint64_t *>(h2->bitmap().bits());
+      candidateIdx[candidateCount] = idxRight;
+      candidateCount++;
+    }
 
-      const bool areMeshable = mesh::bitmapsMeshable(bitmap1, bitmap2, nBytes);
+    if (candidateCount == 0)
+      continue;
 
-      if (unlikely(areMeshable)) {
-        std::pair<MiniHeap<PageSize> *, MiniHeap<PageSize> *> heaps{h1, h2};
-        bool shouldContinue = meshFound(std::move(heaps));
-        left[idxLeft] = nullptr;
-        right[idxRight] = nullptr;
-        foundCount++;
-        if (unlikely(foundCount > kMaxMeshesPerIteration || !shouldContinue)) {
-          return;
-        }
+    const auto bitmap1 = reinterpret_cast<const uint64_t *>(h1->bitmap().bits());
+    const uint64_t meshable = mesh::bitmapsMeshableBatch(bitmap1, candidateBits, candidateCount, nBytes);
+
+    if (unlikely(meshable != 0)) {
+      // like a scalar scan, take the first meshable miniheap in the window
+      const size_t k = __builtin_ctzll(meshable);
+      const size_t idxMatch = candidateIdx[k];
+
+      std::pair<MiniHeap<PageSize> *, MiniHeap<PageSize> *> heaps{h1, right[idxMatch]};
+      bool shouldContinue = meshFound(std::move(heaps));
+      left[j] = nullptr;
+      right[idxMatch] = nullptr;
+      foundCount++;
+      if (unlikely(foundCount > kMaxMeshesPerIteration || !shouldContinue)) {
+        return;
       }
     }
   }
 }
 
+template <size_t PageSize>
+void ATTRIBUTE_NEVER_INLINE greedyMatching(
+    const PartialBuckets<PageSize> &miniheaps, OccupancyArray<PageSize> &candidates,
+    const function<bool(std::pair<MiniHeap<PageSize> *, MiniHeap<PageSize> *> &&)> &meshFound) noexcept {
+  // how many of the emptiest remaining spans each span is tested against
+  constexpr size_t t = 64;
+  static_assert(t <= kMeshableBatchMax, "probe window must fit in a single batch");
+
+  // emptiest bucket first, so a size class with more candidates than
+  // fit keeps the sparsest ones
+  size_t count = 0;
+  for (const auto &bucket : miniheaps) {
+    MiniHeapID mhId = bucket.first.next();
+    while (mhId != list::Head && count < kMaxSplitListSize) {
+      auto mh = GetMiniHeap<MiniHeap<PageSize>>(mhId);
+      mhId = mh->getFreelist()->next();
+
+      if (!mh->isMeshingCandidate() || (mh->fullness() >= kOccupancyCutoff)) {
+        continue;
+      }
+
+      // frees can race with us, so read each count once and sort on that
+      candidates[count] = {mh->inUseCount(), mh};
+      count++;
+    }
+  }
+
+  if (count < 2) {
+    return;
+  }
+
+  // fullest first
+  std::sort(&candidates[0], &candidates[count],
+            [](const std::pair<uint32_t, MiniHeap<PageSize> *> &a, const std::pair<uint32_t, MiniHeap<PageSize> *> &b) {
+              return a.first > b.first;
+            });
+
+  constexpr size_t nBytes = PageSize / kMinObjectSize / 8;
+  d_assert(nBytes == candidates[0].second->bitmap().byteCount());
+
+  const uint64_t *windowBits[t];
+  size_t windowIdx[t];
+
+  // candidates[tail] is the emptiest span that hasn't been matched yet
+  size_t tail = count - 1;
+  for (size_t i = 0; i < tail; i++) {
+    auto h1 = candidates[i].second;
+    if (h1 == nullptr)
+      continue;
+
+    // spans matched out of the middle of a window leave holes, so
+    // bound how far back we look
+    size_t windowCount = 0;
+    for (size_t j = tail; j > i && windowCount < t && tail - j < 2 * t; j--) {
+      auto h2 = candidates[j].second;
+      if (h2 == nullptr)
+        continue;
+
+      windowBits[windowCount] = reinterpret_cast<const uint64_t *>(h2->bitmap().bits());
+      windowIdx[windowCount] = j;
+      windowCount++;
+    }
+
+    if (windowCount == 0)
+      continue;
+
+    const auto bitmap1 = reinterpret_cast<const uint64_t *>(h1->bitmap().bits());
+    const uint64_t meshable = mesh::bitmapsMeshableBatch(bitmap1, windowBits, windowCount, nBytes);
+    if (meshable == 0)
+      continue;
+
+    // pair with the emptiest meshable span in the window
+    const size_t idxMatch = windowIdx[__builtin_ctzll(meshable)];
+    std::pair<MiniHeap<PageSize> *, MiniHeap<PageSize> *> heaps{h1, candidates[idxMatch].second};
+    bool shouldContinue = meshFound(std::move(heaps));
+    candidates[i].second = nullptr;
+    candidates[idxMatch].second = nullptr;
+    if (!shouldContinue) {
+      return;
+    }
+
+    while (tail > i && candidates[tail].second == nullptr) {
+      tail--;
+    }
+  }
+}
+
 }  // namespace method
 }  // namespace mesh
 
@@ -209,6 +209,69 @@ inline size_t getPageSizeFromAuxv() {
 }
 #endif  // defined(__aarch64__) || defined(__x86_64__)
 
+#ifdef __x86_64__
+// ===================================================================
+// x86_64 CPU Feature Detection
+// ===================================================================
+// Used to pick SIMD kernels at load time.  __builtin_cpu_supports
+// depends on libgcc state that may not be initialized yet when a
+// resolver runs, so we issue CPUID (and XGETBV, to check that the OS
+// saves the wider vector registers on context switch) directly.
+// ===================================================================
+
+__attribute__((no_stack_protector)) inline void cpuid(unsigned leaf, unsigned subleaf, unsigned regs[4]) {
+  __asm__ volatile("cpuid" : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3]) : "a"(leaf), "c"(subleaf));
+}
+
+__attribute__((no_stack_protector)) inline unsigned long long xgetbv0() {
+  unsigned lo, hi;
+  __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  return (static_cast<unsigned long long>(hi) << 32) | lo;
+}
+
+// bits of XCR0 the OS must set for it to preserve AVX (XMM + YMM) and
+// AVX-512 (opmask + both halves of ZMM) state
+static constexpr unsigned long long kXcr0Avx = 0x6;
+static constexpr unsigned long long kXcr0Avx512 = 0xe6;
+
+__attribute__((no_stack_protector)) inline unsigned long long osVectorState() {
+  unsigned regs[4];
+  cpuid(0, 0, regs);
+  if (regs[0] < 7) {
+    return 0;
+  }
+
+  cpuid(1, 0, regs);
+  const bool osxsave = (regs[2] >> 27) & 1;
+  const bool avx = (regs[2] >> 28) & 1;
+  if (!osxsave || !avx) {
+    return 0;
+  }
+
+  return xgetbv0();
+}
+
+__attribute__((no_stack_protector)) inline bool cpuHasAvx2() {
+  if ((osVectorState() & kXcr0Avx) != kXcr0Avx) {
+    return false;
+  }
+
+  unsigned regs[4];
+  cpuid(7, 0, regs);
+  return (regs[1] >> 5) & 1;
+}
+
+__attribute__((no_stack_protector)) inline bool cpuHasAvx512F() {
+  if ((osVectorState() & kXcr0Avx512) != kXcr0Avx512) {
+    return false;
+  }
+
+  unsigned regs[4];
+  cpuid(7, 0, regs);
+  return (regs[1] >> 16) & 1;
+}
+#endif  // __x86_64__
+
 }  // namespace ifunc
 }  // namespace mesh
 
@@ -13,6 +13,7 @@
 #endif
 
 #include <atomic>
+#include <set>
 #include <unordered_set>
 
 #include <signal.h>
@@ -109,6 +110,11 @@ MiniHeapID GetMiniHeapID(const MiniHeapT *mh);
 template <size_t PageSize>
 using SplitArray = std::array<MiniHeap<PageSize> *, kMaxSplitListSize>;
 
+// miniheaps paired with their in-use count when they were collected,
+// so sorting them doesn't race with concurrent frees
+template <size_t PageSize>
+using OccupancyArray = std::array<std::pair<uint32_t, MiniHeap<PageSize> *>, kMaxSplitListSize>;
+
 template <size_t PageSize>
 using MergeSetArray = std::array<std::pair<MiniHeap<PageSize> *, MiniHeap<PageSize> *>, kMaxMergeSets>;
 
@@ -150,7 +156,9 @@ public:
   // add calls remove for you
   void add(Entry *listHead, uint8_t listId, ID selfId, Object *newEntry) {
     const uint8_t oldId = newEntry->freelistId();
-    d_assert(oldId != listId);
+    // moving between two lists with the same id (e.g. partial
+    // occupancy buckets) is fine, re-adding to the same list isn't
+    d_assert(oldId != listId || (listHead != nullptr && listHead != this));
     d_assert(!newEntry->isLargeAlloc());
 
     Entry *newEntryFreelist = newEntry->getFreelist();
@@ -213,6 +221,11 @@ private:
 template <size_t PageSize>
 using MiniHeapListEntry = ListEntry<MiniHeap<PageSize>, MiniHeapID>;
 
+// a size class's partial freelist, bucketed by occupancy from
+// emptiest to fullest.  Each bucket is a list head + its length.
+template <size_t PageSize>
+using PartialBuckets = std::array<std::pair<MiniHeapListEntry<PageSize>, size_t>, kBinnedTrackerBinCount>;
+
 typedef uint32_t Offset;
 typedef uint32_t Length;
 
@@ -246,10 +259,6 @@ struct Span {
     return Span(offset + pageCount, restPageCount);
   }
 
-  uint32_t spanClass() const {
-    return std::min(length, kSpanClassCount) - 1;
-  }
-
   size_t byteLength() const {
     return length * getPageSize();
   }
@@ -280,13 +289,19 @@ namespace internal {
 // return the kernel's perspective on our proportional set size
 size_t measurePssKiB();
 
+// the number of NUMA nodes the arena distinguishes between (at most
+// kMaxNumaNodes), and the one the calling thread is running on
+size_t numaNodeCount();
+size_t currentNumaNode();
+
 inline void *MaskToPage(const void *ptr) {
   const auto ptrval = reinterpret_cast<uintptr_t>(ptr);
   return reinterpret_cast<void *>(ptrval & (uintptr_t)~(CPUInfo::PageSize - 1));
 }
 
-// efficiently copy data from srcFd to dstFd
-int copyFile(int dstFd, int srcFd, off_t off, size_t sz);
+// efficiently copy data from srcFd to dstFd, returning the number of
+// bytes copied
+ssize_t copyFile(int dstFd, int srcFd, off_t off, size_t sz);
 
 // for mesh-internal data structures, like heap metadata
 class Heap : public ExactlyOneHeap<LockedHeap<PosixLockType, PartitionedHeap>> {
@@ -320,6 +335,9 @@ using unordered_set = std::unordered_set<K, hash<K>, equal_to<K>, STLAllocator<K
 template <typename K, typename V>
 using map = std::map<K, V, std::less<K>, STLAllocator<pair<const K, V>, Heap>>;
 
+template <typename K>
+using set = std::set<K, std::less<K>, STLAllocator<K, Heap>>;
+
 typedef std::basic_string<char, std::char_traits<char>, STLAllocator<char, Heap>> string;
 
 template <typename T>
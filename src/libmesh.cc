@@ -12,6 +12,7 @@
 
 #include "runtime.h"
 #include "thread_local_heap.h"
+#include "cpu_local_heap.h"
 #include "runtime_impl.h"
 #include "dispatch_utils.h"
 #include "ifunc_resolver.h"
@@ -50,12 +51,97 @@ static __attribute__((constructor)) void libmesh_init() {
     dispatchByPageSize([period](auto &rt) { rt.setMeshPeriodMs(std::chrono::milliseconds{period}); });
   }
 
+  char *incremental = getenv("MESH_INCREMENTAL");
+  if (incremental && atoi(incremental)) {
+    dispatchByPageSize([](auto &rt) { rt.heap().setMeshIncremental(true); });
+  }
+
+  char *hugePages = getenv("MESH_HUGEPAGES");
+  if (hugePages && atoi(hugePages)) {
+    dispatchByPageSize([](auto &rt) { rt.heap().setHugePages(true); });
+  }
+
+  char *emptyRetainStr = getenv("MESH_EMPTY_RETAIN_BYTES");
+  if (emptyRetainStr) {
+    const size_t bytes = strtoul(emptyRetainStr, nullptr, 10);
+    dispatchByPageSize([bytes](auto &rt) { rt.heap().setEmptyRetainBytes(bytes); });
+  }
+
+  // 0 turns off batching of cross-thread frees, e.g. to compare
+  // larson with and without it
+  char *remoteFreeBatchStr = getenv("MESH_REMOTE_FREE_BATCH");
+  if (remoteFreeBatchStr) {
+    const size_t count = strtoul(remoteFreeBatchStr, nullptr, 10);
+    dispatchByPageSize([count](auto &rt) { rt.heap().setRemoteFreeBatch(count); });
+  }
+
+  char *threadCacheStr = getenv("MESH_THREAD_CACHE_BYTES");
+  if (threadCacheStr) {
+    const size_t bytes = strtoul(threadCacheStr, nullptr, 10);
+    dispatchByPageSize([bytes](auto &rt) { rt.heap().setThreadCacheBytes(bytes); });
+  }
+
+  char *dirtyDecayStr = getenv("MESH_DIRTY_DECAY_MS");
+  if (dirtyDecayStr) {
+    const size_t decayMs = strtoul(dirtyDecayStr, nullptr, 10);
+    dispatchByPageSize([decayMs](auto &rt) { rt.heap().setDirtyDecayMs(decayMs); });
+  }
+
+  char *muzzyDecayStr = getenv("MESH_MUZZY_DECAY_MS");
+  if (muzzyDecayStr) {
+    const size_t decayMs = strtoul(muzzyDecayStr, nullptr, 10);
+    dispatchByPageSize([decayMs](auto &rt) { rt.heap().setMuzzyDecayMs(decayMs); });
+  }
+
+  char *uffdBarrier = getenv("MESH_UFFD_BARRIER");
+  if (uffdBarrier && atoi(uffdBarrier)) {
+    dispatchByPageSize([](auto &rt) {
+      if (!rt.heap().setUffdBarrier(true)) {
+        mesh::debug("MESH_UFFD_BARRIER: userfaultfd write-protect unavailable, using mprotect\n");
+      }
+    });
+  }
+
+  char *algorithmStr = getenv("MESH_ALGORITHM");
+  if (algorithmStr) {
+    // either an algorithm:: index or its name
+    size_t meshAlgorithm = strtoul(algorithmStr, nullptr, 10);
+    if (strcmp(algorithmStr, "greedy") == 0) {
+      meshAlgorithm = algorithm::Greedy;
+    }
+    dispatchByPageSize([meshAlgorithm](auto &rt) { rt.heap().setMeshAlgorithm(meshAlgorithm); });
+  }
+
+  char *meshThreadsStr = getenv("MESH_MESH_THREADS");
+  if (meshThreadsStr) {
+    long threads = strtol(meshThreadsStr, nullptr, 10);
+    if (threads < 1) {
+      threads = 1;
+    }
+    dispatchByPageSize([threads](auto &rt) { rt.heap().setMeshThreads(threads); });
+  }
+
+  char *bgBudgetStr = getenv("MESH_BACKGROUND_MESH_BUDGET_MS");
+  if (bgBudgetStr) {
+    long budget = strtol(bgBudgetStr, nullptr, 10);
+    if (budget < 1) {
+      budget = 1;
+    }
+    dispatchByPageSize([budget](auto &rt) { rt.heap().setBackgroundMeshBudgetMs(budget); });
+  }
+
+  // meshing on the background thread implies starting it
+  char *bgMesh = getenv("MESH_BACKGROUND_MESH");
+  int shouldMeshInBackground = bgMesh ? atoi(bgMesh) : 0;
+
   char *bgThread = getenv("MESH_BACKGROUND_THREAD");
-  if (!bgThread)
-    return;
+  int shouldThread = bgThread ? atoi(bgThread) : 0;
 
-  int shouldThread = atoi(bgThread);
-  if (shouldThread) {
+  if (shouldMeshInBackground) {
+    dispatchByPageSize([](auto &rt) { rt.heap().enableBackgroundMeshing(); });
+  }
+
+  if (shouldThread || shouldMeshInBackground) {
     dispatchByPageSize([](auto &rt) { rt.startBgThread(); });
   }
 }
@@ -76,46 +162,97 @@ static __attribute__((destructor)) void libmesh_fini() {
 
 namespace mesh {
 
+// With MESH_PERCPU_HEAPS no thread-local heaps are created, so every
+// call lands in one of the slowpaths below and is served by the
+// current CPU's heap instead.
+#if MESH_PERCPU_HEAPS
+template <size_t PageSize>
+using LocalHeap = CpuLocalHeap<PageSize>;
+#else
+template <size_t PageSize>
+class LocalHeap {
+public:
+  LocalHeap() : _heap(ThreadLocalHeap<PageSize>::GetHeap()) {
+  }
+
+  inline ThreadLocalHeap<PageSize> *operator->() const {
+    return _heap;
+  }
+
+private:
+  ThreadLocalHeap<PageSize> *const _heap;
+};
+#endif
+
 template <size_t PageSize>
 ATTRIBUTE_NEVER_INLINE void *allocSlowpath(size_t sz) {
-  ThreadLocalHeap<PageSize> *localHeap = ThreadLocalHeap<PageSize>::GetHeap();
+  LocalHeap<PageSize> localHeap;
   return localHeap->malloc(sz);
 }
 
 template <size_t PageSize>
 ATTRIBUTE_NEVER_INLINE __attribute__((unused)) void *cxxNewSlowpath(size_t sz) {
-  ThreadLocalHeap<PageSize> *localHeap = ThreadLocalHeap<PageSize>::GetHeap();
+  LocalHeap<PageSize> localHeap;
   return localHeap->cxxNew(sz);
 }
 
 template <size_t PageSize>
 ATTRIBUTE_NEVER_INLINE void freeSlowpath(void *ptr) {
+#if MESH_PERCPU_HEAPS
+  // frees of objects in this CPU's miniheaps go back to its shuffle
+  // vectors
+  CpuLocalHeap<PageSize> localHeap;
+  localHeap->free(ptr);
+#else
   // instead of instantiating a thread-local heap on free, just free
   // to the global heap directly
   runtime<PageSize>().heap().free(ptr);
+#endif
+}
+
+template <size_t PageSize>
+ATTRIBUTE_NEVER_INLINE void *allocSizeClassSlowpath(uint32_t sizeClass) {
+  LocalHeap<PageSize> localHeap;
+  return localHeap->mallocSizeClass(sizeClass);
+}
+
+template <size_t PageSize>
+ATTRIBUTE_NEVER_INLINE size_t allocBatchSlowpath(size_t sz, void **ptrs, size_t count) {
+  LocalHeap<PageSize> localHeap;
+  return localHeap->mallocBatch(sz, ptrs, count);
+}
+
+template <size_t PageSize>
+ATTRIBUTE_NEVER_INLINE void freeBatchSlowpath(void *const *ptrs, size_t count) {
+#if MESH_PERCPU_HEAPS
+  CpuLocalHeap<PageSize> localHeap;
+  localHeap->freeBatch(ptrs, count);
+#else
+  runtime<PageSize>().heap().freeBatch(ptrs, count);
+#endif
 }
 
 template <size_t PageSize>
 ATTRIBUTE_NEVER_INLINE void *reallocSlowpath(void *oldPtr, size_t newSize) {
-  ThreadLocalHeap<PageSize> *localHeap = ThreadLocalHeap<PageSize>::GetHeap();
+  LocalHeap<PageSize> localHeap;
   return localHeap->realloc(oldPtr, newSize);
 }
 
 template <size_t PageSize>
 ATTRIBUTE_NEVER_INLINE void *callocSlowpath(size_t count, size_t size) {
-  ThreadLocalHeap<PageSize> *localHeap = ThreadLocalHeap<PageSize>::GetHeap();
+  LocalHeap<PageSize> localHeap;
   return localHeap->calloc(count, size);
 }
 
 template <size_t PageSize>
 ATTRIBUTE_NEVER_INLINE size_t usableSizeSlowpath(void *ptr) {
-  ThreadLocalHeap<PageSize> *localHeap = ThreadLocalHeap<PageSize>::GetHeap();
+  LocalHeap<PageSize> localHeap;
   return localHeap->getSize(ptr);
 }
 
 template <size_t PageSize>
 ATTRIBUTE_NEVER_INLINE void *memalignSlowpath(size_t alignment, size_t size) {
-  ThreadLocalHeap<PageSize> *localHeap = ThreadLocalHeap<PageSize>::GetHeap();
+  LocalHeap<PageSize> localHeap;
   return localHeap->memalign(alignment, size);
 }
 }  // namespace mesh
@@ -150,6 +287,37 @@ static void mesh_sized_free_impl(void *ptr, size_t sz) {
   localHeap->sizedFree(ptr, sz);
 }
 
+template <size_t PageSize>
+static void *mesh_malloc_size_class_impl(unsigned sizeClass) {
+  if (unlikely(sizeClass == 0 || sizeClass >= kNumBins)) {
+    return nullptr;
+  }
+  auto *localHeap = ThreadLocalHeap<PageSize>::GetHeapIfPresent();
+  if (unlikely(localHeap == nullptr)) {
+    return mesh::allocSizeClassSlowpath<PageSize>(sizeClass);
+  }
+  return localHeap->mallocSizeClass(sizeClass);
+}
+
+template <size_t PageSize>
+static size_t mesh_malloc_batch_impl(size_t sz, void **ptrs, size_t count) {
+  auto *localHeap = ThreadLocalHeap<PageSize>::GetHeapIfPresent();
+  if (unlikely(localHeap == nullptr)) {
+    return mesh::allocBatchSlowpath<PageSize>(sz, ptrs, count);
+  }
+  return localHeap->mallocBatch(sz, ptrs, count);
+}
+
+template <size_t PageSize>
+static void mesh_free_batch_impl(void *const *ptrs, size_t count) {
+  auto *localHeap = ThreadLocalHeap<PageSize>::GetHeapIfPresent();
+  if (unlikely(localHeap == nullptr)) {
+    mesh::freeBatchSlowpath<PageSize>(ptrs, count);
+    return;
+  }
+  localHeap->freeBatch(ptrs, count);
+}
+
 template <size_t PageSize>
 static void *mesh_realloc_impl(void *oldPtr, size_t newSize) {
   auto *localHeap = ThreadLocalHeap<PageSize>::GetHeapIfPresent();
@@ -218,6 +386,7 @@ typedef void *(*realloc_func)(void *, size_t);
 typedef size_t (*usable_size_func)(void *);
 typedef void *(*memalign_func)(size_t, size_t);
 typedef void *(*calloc_func)(size_t, size_t);
+typedef void *(*size_class_malloc_func)(unsigned);
 
 __attribute__((no_stack_protector)) static malloc_func resolve_mesh_malloc() {
   size_t pageSize = mesh::ifunc::getPageSizeFromAuxv();
@@ -248,6 +417,11 @@ __attribute__((no_stack_protector)) static calloc_func resolve_mesh_calloc() {
   size_t pageSize = mesh::ifunc::getPageSizeFromAuxv();
   return (pageSize == kPageSize4K) ? mesh_calloc_impl<kPageSize4K> : mesh_calloc_impl<kPageSize16K>;
 }
+__attribute__((no_stack_protector)) static size_class_malloc_func resolve_mesh_malloc_size_class() {
+  size_t pageSize = mesh::ifunc::getPageSizeFromAuxv();
+  return (pageSize == kPageSize4K) ? mesh_malloc_size_class_impl<kPageSize4K>
+                                   : mesh_malloc_size_class_impl<kPageSize16K>;
+}
 }
 #endif
 
@@ -366,6 +540,19 @@ extern "C" MESH_EXPORT CACHELINE_ALIGNED_FN void *mesh_calloc(size_t count, size
 }
 #endif
 
+extern "C" MESH_EXPORT CACHELINE_ALIGNED_FN void *mesh_malloc_size_class(unsigned sizeClass)
+#if defined(__linux__) && defined(__aarch64__)
+    __attribute__((ifunc("resolve_mesh_malloc_size_class")));
+#else
+{
+  if (likely(getPageSize() == kPageSize4K)) {
+    return mesh_malloc_size_class_impl<kPageSize4K>(sizeClass);
+  } else {
+    return mesh_malloc_size_class_impl<kPageSize16K>(sizeClass);
+  }
+}
+#endif
+
 extern "C" {
 #ifdef __linux__
 size_t MESH_EXPORT mesh_usable_size(void *ptr) __attribute__((weak, alias("mesh_malloc_usable_size")));
@@ -416,7 +603,23 @@ void MESH_EXPORT ATTRIBUTE_NORETURN pthread_exit(void *retval) {
 // Same API as je_mallctl, allows a program to query stats and set
 // allocator-related options.
 int MESH_EXPORT mesh_mallctl(const char *name, void *oldp, size_t *oldlenp, void *newp, size_t newlen) {
-  return mesh::dispatchByPageSize([=](auto &rt) { return rt.heap().mallctl(name, oldp, oldlenp, newp, newlen); });
+  return mesh::dispatchByPageSize([=](auto &rt) { return rt.mallctl(name, oldp, oldlenp, newp, newlen); });
+}
+
+size_t MESH_EXPORT mesh_malloc_batch(size_t sz, void **ptrs, size_t count) {
+  if (likely(getPageSize() == kPageSize4K)) {
+    return mesh_malloc_batch_impl<kPageSize4K>(sz, ptrs, count);
+  } else {
+    return mesh_malloc_batch_impl<kPageSize16K>(sz, ptrs, count);
+  }
+}
+
+void MESH_EXPORT mesh_free_batch(void **ptrs, size_t count) {
+  if (likely(getPageSize() == kPageSize4K)) {
+    mesh_free_batch_impl<kPageSize4K>(ptrs, count);
+  } else {
+    mesh_free_batch_impl<kPageSize16K>(ptrs, count);
+  }
 }
 
 #ifdef __linux__
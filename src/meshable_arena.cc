@@ -3,13 +3,115 @@
 // Use of this source code is governed by the Apache License,
 // Version 2.0, that can be found in the LICENSE file.
 
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#if __has_include(<linux/userfaultfd.h>)
+#include <linux/userfaultfd.h>
+#endif
+#endif
+
 #include "meshable_arena.h"
 #include "runtime.h"
+#include "cpu_local_heap.h"
 
 namespace mesh {
 
+namespace {
+int openUffd() {
+#if defined(__linux__) && defined(UFFDIO_WRITEPROTECT) && defined(UFFD_FEATURE_WP_HUGETLBFS_SHMEM)
+  // ideally the kernel blocks on protected pages too (e.g. a read()
+  // into a span being meshed), but unprivileged processes may only
+  // handle user-mode faults.  Syscalls then fail with EFAULT, which
+  // our wrappers already retry.
+  int fd = syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+#ifdef UFFD_USER_MODE_ONLY
+  if (fd == -1 && errno == EPERM) {
+    fd = syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+  }
+#endif
+  if (fd == -1) {
+    return -1;
+  }
+
+  struct uffdio_api api;
+  memset(&api, 0, sizeof(api));
+  api.api = UFFD_API;
+  api.features = UFFD_FEATURE_WP_HUGETLBFS_SHMEM;
+  if (ioctl(fd, UFFDIO_API, &api) == -1 || (api.features & UFFD_FEATURE_WP_HUGETLBFS_SHMEM) == 0) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+#else
+  return -1;
+#endif
+}
+}  // namespace
+
+template <size_t PageSize>
+bool MeshableArena<PageSize>::setUffdBarrier(bool enabled) {
+  if (!enabled || !kMeshingEnabled) {
+    if (_uffd != -1) {
+      close(_uffd);
+      _uffd = -1;
+    }
+    return !enabled;
+  }
+
+  if (_uffd == -1) {
+    _uffd = openUffd();
+  }
+  return _uffd != -1;
+}
+
+template <size_t PageSize>
+size_t MeshableArena<PageSize>::uffdProtect(Offset off, size_t pageCount) {
+#ifdef UFFDIO_WRITEPROTECT
+  // the remap at the end of the last mesh replaced any registration
+  // these pages had, so register them every time
+  struct uffdio_register reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.range.start = ptrvalFromOffset(off);
+  reg.range.len = pageCount << kPageShift;
+  reg.mode = UFFDIO_REGISTER_MODE_WP;
+  if (ioctl(_uffd, UFFDIO_REGISTER, &reg) == -1) {
+    return 0;
+  }
+
+  struct uffdio_writeprotect wp;
+  memset(&wp, 0, sizeof(wp));
+  wp.range = reg.range;
+  wp.mode = UFFDIO_WRITEPROTECT_MODE_WP;
+  if (ioctl(_uffd, UFFDIO_WRITEPROTECT, &wp) == -1) {
+    ioctl(_uffd, UFFDIO_UNREGISTER, &reg.range);
+    return 0;
+  }
+
+  return 2;
+#else
+  return 0;
+#endif
+}
+
+template <size_t PageSize>
+void MeshableArena<PageSize>::uffdWake(Offset off, size_t pageCount) {
+#ifdef UFFDIO_WRITEPROTECT
+  struct uffdio_range range;
+  range.start = ptrvalFromOffset(off);
+  range.len = pageCount << kPageShift;
+  int r = ioctl(_uffd, UFFDIO_WAKE, &range);
+  d_assert_msg(r == 0, "UFFDIO_WAKE: %d", errno);
+#endif
+}
+
 template <size_t PageSize>
 void MeshableArena<PageSize>::prepareForFork() {
+  if (kPerCpuHeaps) {
+    CpuLocalHeap<PageSize>::LockAll();
+  }
+
   if (!kMeshingEnabled) {
     return;
   }
@@ -18,7 +120,9 @@ void MeshableArena<PageSize>::prepareForFork() {
   runtime<PageSize>().lock();
   internal::Heap().lock();
 
-  int r = mprotect(_arenaBegin, kArenaSize, PROT_READ);
+  _forkStart = time::preciseNow();
+
+  int r = mprotect(_arenaBegin, _arenaSize, PROT_READ);
   hard_assert(r == 0);
 
   int err = pipe(_forkPipe);
@@ -29,6 +133,10 @@ void MeshableArena<PageSize>::prepareForFork() {
 
 template <size_t PageSize>
 void MeshableArena<PageSize>::afterForkParent() {
+  if (kPerCpuHeaps) {
+    CpuLocalHeap<PageSize>::UnlockAll();
+  }
+
   if (!kMeshingEnabled) {
     return;
   }
@@ -49,9 +157,15 @@ void MeshableArena<PageSize>::afterForkParent() {
   _forkPipe[0] = -1;
   _forkPipe[1] = -1;
 
-  int r = mprotect(_arenaBegin, kArenaSize, PROT_READ | PROT_WRITE);
+  int r = mprotect(_arenaBegin, _arenaSize, PROT_READ | PROT_WRITE);
   hard_assert(r == 0);
 
+  const size_t forkUs =
+      std::chrono::duration_cast<std::chrono::microseconds>(time::preciseNow() - _forkStart).count();
+  _forkCount++;
+  _forkTotalUs += forkUs;
+  _forkMaxUs = std::max(_forkMaxUs, forkUs);
+
   runtime<PageSize>().unlock();
   runtime<PageSize>().heap().unlock();
 }
@@ -63,12 +177,27 @@ void MeshableArena<PageSize>::doAfterForkChild() {
 
 template <size_t PageSize>
 void MeshableArena<PageSize>::afterForkChild() {
+  // as in afterForkParent, first, so no early return below skips it
+  if (kPerCpuHeaps) {
+    CpuLocalHeap<PageSize>::UnlockAll();
+  }
+
   runtime<PageSize>().updatePid();
+  // the background thread didn't survive the fork, so go back to
+  // meshing inline in the child
+  runtime<PageSize>().heap().disableBackgroundMeshing();
+  runtime<PageSize>().heap().abandonMeshThreads();
 
   if (!kMeshingEnabled) {
     return;
   }
 
+  // our userfaultfd belongs to the parent's address space
+  if (_uffd != -1) {
+    close(_uffd);
+    _uffd = openUffd();
+  }
+
   if (_forkPipe[0] == -1) {
     return;
   }
@@ -81,29 +210,62 @@ void MeshableArena<PageSize>::afterForkChild() {
 
   char *oldSpanDir = _spanDir;
 
-  int newFd = openSpanFile(kArenaSize);
+  int newFd = openSpanFile(arenaFileSize());
 
   struct stat fileinfo;
   memset(&fileinfo, 0, sizeof(fileinfo));
   fstat(newFd, &fileinfo);
-  d_assert(fileinfo.st_size >= 0 && (size_t)fileinfo.st_size == kArenaSize);
+  d_assert(fileinfo.st_size >= 0 && (size_t)fileinfo.st_size == arenaFileSize());
 
   const int oldFd = _fd;
 
-  const auto bitmap = allocatedBitmap();
-  for (auto const &i : bitmap) {
-    int result = internal::copyFile(newFd, oldFd, i << kPageShift, PageSize);
-    d_assert(result == CPUInfo::PageSize);
+  // the parent is blocked until we're done, so copy each run of
+  // allocated pages with as few calls as possible.  Meshed pages are
+  // skipped: their physical pages were released when they were meshed,
+  // and they are pointed back at the pages they share below.
+  {
+    const auto bitmap = allocatedBitmap();
+    Offset runStart = 0;
+    size_t runLength = 0;
+    auto copyRun = [&]() {
+      if (runLength == 0) {
+        return;
+      }
+      const size_t sz = runLength << kPageShift;
+      const ssize_t result = internal::copyFile(newFd, oldFd, static_cast<off_t>(runStart) << kPageShift, sz);
+      hard_assert_msg(result == static_cast<ssize_t>(sz), "fork copy failed: %zd/%zu (errno %d)", result, sz, errno);
+      runLength = 0;
+    };
+
+    for (auto const &i : bitmap) {
+      if (_meshedBitmap.isSet(i)) {
+        continue;
+      }
+      if (runLength > 0 && i == runStart + runLength) {
+        runLength++;
+        continue;
+      }
+      copyRun();
+      runStart = i;
+      runLength = 1;
+    }
+    copyRun();
   }
 
-  int r = mprotect(_arenaBegin, kArenaSize, PROT_READ | PROT_WRITE);
+  int r = mprotect(_arenaBegin, _arenaSize, PROT_READ | PROT_WRITE);
   hard_assert(r == 0);
 
-  void *ptr = mmap(_arenaBegin, kArenaSize, HL_MMAP_PROTECTION_MASK, kMapShared | MAP_FIXED, newFd, 0);
+  void *ptr = mmap(_arenaBegin, _arenaSize, HL_MMAP_PROTECTION_MASK, kMapShared | MAP_FIXED, newFd, 0);
   hard_assert_msg(ptr != MAP_FAILED, "map failed: %d", errno);
 
+  // the new mapping lost our THP advice
+  for (auto const &chunk : _hugeChunks) {
+    adviseHugeChunk(chunk);
+  }
+
   {
     internal::unordered_set<void *> seenMiniheaps{};
+    internal::vector<MeshRemap> remaps{};
 
     for (auto const &i : _meshedBitmap) {
       void *mh_void = miniheapForArenaOffset(i);
@@ -134,13 +296,17 @@ void MeshableArena<PageSize>::afterForkChild() {
         }
 #endif
 
-        void *remapPtr =
-            mmap(remove, sz, HL_MMAP_PROTECTION_MASK, kMapShared | MAP_FIXED, newFd, keepOff << kPageShift);
-        hard_assert_msg(remapPtr != MAP_FAILED, "mesh remap failed: %d", errno);
+        remaps.push_back({keepOff, removeOff, static_cast<Length>(sz >> kPageShift), false});
 
         return false;
       });
     }
+
+    // _meshedBitmap is walked in order, but a miniheap's meshed spans
+    // needn't be
+    std::sort(remaps.begin(), remaps.end(),
+              [](const MeshRemap &a, const MeshRemap &b) { return a.remove < b.remove; });
+    remapMeshed(newFd, remaps.data(), remaps.size());
   }
 
   _fd = newFd;
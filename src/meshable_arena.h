@@ -25,6 +25,7 @@
 #include <linux/fs.h>
 #include <sys/syscall.h>
 #include <linux/memfd.h>
+#include <sys/eventfd.h>
 #endif
 
 #if defined(__APPLE__)
@@ -46,12 +47,16 @@
 #include <algorithm>
 #include <cstdio>
 #include <cstring>
+#include <limits>
 #include <new>
 
 #include "internal.h"
 
 #include "cheap_heap.h"
 
+#include "decay.h"
+#include "free_span_set.h"
+
 #include "bitmap.h"
 
 #include "mmap_heap.h"
@@ -95,19 +100,6 @@ inline char *uintToStr(char *dst, uint32_t i) {
   return strcat(dst, digit);
 }
 
-template <typename Func>
-inline void forEachFree(const internal::vector<Span> freeSpans[kSpanClassCount], const Func func) {
-  for (size_t i = 0; i < kSpanClassCount; i++) {
-    if (freeSpans[i].empty())
-      continue;
-
-    for (size_t j = 0; j < freeSpans[i].size(); j++) {
-      auto span = freeSpans[i][j];
-      func(span);
-    }
-  }
-}
-
 #ifdef USE_MEMFD
 inline int sys_memfd_create(const char *name, unsigned int flags) {
   return syscall(__NR_memfd_create, name, flags);
@@ -137,11 +129,16 @@ public:
   inline bool contains(const void *ptr) const {
     auto arena = reinterpret_cast<uintptr_t>(_arenaBegin);
     auto ptrval = reinterpret_cast<uintptr_t>(ptr);
-    return arena <= ptrval && ptrval < arena + kArenaSize;
+    return arena <= ptrval && ptrval < arena + _arenaSize;
   }
 
   char *pageAlloc(Span &result, size_t pageCount, size_t pageAlignment = 1);
 
+  // like pageAlloc, but packs the span into a hugepage-aligned chunk
+  // that is advised for THP.  Spans from here are never meshed (that
+  // would split the huge page), so only dense spans should use it.
+  char *hugePageAlloc(Span &result, size_t pageCount);
+
   void free(void *ptr, size_t sz, internal::PageType type);
 
   inline void trackMiniHeap(const Span span, MiniHeapID id) {
@@ -179,8 +176,32 @@ public:
     return miniheapForArenaOffset(arenaOff);
   }
 
-  void beginMesh(void *keep, void *remove, size_t sz);
-  void finalizeMesh(void *keep, void *remove, size_t sz);
+  // one span being meshed away: remove's virtual pages end up backed
+  // by keep's physical pages.  If release is set, remove's own
+  // physical pages are returned to the OS afterwards.
+  struct MeshRemap {
+    Offset keep;
+    Offset remove;
+    Length length;
+    bool release;
+  };
+
+  // marks every span being removed read-only, and after objects have
+  // been copied points them at the spans being kept.  Adjacent spans
+  // share a syscall; both return the number of syscalls made.
+  size_t beginMeshBatch(MeshRemap *remaps, size_t count);
+  size_t finalizeMeshBatch(MeshRemap *remaps, size_t count);
+
+  // with the userfaultfd barrier, spans being meshed are
+  // write-protected with UFFDIO_WRITEPROTECT rather than mprotect.
+  // Writers then wait in the kernel for the mesh to finish, and are
+  // woken by the mesher, rather than taking a SIGSEGV and waiting on a
+  // size-class lock.  Returns false if the kernel doesn't support it.
+  bool setUffdBarrier(bool enabled);
+
+  inline bool uffdBarrier() const {
+    return _uffd != -1;
+  }
 
   inline bool aboveMeshThreshold() const {
     return _meshedPageCount > _maxMeshCount;
@@ -195,11 +216,157 @@ public:
     return _maxMeshCount;
   }
 
+  inline void setHugePages(bool enabled) {
+    _hugePages = enabled;
+  }
+
+  inline bool hugePages() const {
+    return _hugePages;
+  }
+
+  inline bool isHugeOffset(Offset off) const {
+    return _hugeChunkCount > 0 && off >= _hugeChunkBase && _hugeChunks.isSet(hugeChunkFor(off));
+  }
+
+  // pages handed out to spans, and how many of those live in hugepage
+  // chunks (our TLB-friendly fraction)
+  inline size_t spanPageCount() const {
+    return _spanPageCount;
+  }
+
+  inline size_t hugeSpanPageCount() const {
+    return _hugeSpanPageCount;
+  }
+
+  // how long the parent has been blocked in fork() while the child
+  // copies the arena
+  inline size_t forkCount() const {
+    return _forkCount;
+  }
+
+  inline size_t forkTotalUs() const {
+    return _forkTotalUs;
+  }
+
+  inline size_t forkMaxUs() const {
+    return _forkMaxUs;
+  }
+
   // protected:
   // public for testing
   void scavenge(bool force);
   // like a scavenge, but we only MADV_FREE
   void partialScavenge();
+  // resets freed meshed spans and cleans dirty spans, stopping once
+  // roughly maxPages pages have been processed.  Returns true if
+  // there is work left for another slice.
+  bool scavengeSlice(size_t maxPages);
+  // the scavenge run around a mesh pass: freed meshed spans are reset
+  // right away (so we stay under the VMA limit), but with background
+  // scavenging on, dirty spans are left for the background thread.
+  void meshScavenge();
+
+  // rather than scavenging inline when too many dirty pages build up,
+  // post a hint to scavengeHintFd(), which the background thread
+  // polls and answers with scavengeSlice() calls.
+  void enableBackgroundScavenging() {
+#ifdef __linux__
+    if (_scavengeHintFd < 0) {
+      _scavengeHintFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+      hard_assert(_scavengeHintFd >= 0);
+    }
+#endif
+  }
+
+  void disableBackgroundScavenging() {
+    _scavengeHintPending = false;
+    if (_scavengeHintFd >= 0) {
+      close(_scavengeHintFd);
+      _scavengeHintFd = -1;
+    }
+  }
+
+  int scavengeHintFd() const {
+    return _scavengeHintFd;
+  }
+
+  bool scavengeHintPending() const {
+    return _scavengeHintPending;
+  }
+
+  inline size_t dirtyPageCount() const {
+    return _dirty.pageCount();
+  }
+
+  inline size_t muzzyPageCount() const {
+    return _muzzy.pageCount();
+  }
+
+  // the NUMA node the span's pages were first handed out on.  Only
+  // meaningful for a span currently allocated through pageAlloc.
+  inline size_t spanNode(const Span &span) const {
+    return _spanNode[span.offset];
+  }
+
+  // pages handed out by pageAlloc (and not yet freed), free dirty
+  // pages and free muzzy pages, on the given NUMA node
+  inline size_t nodePageCount(size_t node) const {
+    d_assert(node < kMaxNumaNodes);
+    return _nodePageCount[node];
+  }
+
+  inline size_t nodeDirtyPageCount(size_t node) const {
+    return _dirty[node].pageCount();
+  }
+
+  inline size_t nodeMuzzyPageCount(size_t node) const {
+    return _muzzy[node].pageCount();
+  }
+
+  // spans that had to reuse another node's dirty or muzzy pages
+  inline size_t remoteSpanCount() const {
+    return _remoteSpanCount;
+  }
+
+  // moves dirty and muzzy pages that have outstayed their decay period
+  // on to the next stage.  Cheap unless an epoch boundary has passed.
+  void decay(time::time_point now);
+
+  // decay periods for the dirty and muzzy stages; 0 turns decay off.
+  // Take effect immediately.
+  void setDirtyDecayMs(size_t decayMs) {
+    _dirtyDecay.setDecayMs(decayMs, time::now(), _dirty.pageCount());
+    wakeBackgroundThread();
+  }
+
+  size_t dirtyDecayMs() const {
+    return _dirtyDecay.decayMs();
+  }
+
+  void setMuzzyDecayMs(size_t decayMs) {
+    _muzzyDecay.setDecayMs(decayMs, time::now(), _muzzy.pageCount());
+    if (!_muzzyDecay.enabled()) {
+      // nothing will age these out any more
+      cleanMuzzySpans(std::numeric_limits<size_t>::max());
+    }
+    wakeBackgroundThread();
+  }
+
+  size_t muzzyDecayMs() const {
+    return _muzzyDecay.decayMs();
+  }
+
+  // how often the background thread should call decay(), or a zero
+  // duration if decay is off
+  std::chrono::milliseconds decayInterval() const {
+    if (!_dirtyDecay.enabled()) {
+      return kZeroMs;
+    }
+    if (_muzzyDecay.enabled()) {
+      return std::min(_dirtyDecay.epochLength(), _muzzyDecay.epochLength());
+    }
+    return _dirtyDecay.epochLength();
+  }
 
   // return the maximum number of pages we've had meshed (and thus our
   // savings) at any point in time.
@@ -215,19 +382,59 @@ public:
     return reinterpret_cast<char *>(_arenaBegin);
   }
   void *arenaEnd() const {
-    return reinterpret_cast<char *>(_arenaBegin) + kArenaSize;
+    return reinterpret_cast<char *>(_arenaBegin) + _arenaSize;
   }
 
+  // the address space reserved for the arena, fixed at startup
+  size_t arenaSize() const {
+    return _arenaSize;
+  }
+
+  // how much of the arena its file currently backs
+  size_t arenaFileSize() const {
+    return static_cast<size_t>(_fileEnd) << kPageShift;
+  }
+
+  // parses a MESH_ARENA_SIZE value: a byte count, optionally suffixed
+  // with K, M, G or T.  Returns the default arena size for nullptr, and
+  // clamps to [kMinArenaSize, kMaxArenaSize] in whole hugepage chunks.
+  static size_t parseArenaSize(const char *str);
+
   void doAfterForkChild();
 
   void freePhys(void *ptr, size_t sz);
 
 private:
+  // a PMD maps one page of page-table entries worth of pages: 2 MB
+  // with 4K pages and 32 MB with 16K pages
+  static constexpr size_t kHugeChunkPages = PageSize / sizeof(uint64_t);
+  static constexpr size_t kHugeChunkSize = kHugeChunkPages * PageSize;
+
+  inline size_t hugeChunkCount() const {
+    return _arenaSize / kHugeChunkSize;
+  }
+
+  // chunks are aligned in the address space, which the arena itself
+  // need not be
+  inline size_t hugeChunkFor(Offset off) const {
+    d_assert(off >= _hugeChunkBase);
+    return (off - _hugeChunkBase) / kHugeChunkPages;
+  }
+
+  inline Offset hugeChunkOffset(size_t chunk) const {
+    return _hugeChunkBase + chunk * kHugeChunkPages;
+  }
+
   void expandArena(size_t minPagesAdded);
-  bool findPages(size_t pageCount, Span &result, internal::PageType &type);
-  bool ATTRIBUTE_NEVER_INLINE findPagesInner(internal::vector<Span> freeSpans[kSpanClassCount], size_t i,
-                                             size_t pageCount, Span &result);
-  Span reservePages(size_t pageCount, size_t pageAlignment);
+  void growArenaFile();
+  void addHugeChunk();
+  void freeHugeSpan(const Span &span);
+  void adviseHugeChunk(size_t chunk);
+  bool findPages(size_t pageCount, size_t node, Span &result, internal::PageType &type, size_t &spanNode);
+  // reserves pages for a span requested from NUMA node node.  type and
+  // spanNode say what kind of pages the span is made of, and where
+  // they live.
+  Span reservePages(size_t pageCount, size_t pageAlignment, size_t node, internal::PageType &type, size_t &spanNode);
   internal::RelaxedBitmap allocatedBitmap(bool includeDirty = true) const;
 
   void *malloc(size_t sz) = delete;
@@ -236,8 +443,8 @@ private:
     return ptrvalFromOffset(span.offset) % (pageAlignment << kPageShift) == 0;
   }
 
-  static constexpr size_t indexSize() {
-    return sizeof(Offset) * (kArenaSize / PageSize);
+  inline size_t indexSize() const {
+    return sizeof(Offset) * (_arenaSize / PageSize);
   }
 
   inline void clearIndex(const Span &span) {
@@ -247,7 +454,9 @@ private:
     }
   }
 
-  inline void freeSpan(const Span &span, const internal::PageType flags) {
+  // node is where a dirty span's pages live; it is ignored for other
+  // page types
+  inline void freeSpan(const Span &span, const internal::PageType flags, size_t node = 0) {
     if (span.length == 0) {
       return;
     }
@@ -255,7 +464,7 @@ private:
     // this happens when we are trying to get an aligned allocation
     // and returning excess back to the arena
     if (flags == internal::PageType::Clean) {
-      _clean[span.spanClass()].push_back(span);
+      _clean.add(span);
       return;
     }
 
@@ -266,14 +475,23 @@ private:
         madvise(ptrFromOffset(span.offset), span.length << kPageShift, MADV_DONTDUMP);
       }
       d_assert(span.length > 0);
-      _dirty[span.spanClass()].push_back(span);
-      _dirtyPageCount += span.length;
+      _dirty[node].add(span);
+
+      if (_dirtyDecay.enabled()) {
+        _dirtyDecay.record(span.length);
+        // the background thread, if any, decays on a timer instead
+        if (_scavengeHintFd < 0) {
+          decay(time::now());
+        }
+      }
 
       const size_t maxDirtyPageThreshold = (kMaxDirtyPageThreshold * kPageSize4K) / PageSize;
 
-      if (_dirtyPageCount > maxDirtyPageThreshold) {
-        // do a full scavenge with a probability 1/10
-        if (_fastPrng.inRange(0, 9) == 9) {
+      if (_dirty.pageCount() > maxDirtyPageThreshold) {
+        if (_scavengeHintFd >= 0) {
+          postScavengeHint();
+        } else if (_fastPrng.inRange(0, 9) == 9) {
+          // do a full scavenge with a probability 1/10
           scavenge(true);
         } else {
           partialScavenge();
@@ -285,6 +503,57 @@ private:
     }
   }
 
+  inline void postScavengeHint() {
+    // called with the arena lock held
+    if (_scavengeHintPending) {
+      return;
+    }
+    _scavengeHintPending = true;
+
+    const uint64_t hint = 1;
+    auto _ __attribute__((unused)) = write(_scavengeHintFd, &hint, sizeof(hint));
+  }
+
+  // without posting a scavenge hint, so that it picks up new decay
+  // settings
+  inline void wakeBackgroundThread() {
+    if (_scavengeHintFd < 0) {
+      return;
+    }
+    const uint64_t hint = 1;
+    auto _ __attribute__((unused)) = write(_scavengeHintFd, &hint, sizeof(hint));
+  }
+
+  // each returns the number of pages processed
+  size_t resetMeshedSpans(size_t maxPages);
+  size_t cleanDirtySpans(size_t maxPages);
+  size_t cleanMuzzySpans(size_t maxPages);
+
+  // releases span's physical pages and adds it to the clean set
+  inline void purgeSpan(const Span &span) {
+    auto ptr = ptrFromOffset(span.offset);
+    auto sz = span.byteLength();
+    madvise(ptr, sz, MADV_DONTNEED);
+    freePhys(ptr, sz);
+    _clean.add(span);
+  }
+
+  // MADV_FREE only applies to private anonymous memory.  With meshing
+  // on, the arena is a shared mapping of a memfd, so muzzy pages just
+  // lose their page table entries: they stay in the page cache until
+  // purged, and touching one again is a minor fault, not a zero-fill.
+  inline void adviseMuzzy(const Span &span) {
+    auto ptr = ptrFromOffset(span.offset);
+    auto sz = span.byteLength();
+#ifdef MADV_FREE
+    if (!kMeshingEnabled) {
+      madvise(ptr, sz, MADV_FREE);
+      return;
+    }
+#endif
+    madvise(ptr, sz, MADV_DONTNEED);
+  }
+
   int openShmSpanFile(size_t sz);
   int openSpanFile(size_t sz);
   char *openSpanDir(int pid);
@@ -341,6 +610,15 @@ private:
     }
   }
 
+  // registers the pages with our userfaultfd and write-protects them,
+  // returning the syscalls made (or 0 if that failed)
+  size_t uffdProtect(Offset off, size_t pageCount);
+  void uffdWake(Offset off, size_t pageCount);
+
+  // points each remap's remove span at keep's pages in fd.  remaps must
+  // be sorted by remove offset, so that adjacent spans can share a call.
+  size_t remapMeshed(int fd, const MeshRemap *remaps, size_t count);
+
   inline void resetSpanMapping(const Span &span) {
     auto ptr = ptrFromOffset(span.offset);
     auto sz = static_cast<size_t>(span.length) << kPageShift;
@@ -351,35 +629,74 @@ private:
   void afterForkParent();
   void afterForkChild();
 
+  // declared first: the side tables below are sized from it
+  const size_t _arenaSize{parseArenaSize(getenv("MESH_ARENA_SIZE"))};
   void *_arenaBegin{nullptr};
   atomic<MiniHeapID> *_mhIndex{nullptr};
 
 protected:
-  CheapHeap<MiniHeapSizeFor<PageSize>(), kArenaSize / PageSize> _mhAllocator{};
+  DynCheapHeap _mhAllocator{};
   MWC _fastPrng;
 
 private:
   Offset _end{};  // in pages
+  // the arena's file is grown ahead of _end, rather than sized for the
+  // whole reservation up front
+  Offset _fileEnd{};  // in pages
 
   // spans that had been meshed, have been freed, and need to be reset
   // to identity mappings in the page tables.
   internal::vector<Span> _toReset;
 
-  internal::vector<Span> _clean[kSpanClassCount];
-  internal::vector<Span> _dirty[kSpanClassCount];
+  FreeSpanSet _clean{};
+  // dirty pages are resident, so kept apart by NUMA node
+  NodeSpanSets _dirty{};
+
+  // dirty pages that have been advised away but not yet purged
+  NodeSpanSets _muzzy{};
+
+  // the node each allocated span was handed out on, by first page
+  uint8_t *_spanNode{reinterpret_cast<uint8_t *>(OneWayMmapHeap().malloc(_arenaSize / PageSize))};
+  size_t _nodePageCount[kMaxNumaNodes]{};
+  size_t _remoteSpanCount{0};
 
-  size_t _dirtyPageCount{0};
+  Decay _dirtyDecay{};
+  Decay _muzzyDecay{};
+
+  int _scavengeHintFd{-1};
+  bool _scavengeHintPending{false};
 
   internal::RelaxedBitmap _meshedBitmap{
-      kArenaSize / PageSize,
-      reinterpret_cast<char *>(OneWayMmapHeap().malloc(bitmap::representationSize(kArenaSize / PageSize))), false};
+      _arenaSize / PageSize,
+      reinterpret_cast<char *>(OneWayMmapHeap().malloc(bitmap::representationSize(_arenaSize / PageSize))), false};
+  mutex _meshedBitmapLock{};
   size_t _meshedPageCount{0};
   size_t _meshedPageCountHWM{0};
   size_t _rssKbAtHWM{0};
   size_t _maxMeshCount{kDefaultMaxMeshCount};
 
+  bool _hugePages{false};
+  // free spans inside hugepage chunks, kept apart from _clean/_dirty
+  // so they are never scavenged or handed to meshable spans
+  FreeSpanSet _huge{};
+  internal::RelaxedBitmap _hugeChunks{
+      hugeChunkCount(),
+      reinterpret_cast<char *>(OneWayMmapHeap().malloc(bitmap::representationSize(hugeChunkCount()))), false};
+  // pages in use in each hugepage chunk
+  uint16_t *_hugeChunkInUse{
+      reinterpret_cast<uint16_t *>(OneWayMmapHeap().malloc(hugeChunkCount() * sizeof(uint16_t)))};
+  Offset _hugeChunkBase{0};
+  size_t _hugeChunkCount{0};
+  size_t _hugeSpanPageCount{0};
+  size_t _spanPageCount{0};
+
   int _fd;
+  int _uffd{-1};
   int _forkPipe[2]{-1, -1};  // used for signaling during fork
+  time::time_point _forkStart{};
+  size_t _forkCount{0};
+  size_t _forkTotalUs{0};
+  size_t _forkMaxUs{0};
   char *_spanDir{nullptr};
 };
 
@@ -392,7 +709,8 @@ MeshableArena<PageSize>::MeshableArena() : SuperHeap(), _fastPrng(internal::seed
 
   int fd = -1;
   if (kMeshingEnabled) {
-    fd = openSpanFile(kArenaSize);
+    // starts empty, and grows with the arena
+    fd = openSpanFile(0);
     if (fd < 0) {
       debug("mesh: opening arena file failed.\n");
       abort();
@@ -404,18 +722,27 @@ MeshableArena<PageSize>::MeshableArena() : SuperHeap(), _fastPrng(internal::seed
   if (kMeshingEnabled) {
     debug("mesh: using file-backed memory for arena (macOS) - enables F_PUNCHHOLE\n");
   }
-  _arenaBegin = SuperHeap::map(kArenaSize, kMapShared, fd);
+  _arenaBegin = SuperHeap::map(_arenaSize, kMapShared, fd);
 #else
-  _arenaBegin = SuperHeap::map(kArenaSize, kMapShared, fd);
+  _arenaBegin = SuperHeap::map(_arenaSize, kMapShared, fd);
 #endif
 
   _mhIndex = reinterpret_cast<atomic<MiniHeapID> *>(SuperHeap::malloc(indexSize()));
 
+  // at most one miniheap per page
+  const size_t maxMiniheaps = _arenaSize / PageSize;
+  constexpr size_t miniheapSize = MiniHeapSizeFor<PageSize>();
+  _mhAllocator.init(miniheapSize, maxMiniheaps, reinterpret_cast<char *>(SuperHeap::malloc(miniheapSize * maxMiniheaps)),
+                    reinterpret_cast<void **>(SuperHeap::malloc(maxMiniheaps * sizeof(void *))));
+
   hard_assert(_arenaBegin != nullptr);
   hard_assert(_mhIndex != nullptr);
 
+  const uintptr_t arenaVal = reinterpret_cast<uintptr_t>(_arenaBegin);
+  _hugeChunkBase = (((arenaVal + kHugeChunkSize - 1) & ~(kHugeChunkSize - 1)) - arenaVal) >> kPageShift;
+
   if (kAdviseDump) {
-    madvise(_arenaBegin, kArenaSize, MADV_DONTDUMP);
+    madvise(_arenaBegin, _arenaSize, MADV_DONTDUMP);
   }
 
   debug("MeshableArena(%p): fd:%4d\t%p-%p\n", this, _fd, _arenaBegin, arenaEnd());
@@ -468,90 +795,128 @@ void MeshableArena<PageSize>::expandArena(size_t minPagesAdded) {
   Span expansion(_end, pageCount);
   _end += pageCount;
 
-  const size_t maxPages = kArenaSize >> kPageShift;
+  const size_t maxPages = _arenaSize >> kPageShift;
   if (unlikely(_end >= maxPages)) {
-    debug("Mesh: arena exhausted: current arena size is %.1f GB; recompile with larger arena size.",
-          kArenaSize / 1024.0 / 1024.0 / 1024.0);
+    debug("Mesh: arena exhausted: current arena size is %.1f GB; set MESH_ARENA_SIZE to raise it.",
+          _arenaSize / 1024.0 / 1024.0 / 1024.0);
     abort();
   }
 
-  _clean[expansion.spanClass()].push_back(expansion);
+  growArenaFile();
+
+  // merges with a clean span at the old end of the arena, if any
+  _clean.add(expansion);
 }
 
 template <size_t PageSize>
-bool MeshableArena<PageSize>::findPagesInner(internal::vector<Span> freeSpans[kSpanClassCount], const size_t i,
-                                             const size_t pageCount, Span &result) {
-  internal::vector<Span> &spanList = freeSpans[i];
-  if (spanList.empty())
-    return false;
+void MeshableArena<PageSize>::growArenaFile() {
+  if (_end <= _fileEnd) {
+    return;
+  }
 
-  size_t oldLen = spanList.size();
+  // double the file each time, so growing it is amortized, but never
+  // past the end of the reservation
+  const size_t maxPages = _arenaSize >> kPageShift;
+  const size_t fileEnd = std::min(std::max(static_cast<size_t>(_end), 2 * static_cast<size_t>(_fileEnd)), maxPages);
 
-  if (i == kSpanClassCount - 1 && spanList.back().length < pageCount) {
-    for (size_t j = 0; j < spanList.size() - 1; j++) {
-      if (spanList[j].length >= pageCount) {
-        std::swap(spanList[j], spanList.back());
-        break;
-      }
-    }
-
-    if (spanList.back().length < pageCount) {
-      return false;
+  if (_fd >= 0) {
+    int err = ftruncate(_fd, static_cast<off_t>(fileEnd) << kPageShift);
+    if (err != 0) {
+      debug("Mesh: growing arena file to %zu bytes failed: %d\n", fileEnd << kPageShift, errno);
+      abort();
     }
   }
 
-  Span span = spanList.back();
-  spanList.pop_back();
+  _fileEnd = fileEnd;
+}
 
-#ifndef NDEBUG
-  d_assert_msg(oldLen == spanList.size() + 1, "pageCount:%zu,%zu -- %zu/%zu", pageCount, i, oldLen, spanList.size());
-  for (size_t j = 0; j < spanList.size(); j++) {
-    d_assert(spanList[j] != span);
+template <size_t PageSize>
+size_t MeshableArena<PageSize>::parseArenaSize(const char *str) {
+  size_t sz = kArenaSize;
+  if (str != nullptr) {
+    char *end = nullptr;
+    const size_t parsed = strtoull(str, &end, 10);
+    if (end != str) {
+      size_t shift = 0;
+      switch (*end) {
+      case 'k':
+      case 'K':
+        shift = 10;
+        break;
+      case 'm':
+      case 'M':
+        shift = 20;
+        break;
+      case 'g':
+      case 'G':
+        shift = 30;
+        break;
+      case 't':
+      case 'T':
+        shift = 40;
+        break;
+      default:
+        break;
+      }
+      sz = parsed > (kMaxArenaSize >> shift) ? kMaxArenaSize : parsed << shift;
+    }
   }
-#endif
 
-  d_assert(span.length >= i + 1);
-  d_assert(span.length >= pageCount);
+  sz = std::min(std::max(sz, kMinArenaSize), kMaxArenaSize);
+  return (sz + kHugeChunkSize - 1) & ~(kHugeChunkSize - 1);
+}
 
-  Span rest = span.splitAfter(pageCount);
-  if (!rest.empty()) {
-    freeSpans[rest.spanClass()].push_back(rest);
+template <size_t PageSize>
+bool MeshableArena<PageSize>::findPages(const size_t pageCount, const size_t node, Span &result,
+                                        internal::PageType &type, size_t &spanNode) {
+  // prefer reusing our node's dirty pages over faulting in clean ones
+  spanNode = node;
+  if (_dirty[node].take(pageCount, result)) {
+    type = internal::PageType::Dirty;
+    return true;
   }
-  d_assert(span.length == pageCount);
 
-  result = span;
-  return true;
-}
+  // muzzy pages may still be resident, and are no more zeroed than
+  // dirty ones
+  if (_muzzy[node].take(pageCount, result)) {
+    type = internal::PageType::Dirty;
+    return true;
+  }
 
-template <size_t PageSize>
-bool MeshableArena<PageSize>::findPages(const size_t pageCount, Span &result, internal::PageType &type) {
-  for (size_t i = Span(0, pageCount).spanClass(); i < kSpanClassCount; i++) {
-    if (findPagesInner(_dirty, i, pageCount, result)) {
-      type = internal::PageType::Dirty;
-      return true;
-    }
+  // clean pages are faulted in by the caller, so are local too
+  if (_clean.take(pageCount, result)) {
+    type = internal::PageType::Clean;
+    return true;
   }
 
-  for (size_t i = Span(0, pageCount).spanClass(); i < kSpanClassCount; i++) {
-    if (findPagesInner(_clean, i, pageCount, result)) {
-      type = internal::PageType::Clean;
+  // another node's pages beat growing the arena
+  type = internal::PageType::Dirty;
+  for (size_t i = 0; i < kMaxNumaNodes; i++) {
+    if (i == node) {
+      continue;
+    }
+    if (_dirty[i].take(pageCount, result) || _muzzy[i].take(pageCount, result)) {
+      spanNode = i;
+      _remoteSpanCount++;
       return true;
     }
   }
 
+  type = internal::PageType::Unknown;
   return false;
 }
 
 template <size_t PageSize>
-Span MeshableArena<PageSize>::reservePages(const size_t pageCount, const size_t pageAlignment) {
+Span MeshableArena<PageSize>::reservePages(const size_t pageCount, const size_t pageAlignment, const size_t node,
+                                           internal::PageType &flags, size_t &spanNode) {
   d_assert(pageCount >= 1);
 
-  internal::PageType flags(internal::PageType::Unknown);
+  flags = internal::PageType::Unknown;
   Span result(0, 0);
-  auto ok = findPages(pageCount, result, flags);
+  auto ok = findPages(pageCount, node, result, flags, spanNode);
   if (!ok) {
     expandArena(pageCount);
-    ok = findPages(pageCount, result, flags);
+    ok = findPages(pageCount, node, result, flags, spanNode);
     hard_assert(ok);
   }
 
@@ -559,8 +924,8 @@ Span MeshableArena<PageSize>::reservePages(const size_t pageCount, const size_t
   d_assert(flags != internal::PageType::Unknown);
 
   if (unlikely(pageAlignment > 1 && ((ptrvalFromOffset(result.offset) >> kPageShift) % pageAlignment != 0))) {
-    freeSpan(result, flags);
-    result = reservePages(pageCount + 2 * pageAlignment, 1);
+    freeSpan(result, flags, spanNode);
+    result = reservePages(pageCount + 2 * pageAlignment, 1, node, flags, spanNode);
 
     const size_t alignment = pageAlignment << kPageShift;
     const uintptr_t alignedPtr = (ptrvalFromOffset(result.offset) + alignment - 1) & ~(alignment - 1);
@@ -570,9 +935,9 @@ Span MeshableArena<PageSize>::reservePages(const size_t pageCount, const size_t
     const auto unwantedPageCount = alignedOff - result.offset;
     auto alignedResult = result.splitAfter(unwantedPageCount);
     d_assert(alignedResult.offset == alignedOff);
-    freeSpan(result, flags);
+    freeSpan(result, flags, spanNode);
     const auto excess = alignedResult.splitAfter(pageCount);
-    freeSpan(excess, flags);
+    freeSpan(excess, flags, spanNode);
     result = alignedResult;
   }
 
@@ -596,9 +961,11 @@ internal::RelaxedBitmap MeshableArena<PageSize>::allocatedBitmap(bool includeDir
     }
   };
 
-  if (includeDirty)
-    forEachFree(_dirty, unmarkPages);
-  forEachFree(_clean, unmarkPages);
+  if (includeDirty) {
+    _dirty.forEach(unmarkPages);
+    _muzzy.forEach(unmarkPages);
+  }
+  _clean.forEach(unmarkPages);
 
   return bitmap;
 }
@@ -614,7 +981,9 @@ char *MeshableArena<PageSize>::pageAlloc(Span &result, size_t pageCount, size_t
   d_assert(pageCount >= 1);
   d_assert(pageCount < std::numeric_limits<Length>::max());
 
-  auto span = reservePages(pageCount, pageAlignment);
+  internal::PageType type(internal::PageType::Unknown);
+  size_t node = 0;
+  auto span = reservePages(pageCount, pageAlignment, internal::currentNumaNode(), type, node);
   d_assert(isAligned(span, pageAlignment));
 
   d_assert(contains(ptrFromOffset(span.offset)));
@@ -632,125 +1001,263 @@ char *MeshableArena<PageSize>::pageAlloc(Span &result, size_t pageCount, size_t
     madvise(ptr, pageCount << kPageShift, MADV_DODUMP);
   }
 
+  _spanPageCount += pageCount;
+  _spanNode[span.offset] = node;
+  _nodePageCount[node] += pageCount;
+
   result = span;
   return ptr;
 }
 
 template <size_t PageSize>
-void MeshableArena<PageSize>::free(void *ptr, size_t sz, internal::PageType type) {
-  if (unlikely(!contains(ptr))) {
-    debug("invalid free of %p/%zu", ptr, sz);
-    return;
+char *MeshableArena<PageSize>::hugePageAlloc(Span &result, size_t pageCount) {
+  d_assert(pageCount >= 1);
+  hard_assert(pageCount <= kHugeChunkPages);
+
+  Span span(0, 0);
+  if (!_huge.take(pageCount, span)) {
+    addHugeChunk();
+    const bool ok = _huge.take(pageCount, span);
+    hard_assert(ok);
   }
-  d_assert(sz > 0);
 
-  d_assert((sz >> kPageShift) > 0);
-  d_assert((sz & (PageSize - 1)) == 0);
+  d_assert(isHugeOffset(span.offset));
+  _hugeChunkInUse[hugeChunkFor(span.offset)] += pageCount;
+  _hugeSpanPageCount += pageCount;
+  _spanPageCount += pageCount;
 
-  const Span span(offsetFor(ptr), sz >> kPageShift);
-  freeSpan(span, type);
+  char *ptr = reinterpret_cast<char *>(ptrFromOffset(span.offset));
+
+  if (kAdviseDump) {
+    madvise(ptr, pageCount << kPageShift, MADV_DODUMP);
+  }
+
+  result = span;
+  return ptr;
 }
 
 template <size_t PageSize>
-void MeshableArena<PageSize>::partialScavenge() {
-  forEachFree(_dirty, [&](const Span &span) {
-    auto ptr = ptrFromOffset(span.offset);
-    auto sz = span.byteLength();
-    madvise(ptr, sz, MADV_DONTNEED);
-    freePhys(ptr, sz);
-    _clean[span.spanClass()].push_back(span);
-  });
+void MeshableArena<PageSize>::addHugeChunk() {
+  internal::PageType type(internal::PageType::Unknown);
+  size_t node = 0;
+  const Span chunk = reservePages(kHugeChunkPages, kHugeChunkPages, internal::currentNumaNode(), type, node);
+  d_assert(chunk.length == kHugeChunkPages);
+  // the chunk's spans don't record their own node, but the chunk does
+  _spanNode[chunk.offset] = node;
+
+  const size_t chunkIdx = hugeChunkFor(chunk.offset);
+  d_assert(hugeChunkOffset(chunkIdx) == chunk.offset);
+  _hugeChunks.tryToSet(chunkIdx);
+  _hugeChunkInUse[chunkIdx] = 0;
+  _hugeChunkCount++;
+  adviseHugeChunk(chunkIdx);
+
+  _huge.add(chunk, chunk.offset, chunk.offset + kHugeChunkPages);
+}
 
-  for (size_t i = 0; i < kSpanClassCount; i++) {
-    _dirty[i] = internal::vector<Span>{};
+template <size_t PageSize>
+void MeshableArena<PageSize>::adviseHugeChunk(size_t chunk) {
+#ifdef MADV_HUGEPAGE
+  // the arena is a shared memfd mapping, so this takes effect when
+  // shmem THP is in 'advise' (or 'always') mode
+  madvise(ptrFromOffset(hugeChunkOffset(chunk)), kHugeChunkSize, MADV_HUGEPAGE);
+#endif
+}
+
+template <size_t PageSize>
+void MeshableArena<PageSize>::freeHugeSpan(const Span &span) {
+  clearIndex(span);
+
+  const size_t chunkIdx = hugeChunkFor(span.offset);
+  d_assert(_hugeChunkInUse[chunkIdx] >= span.length);
+  _hugeChunkInUse[chunkIdx] -= span.length;
+  _hugeSpanPageCount -= span.length;
+
+  // free spans only coalesce within their own chunk
+  const Offset chunkBegin = hugeChunkOffset(chunkIdx);
+  const Offset chunkEnd = chunkBegin + kHugeChunkPages;
+  if (_hugeChunkInUse[chunkIdx] > 0) {
+    _huge.add(span, chunkBegin, chunkEnd);
+    return;
   }
 
-  _dirtyPageCount = 0;
+  // the whole chunk is free: drop it from the huge freelist and hand it
+  // back to the meshable region as one dirty span
+  _huge.removeRange(chunkBegin, chunkEnd);
+
+  _hugeChunks.unset(chunkIdx);
+  _hugeChunkCount--;
+
+  freeSpan(Span(chunkBegin, kHugeChunkPages), internal::PageType::Dirty, _spanNode[chunkBegin]);
 }
 
 template <size_t PageSize>
-void MeshableArena<PageSize>::scavenge(bool force) {
-  const size_t minDirtyPageThreshold = (kMinDirtyPageThreshold * kPageSize4K) / PageSize;
-
-  if (!force && _dirtyPageCount < minDirtyPageThreshold) {
+void MeshableArena<PageSize>::free(void *ptr, size_t sz, internal::PageType type) {
+  if (unlikely(!contains(ptr))) {
+    debug("invalid free of %p/%zu", ptr, sz);
     return;
   }
+  d_assert(sz > 0);
 
-  auto bitmap = allocatedBitmap(false);
-  bitmap.invert();
+  d_assert((sz >> kPageShift) > 0);
+  d_assert((sz & (PageSize - 1)) == 0);
 
-  auto markPages = [&](const Span &span) {
-    for (size_t k = 0; k < span.length; k++) {
-#ifndef NDEBUG
-      if (bitmap.isSet(span.offset + k)) {
-        debug("arena: bit %zu already set (%zu/%zu) %zu\n", k, span.offset, span.length, bitmap.bitCount());
-      }
-#endif
-      bitmap.tryToSet(span.offset + k);
-    }
-  };
+  const Span span(offsetFor(ptr), sz >> kPageShift);
+  _spanPageCount -= span.length;
+  if (unlikely(isHugeOffset(span.offset))) {
+    d_assert(type != internal::PageType::Meshed);
+    freeHugeSpan(span);
+    return;
+  }
+  const size_t node = _spanNode[span.offset];
+  d_assert(_nodePageCount[node] >= span.length);
+  _nodePageCount[node] -= span.length;
+  freeSpan(span, type, node);
+}
+
+template <size_t PageSize>
+size_t MeshableArena<PageSize>::resetMeshedSpans(const size_t maxPages) {
+  size_t pageCount = 0;
+  while (!_toReset.empty() && pageCount < maxPages) {
+    const Span span = _toReset.back();
+    _toReset.pop_back();
 
-  std::for_each(_toReset.begin(), _toReset.end(), [&](Span span) {
     untrackMeshed(span);
-    markPages(span);
     resetSpanMapping(span);
-  });
+    // coalesces with its free neighbours
+    _clean.add(span);
+    pageCount += span.length;
+  }
 
-  _toReset = internal::vector<Span>{};
+  if (_toReset.empty()) {
+    _toReset = internal::vector<Span>{};
+  }
 
   _meshedPageCount = _meshedBitmap.inUseCount();
   if (_meshedPageCount > _meshedPageCountHWM) {
     _meshedPageCountHWM = _meshedPageCount;
   }
 
-  forEachFree(_dirty, [&](const Span &span) {
-    auto ptr = ptrFromOffset(span.offset);
-    auto sz = span.byteLength();
-    madvise(ptr, sz, MADV_DONTNEED);
-    freePhys(ptr, sz);
-    markPages(span);
-  });
+  return pageCount;
+}
 
-  for (size_t i = 0; i < kSpanClassCount; i++) {
-    _dirty[i] = internal::vector<Span>{};
+template <size_t PageSize>
+size_t MeshableArena<PageSize>::cleanDirtySpans(const size_t maxPages) {
+  size_t pageCount = 0;
+  Span span(0, 0);
+  size_t node = 0;
+  while (pageCount < maxPages && _dirty.pop(span, node)) {
+    // coalesced spans can be far larger than a slice
+    Span rest = span.splitAfter(std::min(maxPages - pageCount, static_cast<size_t>(span.length)));
+    if (!rest.empty()) {
+      _dirty[node].add(rest);
+    }
+    purgeSpan(span);
+    pageCount += span.length;
   }
 
-  _dirtyPageCount = 0;
+  return pageCount + cleanMuzzySpans(maxPages > pageCount ? maxPages - pageCount : 0);
+}
 
-  for (size_t i = 0; i < kSpanClassCount; i++) {
-    _clean[i] = internal::vector<Span>{};
+template <size_t PageSize>
+size_t MeshableArena<PageSize>::cleanMuzzySpans(const size_t maxPages) {
+  size_t pageCount = 0;
+  Span span(0, 0);
+  size_t node = 0;
+  while (pageCount < maxPages && _muzzy.pop(span, node)) {
+    Span rest = span.splitAfter(std::min(maxPages - pageCount, static_cast<size_t>(span.length)));
+    if (!rest.empty()) {
+      _muzzy[node].add(rest);
+    }
+    purgeSpan(span);
+    pageCount += span.length;
   }
 
-  Span current(0, 0);
-  for (auto const &i : bitmap) {
-    if (i == current.offset + current.length) {
-      current.length++;
-      continue;
+  return pageCount;
+}
+
+template <size_t PageSize>
+void MeshableArena<PageSize>::decay(const time::time_point now) {
+  Span span(0, 0);
+  size_t node = 0;
+
+  size_t excess = _dirtyDecay.update(now, _dirty.pageCount());
+  while (excess > 0 && _dirty.pop(span, node)) {
+    Span rest = span.splitAfter(std::min(excess, static_cast<size_t>(span.length)));
+    if (!rest.empty()) {
+      _dirty[node].add(rest);
+    }
+    excess -= span.length;
+
+    if (_muzzyDecay.enabled()) {
+      adviseMuzzy(span);
+      _muzzy[node].add(span);
+      _muzzyDecay.record(span.length);
+    } else {
+      purgeSpan(span);
     }
+  }
 
-    if (!current.empty()) {
-      _clean[current.spanClass()].push_back(current);
+  excess = _muzzyDecay.update(now, _muzzy.pageCount());
+  while (excess > 0 && _muzzy.pop(span, node)) {
+    Span rest = span.splitAfter(std::min(excess, static_cast<size_t>(span.length)));
+    if (!rest.empty()) {
+      _muzzy[node].add(rest);
     }
+    excess -= span.length;
 
-    current = Span(i, 1);
+    purgeSpan(span);
   }
+}
 
-  if (!current.empty()) {
-    _clean[current.spanClass()].push_back(current);
+template <size_t PageSize>
+void MeshableArena<PageSize>::partialScavenge() {
+  cleanDirtySpans(std::numeric_limits<size_t>::max());
+}
+
+template <size_t PageSize>
+bool MeshableArena<PageSize>::scavengeSlice(const size_t maxPages) {
+  const size_t resetCount = resetMeshedSpans(maxPages);
+  if (resetCount < maxPages) {
+    cleanDirtySpans(maxPages - resetCount);
   }
-#ifndef NDEBUG
-  auto newBitmap = allocatedBitmap();
-  newBitmap.invert();
 
-  const size_t *bits1 = bitmap.bits();
-  const size_t *bits2 = newBitmap.bits();
-  for (size_t i = 0; i < bitmap.byteCount() / sizeof(size_t); i++) {
-    if (bits1[i] != bits2[i]) {
-      debug("bitmaps don't match %zu:\n", i);
-      hard_assert(false);
-    }
+  const bool moreWork = !_toReset.empty() || !_dirty.empty() || !_muzzy.empty();
+  if (!moreWork) {
+    _scavengeHintPending = false;
   }
-#endif
+  return moreWork;
+}
+
+template <size_t PageSize>
+void MeshableArena<PageSize>::meshScavenge() {
+  const bool decaying = _dirtyDecay.enabled();
+  if (_scavengeHintFd < 0 && !decaying) {
+    scavenge(true);
+    return;
+  }
+
+  resetMeshedSpans(std::numeric_limits<size_t>::max());
+  if (decaying) {
+    // dirty pages are purged as they age out instead
+    decay(time::now());
+  } else if (_dirty.pageCount() > 0) {
+    postScavengeHint();
+  }
+}
+
+template <size_t PageSize>
+void MeshableArena<PageSize>::scavenge(bool force) {
+  const size_t minDirtyPageThreshold = (kMinDirtyPageThreshold * kPageSize4K) / PageSize;
+
+  if (!force && _dirty.pageCount() < minDirtyPageThreshold) {
+    return;
+  }
+
+  // only touches freed meshed spans and dirty spans, which become
+  // clean, so the cost tracks the work to do rather than arena size
+  resetMeshedSpans(std::numeric_limits<size_t>::max());
+  cleanDirtySpans(std::numeric_limits<size_t>::max());
 }
 
 template <size_t PageSize>
@@ -797,35 +1304,102 @@ void MeshableArena<PageSize>::freePhys(void *ptr, size_t sz) {
 }
 
 template <size_t PageSize>
-void MeshableArena<PageSize>::beginMesh(void *keep, void *remove, size_t sz) {
-  int r = mprotect(remove, sz, PROT_READ);
-  hard_assert(r == 0);
+size_t MeshableArena<PageSize>::beginMeshBatch(MeshRemap *remaps, size_t count) {
+  std::sort(remaps, remaps + count,
+            [](const MeshRemap &a, const MeshRemap &b) { return a.remove < b.remove; });
+
+  size_t syscalls = 0;
+  for (size_t i = 0; i < count;) {
+    const Offset start = remaps[i].remove;
+    Offset end = start + remaps[i].length;
+    for (i++; i < count && remaps[i].remove == end; i++) {
+      end += remaps[i].length;
+    }
+
+    if (_uffd != -1) {
+      const size_t n = uffdProtect(start, end - start);
+      if (n > 0) {
+        syscalls += n;
+        continue;
+      }
+      // fall back to mprotect for anything userfaultfd won't take
+    }
+
+    int r = mprotect(ptrFromOffset(start), static_cast<size_t>(end - start) << kPageShift, PROT_READ);
+    hard_assert(r == 0);
+    syscalls++;
+  }
+
+  return syscalls;
 }
 
 template <size_t PageSize>
-void MeshableArena<PageSize>::finalizeMesh(void *keep, void *remove, size_t sz) {
-  const auto keepOff = offsetFor(keep);
-  const auto removeOff = offsetFor(remove);
+size_t MeshableArena<PageSize>::finalizeMeshBatch(MeshRemap *remaps, size_t count) {
+  // remaps are still sorted by beginMeshBatch
+  {
+    // size classes may be meshed in parallel, and spans from
+    // different size classes can share a word of the bitmap.
+    lock_guard<mutex> lock(_meshedBitmapLock);
+    for (size_t i = 0; i < count; i++) {
+      const auto &remap = remaps[i];
+      const MiniHeapID keepID = _mhIndex[remap.keep].load(std::memory_order_acquire);
+      for (size_t j = 0; j < remap.length; j++) {
+        setIndex(remap.remove + j, keepID);
+      }
+      trackMeshed(Span{remap.remove, remap.length});
+    }
+  }
 
-  const size_t pageCount = sz >> kPageShift;
+  size_t syscalls = remapMeshed(_fd, remaps, count);
 
-  const MiniHeapID keepID = _mhIndex[keepOff].load(std::memory_order_acquire);
-  for (size_t i = 0; i < pageCount; i++) {
-    setIndex(removeOff + i, keepID);
+  if (_uffd != -1 && count > 0) {
+    // any writers blocked on the old mappings retry against the new
+    // ones.  A wake covers every waiter in its range, so one is enough.
+    const auto &last = remaps[count - 1];
+    uffdWake(remaps[0].remove, last.remove + last.length - remaps[0].remove);
+    syscalls++;
   }
 
-  hard_assert(pageCount < std::numeric_limits<Length>::max());
-  const Span removedSpan{removeOff, static_cast<Length>(pageCount)};
-  trackMeshed(removedSpan);
+  for (size_t i = 0; i < count;) {
+    if (!remaps[i].release) {
+      i++;
+      continue;
+    }
+    const Offset start = remaps[i].remove;
+    Offset end = start + remaps[i].length;
+    for (i++; i < count && remaps[i].release && remaps[i].remove == end; i++) {
+      end += remaps[i].length;
+    }
 
-#ifdef __APPLE__
-  hard_assert(_fd >= 0);
-  void *ptr = mmap(remove, sz, HL_MMAP_PROTECTION_MASK, kMapShared | MAP_FIXED, _fd, keepOff << kPageShift);
-  hard_assert_msg(ptr != MAP_FAILED, "mesh remap failed: %d", errno);
-#else
-  void *ptr = mmap(remove, sz, HL_MMAP_PROTECTION_MASK, kMapShared | MAP_FIXED, _fd, keepOff << kPageShift);
-  hard_assert_msg(ptr != MAP_FAILED, "mesh remap failed: %d", errno);
-#endif
+    freePhys(ptrFromOffset(start), static_cast<size_t>(end - start) << kPageShift);
+    syscalls++;
+  }
+
+  return syscalls;
+}
+
+template <size_t PageSize>
+size_t MeshableArena<PageSize>::remapMeshed(int fd, const MeshRemap *remaps, size_t count) {
+  size_t syscalls = 0;
+
+  // a run of spans can be remapped at once if the spans they are being
+  // meshed with are laid out the same way
+  for (size_t i = 0; i < count;) {
+    const Offset keep = remaps[i].keep;
+    const Offset remove = remaps[i].remove;
+    Length length = remaps[i].length;
+    for (i++; i < count && remaps[i].remove == remove + length && remaps[i].keep == keep + length; i++) {
+      length += remaps[i].length;
+    }
+
+    const size_t sz = static_cast<size_t>(length) << kPageShift;
+    void *ptr = mmap(ptrFromOffset(remove), sz, HL_MMAP_PROTECTION_MASK, kMapShared | MAP_FIXED, fd,
+                     static_cast<off_t>(keep) << kPageShift);
+    hard_assert_msg(ptr != MAP_FAILED, "mesh remap failed: %d", errno);
+    syscalls++;
+  }
+
+  return syscalls;
 }
 
 template <size_t PageSize>
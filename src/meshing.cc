@@ -0,0 +1,200 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#include "meshing.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "ifunc_resolver.h"
+
+namespace mesh {
+
+// Each kernel below loads the left bitmap once and keeps it in
+// registers while streaming through the right-hand bitmaps.  Miniheap
+// bitmaps are PageSize / kMinObjectSize bits: 32 bytes for 4K pages
+// and 128 bytes for 16K pages, so only a few fixed lengths matter;
+// anything else falls back to the scalar loop.
+//
+// As with bitmapsMeshable, we may race with frees clearing bits, which
+// at worst gives a false negative.
+
+namespace {
+
+uint64_t meshableBatchScalar(const uint64_t *__restrict__ left, const uint64_t *const *__restrict__ rights,
+                             size_t count, size_t byteLen) noexcept {
+  const size_t wordCount = byteLen / sizeof(uint64_t);
+
+  uint64_t result = 0;
+  for (size_t i = 0; i < count; i++) {
+    const uint64_t *right = rights[i];
+    uint64_t overlap = 0;
+    for (size_t w = 0; w < wordCount; w++) {
+      overlap |= left[w] & right[w];
+    }
+    result |= static_cast<uint64_t>(overlap == 0) << i;
+  }
+
+  return result;
+}
+
+#if defined(__x86_64__)
+
+template <size_t VecCount>
+__attribute__((target("avx2"))) uint64_t meshableBatchAvx2Fixed(const uint64_t *__restrict__ left,
+                                                                 const uint64_t *const *__restrict__ rights,
+                                                                 size_t count) noexcept {
+  __m256i l[VecCount];
+  for (size_t v = 0; v < VecCount; v++) {
+    l[v] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(left) + v);
+  }
+
+  uint64_t result = 0;
+  for (size_t i = 0; i < count; i++) {
+    const auto right = reinterpret_cast<const __m256i *>(rights[i]);
+    __m256i overlap = _mm256_and_si256(l[0], _mm256_loadu_si256(right));
+    for (size_t v = 1; v < VecCount; v++) {
+      overlap = _mm256_or_si256(overlap, _mm256_and_si256(l[v], _mm256_loadu_si256(right + v)));
+    }
+    result |= static_cast<uint64_t>(_mm256_testz_si256(overlap, overlap)) << i;
+  }
+
+  return result;
+}
+
+__attribute__((target("avx2"))) uint64_t meshableBatchAvx2(const uint64_t *__restrict__ left,
+                                                           const uint64_t *const *__restrict__ rights, size_t count,
+                                                           size_t byteLen) noexcept {
+  switch (byteLen) {
+  case 32:
+    return meshableBatchAvx2Fixed<1>(left, rights, count);
+  case 64:
+    return meshableBatchAvx2Fixed<2>(left, rights, count);
+  case 128:
+    return meshableBatchAvx2Fixed<4>(left, rights, count);
+  default:
+    return meshableBatchScalar(left, rights, count, byteLen);
+  }
+}
+
+template <size_t VecCount>
+__attribute__((target("avx512f"))) uint64_t meshableBatchAvx512Fixed(const uint64_t *__restrict__ left,
+                                                                     const uint64_t *const *__restrict__ rights,
+                                                                     size_t count) noexcept {
+  __m512i l[VecCount];
+  for (size_t v = 0; v < VecCount; v++) {
+    l[v] = _mm512_loadu_si512(reinterpret_cast<const __m512i *>(left) + v);
+  }
+
+  uint64_t result = 0;
+  for (size_t i = 0; i < count; i++) {
+    const auto right = reinterpret_cast<const __m512i *>(rights[i]);
+    __m512i overlap = _mm512_and_si512(l[0], _mm512_loadu_si512(right));
+    for (size_t v = 1; v < VecCount; v++) {
+      overlap = _mm512_or_si512(overlap, _mm512_and_si512(l[v], _mm512_loadu_si512(right + v)));
+    }
+    result |= static_cast<uint64_t>(_mm512_test_epi64_mask(overlap, overlap) == 0) << i;
+  }
+
+  return result;
+}
+
+__attribute__((target("avx512f"))) uint64_t meshableBatchAvx512(const uint64_t *__restrict__ left,
+                                                                 const uint64_t *const *__restrict__ rights,
+                                                                 size_t count, size_t byteLen) noexcept {
+  switch (byteLen) {
+  case 32:
+    // 4K page bitmaps only fill half a ZMM register, and packing two
+    // right-hand bitmaps into one measured slower than plain AVX2
+    return meshableBatchAvx2Fixed<1>(left, rights, count);
+  case 64:
+    return meshableBatchAvx512Fixed<1>(left, rights, count);
+  case 128:
+    return meshableBatchAvx512Fixed<2>(left, rights, count);
+  default:
+    return meshableBatchScalar(left, rights, count, byteLen);
+  }
+}
+
+#elif defined(__aarch64__)
+
+template <size_t VecCount>
+uint64_t meshableBatchNeonFixed(const uint64_t *__restrict__ left, const uint64_t *const *__restrict__ rights,
+                                size_t count) noexcept {
+  uint64x2_t l[VecCount];
+  for (size_t v = 0; v < VecCount; v++) {
+    l[v] = vld1q_u64(left + 2 * v);
+  }
+
+  uint64_t result = 0;
+  for (size_t i = 0; i < count; i++) {
+    const uint64_t *right = rights[i];
+    uint64x2_t overlap = vandq_u64(l[0], vld1q_u64(right));
+    for (size_t v = 1; v < VecCount; v++) {
+      overlap = vorrq_u64(overlap, vandq_u64(l[v], vld1q_u64(right + 2 * v)));
+    }
+    const uint64_t any = vgetq_lane_u64(overlap, 0) | vgetq_lane_u64(overlap, 1);
+    result |= static_cast<uint64_t>(any == 0) << i;
+  }
+
+  return result;
+}
+
+uint64_t meshableBatchNeon(const uint64_t *__restrict__ left, const uint64_t *const *__restrict__ rights,
+                           size_t count, size_t byteLen) noexcept {
+  switch (byteLen) {
+  case 32:
+    return meshableBatchNeonFixed<2>(left, rights, count);
+  case 64:
+    return meshableBatchNeonFixed<4>(left, rights, count);
+  case 128:
+    return meshableBatchNeonFixed<8>(left, rights, count);
+  default:
+    return meshableBatchScalar(left, rights, count, byteLen);
+  }
+}
+
+#endif
+}  // namespace
+
+#if defined(__linux__) && defined(__x86_64__)
+// AVX-512 isn't part of our baseline (-march=westmere -mavx2), so
+// choose between kernels when the library is loaded.
+extern "C" {
+typedef uint64_t (*meshable_batch_func)(const uint64_t *, const uint64_t *const *, size_t, size_t);
+
+__attribute__((no_stack_protector)) static meshable_batch_func resolve_bitmaps_meshable_batch() {
+  if (mesh::ifunc::cpuHasAvx512F()) {
+    return meshableBatchAvx512;
+  } else if (mesh::ifunc::cpuHasAvx2()) {
+    return meshableBatchAvx2;
+  }
+  return meshableBatchScalar;
+}
+}
+
+uint64_t bitmapsMeshableBatch(const uint64_t *__restrict__ left, const uint64_t *const *__restrict__ rights,
+                              size_t count, size_t byteLen) noexcept
+    __attribute__((ifunc("resolve_bitmaps_meshable_batch")));
+#else
+uint64_t bitmapsMeshableBatch(const uint64_t *__restrict__ left, const uint64_t *const *__restrict__ rights,
+                              size_t count, size_t byteLen) noexcept {
+  d_assert(count <= kMeshableBatchMax);
+  d_assert(byteLen % 8 == 0);
+
+#if defined(__aarch64__)
+  // NEON is part of the ARMv8 baseline
+  return meshableBatchNeon(left, rights, count, byteLen);
+#elif defined(__x86_64__) && defined(__AVX2__)
+  return meshableBatchAvx2(left, rights, count, byteLen);
+#else
+  return meshableBatchScalar(left, rights, count, byteLen);
+#endif
+}
+#endif
+}  // namespace mesh
@@ -46,16 +46,35 @@ inline bool bitmapsMeshable(const void *__restrict__ bitmap1, const void *__rest
   return result == 0;
 }
 
+// the most right-hand bitmaps bitmapsMeshableBatch tests at once
+static constexpr size_t kMeshableBatchMax = 64;
+
+// tests a single bitmap against a batch of up to kMeshableBatchMax
+// others, keeping the left-hand bitmap in vector registers.  Bit i of
+// the result is set if left and rights[i] are meshable.  The kernel
+// (AVX-512, AVX2, NEON or scalar) is picked once, at load time.
+uint64_t bitmapsMeshableBatch(const uint64_t *__restrict__ left, const uint64_t *const *__restrict__ rights,
+                              size_t count, size_t byteLen) noexcept;
+
 namespace method {
 
-// split miniheaps into two lists in a random order
+// split miniheaps into two lists in a random order.  Candidates are
+// collected from the emptiest occupancy bucket up, so if there are
+// more than fit in the split lists the sparsest spans are kept.
 template <size_t PageSize>
-void halfSplit(MWC &prng, MiniHeapListEntry<PageSize> *miniheaps, SplitArray<PageSize> &left, size_t &leftSize,
+void halfSplit(MWC &prng, const PartialBuckets<PageSize> &miniheaps, SplitArray<PageSize> &left, size_t &leftSize,
                SplitArray<PageSize> &right, size_t &rightSize) noexcept;
 
 template <size_t PageSize>
 void shiftedSplitting(
-    MWC &prng, MiniHeapListEntry<PageSize> *miniheaps, SplitArray<PageSize> &left, SplitArray<PageSize> &right,
+    MWC &prng, const PartialBuckets<PageSize> &miniheaps, SplitArray<PageSize> &left, SplitArray<PageSize> &right,
+    const function<bool(std::pair<MiniHeap<PageSize> *, MiniHeap<PageSize> *> &&)> &meshFound) noexcept;
+
+// sort candidates from fullest to emptiest, and let each one (in that
+// order) pair with one of the emptiest remaining spans
+template <size_t PageSize>
+void greedyMatching(
+    const PartialBuckets<PageSize> &miniheaps, OccupancyArray<PageSize> &candidates,
     const function<bool(std::pair<MiniHeap<PageSize> *, MiniHeap<PageSize> *> &&)> &meshFound) noexcept;
 }  // namespace method
 }  // namespace mesh
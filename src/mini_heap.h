@@ -35,7 +35,9 @@ private:
   static constexpr uint32_t ShuffleVectorOffsetShift = 8;
   static constexpr uint32_t MaxCountShift = 16;
   static constexpr uint32_t PendingOffset = 27;
+  static constexpr uint32_t PartialBucketShift = 28;
   static constexpr uint32_t MeshedOffset = 30;
+  static constexpr uint32_t HugeOffset = 31;
 
   inline void ATTRIBUTE_ALWAYS_INLINE setMasked(uint32_t mask, uint32_t newVal) {
     uint32_t oldFlags = _flags.load(std::memory_order_relaxed);
@@ -71,6 +73,20 @@ public:
     setMasked(mask, newVal);
   }
 
+  // which occupancy bucket of the partial freelist we were last added
+  // to.  Only meaningful when freelistId is Partial.
+  inline uint32_t partialBucket() const {
+    return (_flags.load(std::memory_order_seq_cst) >> PartialBucketShift) & 0x3;
+  }
+
+  inline void setPartialBucket(uint32_t bucket) {
+    static_assert(kBinnedTrackerBinCount <= 4, "partial bucket must fit in 2 bits");
+    d_assert(bucket < kBinnedTrackerBinCount);
+    uint32_t mask = ~(static_cast<uint32_t>(0x3) << PartialBucketShift);
+    uint32_t newVal = (static_cast<uint32_t>(bucket) << PartialBucketShift);
+    setMasked(mask, newVal);
+  }
+
   // Atomically set pending flag if current state is Full.
   // FreelisId remains Full. Returns true on success.
   inline bool trySetPendingFromFull() {
@@ -127,6 +143,15 @@ public:
     return is(MeshedOffset);
   }
 
+  // the span lives in a hugepage chunk, and so can't be meshed
+  inline void setHuge() {
+    set(HugeOffset);
+  }
+
+  inline bool isHuge() const {
+    return is(HugeOffset);
+  }
+
   inline void setPending() {
     set(PendingOffset);
   }
@@ -181,6 +206,8 @@ public:
   using BitmapType = internal::Bitmap<PageSize>;
   using ListEntryType = MiniHeapListEntry<PageSize>;
   static constexpr size_t kPageSize = PageSize;
+  // words in an offset mask, as passed to clearMask
+  static constexpr size_t kBitmapWords = bitmap::representationSize(PageSize / kMinObjectSize) / sizeof(size_t);
   static constexpr unsigned kPageShift = __builtin_ctzl(PageSize);
 
   MiniHeap(void *arenaBegin, Span span, size_t objectCount, size_t objectSize)
@@ -226,6 +253,13 @@ public:
     return wasSet;
   }
 
+  // like clearIfNotFree for every offset set in offMask, with one
+  // atomic op per bitmap word.  The offsets that were set are stored
+  // in wereSet.
+  inline void clearMask(const size_t *offMask, size_t *wereSet) {
+    _bitmap.unsetMask(offMask, wereSet);
+  }
+
   inline void ATTRIBUTE_ALWAYS_INLINE freeOff(size_t off) {
     d_assert_msg(_bitmap.isSet(off), "MiniHeap(%p) expected bit %zu to be set (svOff:%zu)", this, off, svOffset());
     _bitmap.unset(off);
@@ -262,7 +296,7 @@ public:
       // debug("\t'%s'\n", srcObject);
     }
 
-    trackMeshedSpan(GetMiniHeapID(src));
+    spliceMeshed(src);
   }
 
   inline size_t spanSize() const {
@@ -340,6 +374,14 @@ public:
     _flags.setFreelistId(id);
   }
 
+  inline uint8_t partialBucket() const {
+    return _flags.partialBucket();
+  }
+
+  inline void setPartialBucket(uint8_t bucket) {
+    _flags.setPartialBucket(bucket);
+  }
+
   // Atomically set pending flag if current state is Full.
   inline bool trySetPendingFromFull() {
     return _flags.trySetPendingFromFull();
@@ -354,11 +396,11 @@ public:
   }
 
   inline MiniHeapID pendingNext() const {
-    return _pendingNext;
+    return _pendingNext.load(std::memory_order_relaxed);
   }
 
   inline void setPendingNext(MiniHeapID next) {
-    _pendingNext = next;
+    _pendingNext.store(next, std::memory_order_relaxed);
   }
 
   inline pid_t current() const {
@@ -382,8 +424,16 @@ public:
     return _nextMeshed.hasValue();
   }
 
+  inline void setHuge() {
+    _flags.setHuge();
+  }
+
+  inline bool isHuge() const {
+    return _flags.isHuge();
+  }
+
   inline bool isMeshingCandidate() const {
-    return !isAttached() && objectSize() < PageSize;
+    return !isAttached() && objectSize() < PageSize && !isHuge();
   }
 
   /// Returns the fraction full (in the range [0, 1]) that this miniheap is.
@@ -408,37 +458,40 @@ public:
     return _bitmap;
   }
 
-  void trackMeshedSpan(MiniHeapID id) {
-    hard_assert(id.hasValue());
-
-    if (!_nextMeshed.hasValue()) {
-      _nextMeshed = id;
-    } else {
-      GetMiniHeap<MiniHeap>(_nextMeshed)->trackMeshedSpan(id);
-    }
+  // the miniheaps meshed together form a ring through _nextMeshed
+  // (an unmeshed miniheap has no next, and is a ring of one), so
+  // joining src's ring to ours is O(1) however big either is.
+  void spliceMeshed(MiniHeap *src) {
+    d_assert(src != this);
+    const MiniHeapID ourNext = _nextMeshed.hasValue() ? _nextMeshed : GetMiniHeapID(this);
+    const MiniHeapID srcNext = src->_nextMeshed.hasValue() ? src->_nextMeshed : GetMiniHeapID(src);
+    // lock-free frees may be walking our ring: link src's ring to
+    // ours first, so that ours is always intact
+    src->_nextMeshed = ourNext;
+    _nextMeshed = srcNext;
   }
 
 public:
+  // calls cb on this miniheap and then each one meshed with it, until
+  // cb returns true
   template <class Callback>
   inline void forEachMeshed(Callback cb) const {
-    if (cb(this))
-      return;
-
-    if (_nextMeshed.hasValue()) {
-      const auto mh = GetMiniHeap<MiniHeap>(_nextMeshed);
-      mh->forEachMeshed(cb);
-    }
+    const MiniHeap *mh = this;
+    do {
+      if (cb(mh))
+        return;
+      mh = mh->_nextMeshed.hasValue() ? GetMiniHeap<MiniHeap>(mh->_nextMeshed) : this;
+    } while (mh != this);
   }
 
   template <class Callback>
   inline void forEachMeshed(Callback cb) {
-    if (cb(this))
-      return;
-
-    if (_nextMeshed.hasValue()) {
-      auto mh = GetMiniHeap<MiniHeap>(_nextMeshed);
-      mh->forEachMeshed(cb);
-    }
+    MiniHeap *mh = this;
+    do {
+      if (cb(mh))
+        return;
+      mh = mh->_nextMeshed.hasValue() ? GetMiniHeap<MiniHeap>(mh->_nextMeshed) : this;
+    } while (mh != this);
   }
 
   bool isRelated(MiniHeap *other) const {
@@ -451,17 +504,18 @@ public:
     return otherFound;
   }
 
+  // the next miniheap in our mesh ring, or this one if we aren't meshed
+  inline MiniHeap *nextMeshed() {
+    return _nextMeshed.hasValue() ? GetMiniHeap<MiniHeap>(_nextMeshed) : this;
+  }
+
+  // walks the ring; GlobalHeap::meshGroupSize() is O(1)
   size_t meshCount() const {
     size_t count = 0;
-
-    const MiniHeap *mh = this;
-    while (mh != nullptr) {
+    forEachMeshed([&](const MiniHeap *) {
       count++;
-
-      auto next = mh->_nextMeshed;
-      mh = next.hasValue() ? GetMiniHeap<MiniHeap>(next) : nullptr;
-    }
-
+      return false;
+    });
     return count;
   }
 
@@ -550,6 +604,10 @@ protected:
       }
 
       mh = GetMiniHeap<MiniHeap>(mh->_nextMeshed);
+      if (unlikely(mh == this)) {
+        // went all the way round the ring
+        abort();
+      }
 
       const uintptr_t meshedSpanptr = arenaBegin + (static_cast<size_t>(mh->span().offset) << kPageShift);
       if (meshedSpanptr <= ptrval && ptrval < meshedSpanptr + len) {
@@ -566,7 +624,7 @@ protected:
   atomic<pid_t> _current{0};  // 4 bytes
   Flags _flags;               // 4 bytes
   MiniHeapID _nextMeshed{};   // 4 bytes
-  MiniHeapID _pendingNext{};  // 4 bytes (for lock-free pending list, separate from _freelist)
+  atomic<MiniHeapID> _pendingNext{};  // 4 bytes (for lock-free pending list + depot, separate from _freelist)
   BitmapType _bitmap;         // 32 bytes (4K) or 128 bytes (16K)
 };
 
@@ -9,9 +9,16 @@
 
 #include <stddef.h>
 
+#ifdef __cplusplus
+#include <new>
+#endif
+
 #define MESH_VERSION_MAJOR 1
 #define MESH_VERSION_MINOR 0
 
+// number of size classes, including the unused class 0
+#define MESH_SIZE_CLASS_COUNT 25
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -26,8 +33,109 @@ int mesh_in_bounds(void *ptr);
 // returns the usable size of an allocation
 size_t mesh_usable_size(void *ptr);
 
+// allocates count objects of size bytes each, storing them in ptrs.
+// Cheaper than count calls to malloc.  Returns the number allocated,
+// which is less than count only if memory ran out.
+size_t mesh_malloc_batch(size_t size, void **ptrs, size_t count);
+
+// frees the count objects in ptrs (NULL entries are ignored), as if
+// by calling free on each.
+void mesh_free_batch(void **ptrs, size_t count);
+
+// the allocator's malloc and free, under names that don't depend on
+// mesh being interposed as the system allocator.
+void *mesh_malloc(size_t size);
+void mesh_free(void *ptr);
+
+// allocates an object of the given size class (1 through
+// MESH_SIZE_CLASS_COUNT - 1), skipping the size to size class lookup.
+// Returns NULL for an invalid size class.  Prefer mesh::alloc<Size>()
+// from C++, which picks the size class at compile time.
+void *mesh_malloc_size_class(unsigned size_class);
+
 #ifdef __cplusplus
 }
 #endif
 
+#ifdef __cplusplus
+namespace mesh {
+namespace detail {
+// the largest object each size class holds.  Must match
+// SizeMap::class_to_size_ in runtime.cc, which the size class unit
+// tests check.
+static constexpr size_t kClassSizes[] = {
+    16,  16,  32,  48,  64,  80,  96,  112,  128,  160,  192,  224,   256,
+    320, 384, 448, 512, 640, 768, 896, 1024, 2048, 4096, 8192, 16384,
+};
+static constexpr unsigned kSizeClassCount = sizeof(kClassSizes) / sizeof(kClassSizes[0]);
+static_assert(kSizeClassCount == MESH_SIZE_CLASS_COUNT, "one size per size class");
+
+// the smallest size class that fits size, or kSizeClassCount if size
+// is too big for any of them.  Class 0 is never handed out.
+constexpr unsigned sizeClassFor(size_t size, unsigned sizeClass = 1) {
+  return sizeClass == kSizeClassCount || kClassSizes[sizeClass] >= size ? sizeClass
+                                                                          : sizeClassFor(size, sizeClass + 1);
+}
+}  // namespace detail
+
+// allocates Size bytes, 16-byte aligned.  The size class is picked at
+// compile time, so small sizes go straight to the calling thread's
+// free list and large ones straight to the large object path.
+template <size_t Size>
+inline void *alloc() {
+  constexpr unsigned sizeClass = detail::sizeClassFor(Size);
+  if (sizeClass == detail::kSizeClassCount) {
+    return mesh_malloc(Size);
+  }
+  return mesh_malloc_size_class(sizeClass);
+}
+
+inline void dealloc(void *ptr) {
+  mesh_free(ptr);
+}
+
+// a standard allocator for containers of T, such as std::list and
+// std::map nodes, where single-object allocations are the common case
+template <typename T>
+class Allocator {
+public:
+  typedef T value_type;
+
+  static_assert(alignof(T) <= 16, "mesh only guarantees 16-byte alignment");
+
+  Allocator() noexcept {
+  }
+  template <typename U>
+  Allocator(const Allocator<U> &) noexcept {
+  }
+
+  T *allocate(size_t n) {
+    void *ptr = nullptr;
+    if (n == 1) {
+      ptr = alloc<sizeof(T)>();
+    } else if (n <= static_cast<size_t>(-1) / sizeof(T)) {
+      ptr = mesh_malloc(n * sizeof(T));
+    }
+    if (ptr == nullptr) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T *>(ptr);
+  }
+
+  void deallocate(T *ptr, size_t) noexcept {
+    dealloc(ptr);
+  }
+
+  template <typename U>
+  bool operator==(const Allocator<U> &) const noexcept {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const Allocator<U> &) const noexcept {
+    return false;
+  }
+};
+}  // namespace mesh
+#endif
+
 #endif /* PLASMA__MESH_H */
@@ -57,27 +57,109 @@ size_t internal::measurePssKiB() {
   return atoi(&start[6]);
 }
 
-int internal::copyFile(int dstFd, int srcFd, off_t off, size_t sz) {
+static size_t readNumaNodeCount() {
+#ifdef __linux__
+  // e.g. "0" or "0-3"; node IDs are dense in practice
+  auto fd = open("/sys/devices/system/node/possible", O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return 1;
+  }
+
+  char buf[64];
+  memset(buf, 0, sizeof(buf));
+  auto _ __attribute__((unused)) = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+
+  const char *last = buf;
+  for (const char *p = buf; *p != '\0'; p++) {
+    if (*p == '-' || *p == ',') {
+      last = p + 1;
+    }
+  }
+
+  const size_t count = strtoul(last, nullptr, 10) + 1;
+  return std::min(std::max(count, static_cast<size_t>(1)), kMaxNumaNodes);
+#else
+  return 1;
+#endif
+}
+
+size_t internal::numaNodeCount() {
+  static const size_t count = readNumaNodeCount();
+  return count;
+}
+
+size_t internal::currentNumaNode() {
+#if defined(__linux__) && defined(SYS_getcpu)
+  if (numaNodeCount() == 1) {
+    return 0;
+  }
+
+  unsigned cpu = 0;
+  unsigned node = 0;
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+    return 0;
+  }
+  return std::min(static_cast<size_t>(node), numaNodeCount() - 1);
+#else
+  return 0;
+#endif
+}
+
+ssize_t internal::copyFile(int dstFd, int srcFd, off_t off, size_t sz) {
   d_assert(off >= 0);
 
+#if defined(__APPLE__)
   off_t newOff = lseek(dstFd, off, SEEK_SET);
   d_assert(newOff == off);
 
-#if defined(__APPLE__)
   // TODO: test that setting offset on dstFd works as intended
   // fcopyfile works on FreeBSD and OS X 10.5+
   int result = fcopyfile(srcFd, dstFd, 0, COPYFILE_ALL);
-#elif defined(__FreeBSD__)
-  // unlike Linux and Solaris, sendfile works only with sockets here
-  // thus copy_file_range is the only viable solution
-  int result = copy_file_range(srcFd, &off, dstFd, NULL, sz, 0);
+  return result == 0 ? sz : -1;
+#else
+  size_t copied = 0;
+
+#if defined(__FreeBSD__) || defined(SYS_copy_file_range)
+  // copy_file_range keeps the copy in the kernel, and is the only
+  // option on FreeBSD (where sendfile works only with sockets).  It
+  // may copy less than asked for, so loop until we're done.
+  while (copied < sz) {
+    off_t srcOff = off + copied;
+    off_t dstOff = srcOff;
+#if defined(__FreeBSD__)
+    const ssize_t result = copy_file_range(srcFd, &srcOff, dstFd, &dstOff, sz - copied, 0);
 #else
-  errno = 0;
-  // sendfile will work with non-socket output (i.e. regular file) on Linux 2.6.33+
-  int result = sendfile(dstFd, srcFd, &off, sz);
+    const ssize_t result = syscall(SYS_copy_file_range, srcFd, &srcOff, dstFd, &dstOff, sz - copied, 0);
+#endif
+    if (result <= 0) {
+      break;
+    }
+    copied += result;
+  }
+#endif
+
+#ifdef __linux__
+  // older kernels can't copy_file_range between our span files, but
+  // sendfile will work with non-socket output (i.e. regular file) on
+  // Linux 2.6.33+
+  if (copied < sz) {
+    off_t newOff = lseek(dstFd, off + copied, SEEK_SET);
+    d_assert(newOff == static_cast<off_t>(off + copied));
+  }
+  while (copied < sz) {
+    off_t srcOff = off + copied;
+    errno = 0;
+    const ssize_t result = sendfile(dstFd, srcFd, &srcOff, sz - copied);
+    if (result <= 0) {
+      break;
+    }
+    copied += result;
+  }
 #endif
 
-  return result;
+  return copied;
+#endif
 }
 
 // Explicit instantiation of Runtime
@@ -66,6 +66,10 @@ public:
     _heap.setMeshPeriodMs(period);
   }
 
+  // like GlobalHeap::mallctl, but compacting or scavenging also hands
+  // back what the calling thread's heap has cached or buffered
+  int mallctl(const char *name, void *oldp, size_t *oldlenp, void *newp, size_t newlen);
+
 #ifdef __linux__
   int epollWait(int __epfd, struct epoll_event *__events, int __maxevents, int __timeout);
   int epollPwait(int __epfd, struct epoll_event *__events, int __maxevents, int __timeout, const __sigset_t *__ss);
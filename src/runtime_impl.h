@@ -12,10 +12,12 @@
 #include <pthread.h>
 #include <sched.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
 
 #ifdef __linux__
+#include <poll.h>
 #include <sys/signalfd.h>
 #endif
 
@@ -91,6 +93,17 @@ void *Runtime<PageSize>::startThread(StartThreadArgs *threadArgs) {
   return startRoutine(arg);
 }
 
+template <size_t PageSize>
+int Runtime<PageSize>::mallctl(const char *name, void *oldp, size_t *oldlenp, void *newp, size_t newlen) {
+  if (strcmp(name, "mesh.compact") == 0 || strcmp(name, "mesh.scavenge") == 0) {
+    auto heap = ThreadLocalHeap<PageSize>::GetHeap();
+    heap->flushRemoteFrees();
+    heap->flushLargeCache();
+  }
+
+  return _heap.mallctl(name, oldp, oldlenp, newp, newlen);
+}
+
 template <size_t PageSize>
 void Runtime<PageSize>::exitThread(void *retval) {
   if (unlikely(mesh::real::pthread_exit == nullptr)) {
@@ -157,7 +170,83 @@ void *Runtime<PageSize>::bgThread(void *arg) {
   // debug("libmesh: background thread started\n");
 
 #ifdef __linux__
+  // if background meshing is enabled, other threads post hints to
+  // meshHintFd rather than meshing inline.  We run at most one pass
+  // per hint, and after a pass that took N ms of CPU we wait long
+  // enough that we stay within the configured budget of ms per second.
+  //
+  // the arena separately posts to scavengeHintFd once enough dirty
+  // pages build up, and we scavenge them in slices.  With decay on, we
+  // also wake up once per decay epoch to age out dirty pages.
+  struct pollfd fds[3];
+  fds[0].fd = rt._signalFd;
+  fds[0].events = POLLIN;
+  fds[1].fd = rt.heap().meshHintFd();
+  fds[1].events = POLLIN;
+  fds[2].fd = rt.heap().scavengeHintFd();
+  fds[2].events = POLLIN;
+
+  bool meshWanted = false;
+  auto nextMesh = time::preciseNow();
+  auto nextDecay = time::preciseNow();
+  auto decayInterval = kZeroMs;
+
   while (true) {
+    int timeoutMs = -1;
+    if (meshWanted) {
+      const auto now = time::preciseNow();
+      if (now >= nextMesh) {
+        meshWanted = false;
+        const auto cpuUsed = rt.heap().backgroundMesh();
+        const size_t budgetMs = std::max(rt.heap().backgroundMeshBudgetMs(), static_cast<size_t>(1));
+        if (budgetMs < 1000) {
+          nextMesh = now + cpuUsed * 1000 / budgetMs;
+        }
+        continue;
+      }
+      timeoutMs = chrono::duration_cast<chrono::milliseconds>(nextMesh - now).count() + 1;
+    }
+
+    {
+      const auto now = time::preciseNow();
+      if (now >= nextDecay) {
+        decayInterval = rt.heap().backgroundDecay();
+        nextDecay = now + decayInterval;
+      }
+      if (decayInterval > kZeroMs) {
+        const int decayTimeoutMs = chrono::duration_cast<chrono::milliseconds>(nextDecay - now).count() + 1;
+        if (timeoutMs < 0 || decayTimeoutMs < timeoutMs) {
+          timeoutMs = decayTimeoutMs;
+        }
+      }
+    }
+
+    const int n = poll(fds, 3, timeoutMs);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return nullptr;
+    }
+
+    if (fds[1].revents & POLLIN) {
+      uint64_t hints = 0;
+      auto _ __attribute__((unused)) = read(fds[1].fd, &hints, sizeof(hints));
+      meshWanted = true;
+    }
+
+    if (fds[2].revents & POLLIN) {
+      uint64_t hints = 0;
+      auto _ __attribute__((unused)) = read(fds[2].fd, &hints, sizeof(hints));
+      rt.heap().backgroundScavenge();
+      // decay settings may have changed
+      nextDecay = time::preciseNow();
+    }
+
+    if (!(fds[0].revents & POLLIN)) {
+      continue;
+    }
+
     struct signalfd_siginfo siginfo;
 
     ssize_t s = read(rt._signalFd, &siginfo, sizeof(struct signalfd_siginfo));
@@ -218,6 +218,22 @@ public:
     }
   }
 
+  // the attached miniheap whose objects include ptr, or nullptr.  A
+  // range check against each attached span, so unlike
+  // GlobalHeap::miniheapFor it doesn't chase the arena's index.  Every
+  // miniheap of a size class holds _maxCount objects.
+  inline MiniHeapT *ATTRIBUTE_ALWAYS_INLINE attachedMiniheapFor(const void *ptr) const {
+    const auto ptrval = reinterpret_cast<uintptr_t>(ptr);
+    const uintptr_t objectBytes = static_cast<uintptr_t>(_maxCount) * _objectSize;
+    const size_t count = _attachedMiniheaps.size();
+    for (size_t i = 0; i < count; i++) {
+      if (ptrval - _start[i] < objectBytes) {
+        return _attachedMiniheaps[i];
+      }
+    }
+    return nullptr;
+  }
+
   void ATTRIBUTE_NEVER_INLINE freeFullSlowpath(MiniHeapT *mh, size_t off) {
     mh->freeOff(off);
   }
@@ -251,6 +267,17 @@ public:
     return ptrFromOffset(off);
   }
 
+  // pops up to count objects into ptrs, and returns how many it
+  // popped (fewer than count only if the list ran out)
+  inline uint32_t ATTRIBUTE_ALWAYS_INLINE mallocBatch(void **ptrs, uint32_t count) {
+    const uint32_t n = count < length() ? count : length();
+    for (uint32_t i = 0; i < n; i++) {
+      ptrs[i] = ptrFromOffset(_list[_off + i]);
+    }
+    _off += n;
+    return n;
+  }
+
   inline size_t getSize() {
     return _objectSize;
   }
@@ -92,7 +92,7 @@ static void BM_LocalRefill1Impl(benchmark::State &state) {
       // We must attach it to prevent it from being considered "free" immediately if we were to return it
       // But here we just hold it in array.
       // The original allocSmallMiniheaps did setAttached.
-      mh->setAttached(tid, gheap.freelistFor(mh->freelistId(), mh->sizeClass()));
+      mh->setAttached(tid, gheap.freelistFor(mh));
       array.append(mh);
     }
     gheap.unlock();
@@ -4,10 +4,7 @@
 #include <stdlib.h>
 #include <vector>
 
-extern "C" {
-void *mesh_malloc(size_t sz);
-void mesh_free(void *ptr);
-}
+#include "plasma/mesh.h"
 
 static void BM_MallocFree(benchmark::State &state) {
   const size_t size = state.range(0);
@@ -18,5 +15,52 @@ static void BM_MallocFree(benchmark::State &state) {
   }
 }
 
+// the size class is picked at compile time
+template <size_t Size>
+static void BM_AllocFree(benchmark::State &state) {
+  for (auto _ : state) {
+    void *ptr = mesh::alloc<Size>();
+    benchmark::DoNotOptimize(ptr);
+    mesh::dealloc(ptr);
+  }
+}
+
 // Register the benchmark with different sizes
 BENCHMARK(BM_MallocFree)->Range(16, 4096);
+BENCHMARK_TEMPLATE(BM_AllocFree, 16);
+BENCHMARK_TEMPLATE(BM_AllocFree, 64);
+BENCHMARK_TEMPLATE(BM_AllocFree, 512);
+BENCHMARK_TEMPLATE(BM_AllocFree, 4096);
+
+static constexpr size_t kBatchCount = 1024;
+
+// the parser pattern: allocate many same-sized objects, then free
+// them all together
+static void BM_MallocFreeLoop(benchmark::State &state) {
+  const size_t size = state.range(0);
+  std::vector<void *> ptrs(kBatchCount);
+  for (auto _ : state) {
+    for (size_t i = 0; i < kBatchCount; i++) {
+      ptrs[i] = mesh_malloc(size);
+    }
+    benchmark::DoNotOptimize(ptrs.data());
+    for (size_t i = 0; i < kBatchCount; i++) {
+      mesh_free(ptrs[i]);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchCount);
+}
+
+static void BM_MallocFreeBatch(benchmark::State &state) {
+  const size_t size = state.range(0);
+  std::vector<void *> ptrs(kBatchCount);
+  for (auto _ : state) {
+    const size_t n = mesh_malloc_batch(size, ptrs.data(), kBatchCount);
+    benchmark::DoNotOptimize(ptrs.data());
+    mesh_free_batch(ptrs.data(), n);
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchCount);
+}
+
+BENCHMARK(BM_MallocFreeLoop)->Range(16, 4096);
+BENCHMARK(BM_MallocFreeBatch)->Range(16, 4096);
@@ -0,0 +1,139 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+// Benchmark of how long a writer is held up when it stores to a span
+// while that span is being meshed away, with the mprotect + SIGSEGV
+// barrier (arg 0) and the userfaultfd write-protect barrier (arg 1).
+//
+// A writer thread stores to an object in the src miniheap in a tight
+// loop while the benchmark thread meshes it, holding every heap lock
+// as a mesh pass would.  Each iteration reports the writer's longest
+// store: with mprotect that includes delivering the signal and waiting
+// on the size-class lock, with userfaultfd only the wait in the kernel
+// until the mesher wakes it.  Run on a machine with at least 2 CPUs.
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <benchmark/benchmark.h>
+
+#include "internal.h"
+#include "real.h"
+#include "runtime.h"
+
+using namespace mesh;
+
+static constexpr uint32_t kObjSize = 128;
+
+template <size_t PageSize>
+struct BarrierWriter {
+  std::atomic<char *> target{nullptr};
+  std::atomic_bool stop{false};
+  std::atomic<uint64_t> loops{0};
+  std::atomic<uint64_t> maxStallNs{0};
+
+  void run() {
+    for (; !stop.load(std::memory_order_relaxed); loops.fetch_add(1, std::memory_order_release)) {
+      volatile char *ptr = target.load(std::memory_order_acquire);
+      if (ptr == nullptr) {
+        continue;
+      }
+      const auto start = std::chrono::steady_clock::now();
+      *ptr = 'w';
+      const uint64_t ns =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+      if (ns > maxStallNs.load(std::memory_order_relaxed)) {
+        maxStallNs.store(ns, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // waits until the writer has gone all the way around its loop after
+  // now, so it has seen the current target
+  void sync() {
+    const uint64_t seen = loops.load(std::memory_order_acquire);
+    while (loops.load(std::memory_order_acquire) < seen + 2) {
+    }
+  }
+};
+
+template <size_t PageSize>
+static void meshBarrierImpl(benchmark::State &state) {
+  GlobalHeap<PageSize> &gheap = runtime<PageSize>().heap();
+  // the mprotect barrier needs our SIGSEGV handler
+  mesh::real::init();
+  runtime<PageSize>().installSegfaultHandler();
+  gheap.setMeshPeriodMs(kZeroMs);
+
+  const bool uffd = state.range(0) != 0;
+  if (!gheap.setUffdBarrier(uffd)) {
+    state.SkipWithError("userfaultfd write-protect unavailable");
+    return;
+  }
+
+  const auto tid = gettid();
+  const int sizeClass = SizeMap::SizeClass(kObjSize);
+  const uint32_t objCount = PageSize / kObjSize;
+
+  BarrierWriter<PageSize> writer{};
+  std::thread writerThread([&writer]() { writer.run(); });
+
+  uint64_t totalStallNs = 0;
+  uint64_t maxStallNs = 0;
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    FixedArray<MiniHeap<PageSize>, 2> array{};
+    gheap.allocSmallMiniheaps(sizeClass, kObjSize, array, tid);
+    MiniHeap<PageSize> *dst = array[0];
+    MiniHeap<PageSize> *src = array[1];
+    void *dstObj = dst->mallocAt(gheap.arenaBegin(), 0);
+    char *srcObj = reinterpret_cast<char *>(src->mallocAt(gheap.arenaBegin(), objCount - 1));
+    gheap.releaseMiniheaps(array);
+
+    writer.target.store(srcObj, std::memory_order_release);
+    writer.sync();
+    writer.maxStallNs.store(0);
+    state.ResumeTiming();
+
+    gheap.lock();
+    gheap.meshLocked(dst, src);
+    gheap.unlock();
+
+    state.PauseTiming();
+    writer.sync();
+    const uint64_t stallNs = writer.maxStallNs.load();
+    totalStallNs += stallNs;
+    maxStallNs = std::max(maxStallNs, stallNs);
+
+    writer.target.store(nullptr, std::memory_order_release);
+    writer.sync();
+    gheap.free(dstObj);
+    gheap.free(srcObj);
+    size_t unused = 0;
+    size_t len = sizeof(unused);
+    gheap.mallctl("mesh.compact", &unused, &len, nullptr, 0);
+    state.ResumeTiming();
+  }
+
+  writer.stop = true;
+  writerThread.join();
+  gheap.setUffdBarrier(false);
+
+  state.counters["stall_avg_us"] = totalStallNs / 1000.0 / state.iterations();
+  state.counters["stall_max_us"] = maxStallNs / 1000.0;
+}
+
+static void BM_MeshBarrier(benchmark::State &state) {
+  if (getPageSize() == 4096) {
+    meshBarrierImpl<4096>(state);
+  } else {
+    meshBarrierImpl<16384>(state);
+  }
+}
+BENCHMARK(BM_MeshBarrier)->ArgName("uffd")->Arg(0)->Arg(1)->UseRealTime();
+
+BENCHMARK_MAIN();
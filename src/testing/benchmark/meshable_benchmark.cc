@@ -0,0 +1,161 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+// Benchmark comparing the scalar bitmapsMeshable test against the
+// batched (SIMD) bitmapsMeshableBatch used by shiftedSplitting.
+//
+// Both walk the same probe pattern as shiftedSplitting: every left
+// bitmap is tested against a window of 64 right bitmaps.  Throughput
+// is reported as pairs tested per second.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "meshing.h"
+
+using namespace mesh;
+
+static constexpr size_t kBenchPageSize4K = 4096;
+static constexpr size_t kBenchPageSize16K = 16384;
+
+// number of left and right bitmaps, like a well-populated size class
+static constexpr size_t kBitmapCount = 1024;
+// matches the probe window (t) in shiftedSplitting
+static constexpr size_t kWindow = 64;
+
+// large enough for a 16K page of 16-byte objects
+struct alignas(64) TestBitmap {
+  uint64_t words[kBenchPageSize16K / kMinObjectSize / 64];
+};
+
+struct TestData {
+  size_t byteLen;
+  std::vector<TestBitmap> left;
+  std::vector<TestBitmap> right;
+};
+
+// each bit is set with probability occupancyPct / 100, roughly the
+// occupancy of the partially-full miniheaps we try to mesh
+static TestData generateTestData(size_t pageSize, uint32_t occupancyPct) {
+  TestData data;
+  data.byteLen = pageSize / kMinObjectSize / 8;
+  data.left.resize(kBitmapCount);
+  data.right.resize(kBitmapCount);
+
+  std::mt19937_64 rng(42);
+  std::bernoulli_distribution bit(occupancyPct / 100.0);
+  const size_t bitCount = data.byteLen * 8;
+
+  for (auto *bitmaps : {&data.left, &data.right}) {
+    for (auto &bitmap : *bitmaps) {
+      for (size_t i = 0; i < bitCount; i++) {
+        if (bit(rng)) {
+          bitmap.words[i / 64] |= 1ULL << (i % 64);
+        }
+      }
+    }
+  }
+
+  return data;
+}
+
+static size_t ATTRIBUTE_NEVER_INLINE countScalar(const TestData &data) {
+  size_t meshable = 0;
+  for (size_t j = 0; j < kBitmapCount; j++) {
+    for (size_t i = 0; i < kWindow; i++) {
+      const size_t idxRight = (j + i) % kBitmapCount;
+      meshable += bitmapsMeshable(data.left[j].words, data.right[idxRight].words, data.byteLen);
+    }
+  }
+  return meshable;
+}
+
+static size_t ATTRIBUTE_NEVER_INLINE countBatch(const TestData &data) {
+  const uint64_t *rights[kWindow];
+
+  size_t meshable = 0;
+  for (size_t j = 0; j < kBitmapCount; j++) {
+    for (size_t i = 0; i < kWindow; i++) {
+      rights[i] = data.right[(j + i) % kBitmapCount].words;
+    }
+    meshable += __builtin_popcountll(bitmapsMeshableBatch(data.left[j].words, rights, kWindow, data.byteLen));
+  }
+  return meshable;
+}
+
+static void verifyCorrectness() {
+  bool hasErrors = false;
+  for (size_t pageSize : {kBenchPageSize4K, kBenchPageSize16K}) {
+    for (uint32_t occupancy : {1, 5, 10, 30}) {
+      TestData data = generateTestData(pageSize, occupancy);
+      const size_t expected = countScalar(data);
+      const size_t batched = countBatch(data);
+      if (batched != expected) {
+        fprintf(stderr, "MISMATCH: pageSize=%zu occupancy=%u%% expected=%zu got=%zu\n", pageSize, occupancy,
+                expected, batched);
+        hasErrors = true;
+      }
+    }
+  }
+  if (!hasErrors) {
+    fprintf(stderr, "All verification checks passed.\n");
+  }
+}
+
+// Benchmark: one bitmapsMeshable call per pair (baseline)
+static void BM_Meshable_Scalar(benchmark::State &state) {
+  TestData data = generateTestData(state.range(0), state.range(1));
+
+  size_t sum = 0;
+  for (auto _ : state) {
+    sum += countScalar(data);
+  }
+  benchmark::DoNotOptimize(sum);
+
+  state.SetItemsProcessed(state.iterations() * kBitmapCount * kWindow);
+  state.SetLabel("bytes=" + std::to_string(data.byteLen));
+}
+
+// Benchmark: one bitmapsMeshableBatch call per window
+static void BM_Meshable_Batch(benchmark::State &state) {
+  TestData data = generateTestData(state.range(0), state.range(1));
+
+  size_t sum = 0;
+  for (auto _ : state) {
+    sum += countBatch(data);
+  }
+  benchmark::DoNotOptimize(sum);
+
+  state.SetItemsProcessed(state.iterations() * kBitmapCount * kWindow);
+  state.SetLabel("bytes=" + std::to_string(data.byteLen));
+}
+
+// Args: (page_size, occupancy_percent)
+BENCHMARK(BM_Meshable_Scalar)
+    ->Args({kBenchPageSize4K, 5})
+    ->Args({kBenchPageSize4K, 30})
+    ->Args({kBenchPageSize16K, 1})
+    ->Args({kBenchPageSize16K, 30});
+
+BENCHMARK(BM_Meshable_Batch)
+    ->Args({kBenchPageSize4K, 5})
+    ->Args({kBenchPageSize4K, 30})
+    ->Args({kBenchPageSize16K, 1})
+    ->Args({kBenchPageSize16K, 30});
+
+int main(int argc, char **argv) {
+  fprintf(stderr, "Verifying batched meshability test against scalar...\n");
+  verifyCorrectness();
+  fprintf(stderr, "\n");
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
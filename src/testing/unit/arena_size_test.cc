@@ -0,0 +1,74 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+#include "gtest/gtest.h"
+
+#include "internal.h"
+#include "runtime.h"
+
+#include "mallctl_helpers.h"
+
+using namespace mesh;
+
+static constexpr size_t MB = 1024ULL * 1024ULL;
+static constexpr size_t GB = 1024ULL * MB;
+
+TEST(ArenaSizeTest, ParsesSizes) {
+  using Arena4K = MeshableArena<4096>;
+  ASSERT_EQ(Arena4K::parseArenaSize(nullptr), kArenaSize);
+  ASSERT_EQ(Arena4K::parseArenaSize("134217728"), 128 * MB);
+  ASSERT_EQ(Arena4K::parseArenaSize("128M"), 128 * MB);
+  ASSERT_EQ(Arena4K::parseArenaSize("512g"), 512 * GB);
+  ASSERT_EQ(Arena4K::parseArenaSize("1T"), 1024 * GB);
+
+  // clamped, and rounded up to whole hugepage chunks
+  ASSERT_EQ(Arena4K::parseArenaSize("1"), kMinArenaSize);
+  ASSERT_EQ(Arena4K::parseArenaSize("100T"), kMaxArenaSize);
+  ASSERT_EQ(Arena4K::parseArenaSize("65M"), 66 * MB);
+  ASSERT_EQ(MeshableArena<16384>::parseArenaSize("65M"), 96 * MB);
+}
+
+template <size_t PageSize>
+static void growsFileImpl() {
+  GlobalHeap<PageSize> &gheap = runtime<PageSize>().heap();
+
+  const size_t arenaSize = getStat(gheap, "mesh.arena_size");
+  ASSERT_EQ(arenaSize, gheap.arenaSize());
+  ASSERT_GE(arenaSize, kMinArenaSize);
+
+  // the reservation is fixed once the arena exists
+  size_t old = 0;
+  size_t oldLen = sizeof(old);
+  size_t newSize = 2 * arenaSize;
+  ASSERT_EQ(gheap.mallctl("mesh.arena_size", &old, &oldLen, &newSize, sizeof(newSize)), -1);
+  ASSERT_EQ(gheap.arenaSize(), arenaSize);
+
+  // the file only backs what the arena has handed out
+  const size_t fileBytes = getStat(gheap, "stats.arena_file_bytes");
+  ASSERT_LE(fileBytes, arenaSize);
+
+  const size_t sz = std::min(arenaSize / 4, 256 * MB);
+  void *ptr = gheap.malloc(sz);
+  ASSERT_NE(ptr, nullptr);
+  ASSERT_GE(getStat(gheap, "stats.arena_file_bytes"), sz);
+  ASSERT_LE(getStat(gheap, "stats.arena_file_bytes"), arenaSize);
+
+  // and doesn't shrink again
+  gheap.free(ptr);
+  ASSERT_GE(getStat(gheap, "stats.arena_file_bytes"), sz);
+}
+
+TEST(ArenaSizeTest, GrowsFileWithArena) {
+  if (getPageSize() == 4096) {
+    growsFileImpl<4096>();
+  } else {
+    growsFileImpl<16384>();
+  }
+}
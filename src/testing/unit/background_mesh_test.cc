@@ -0,0 +1,137 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#include <poll.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+#include "internal.h"
+#include "runtime.h"
+
+#include "mallctl_helpers.h"
+
+using namespace mesh;
+
+#ifdef __linux__
+
+static bool hintPosted(int fd) {
+  struct pollfd pfd {};
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  return poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN);
+}
+
+template <size_t PageSize>
+static void backgroundMeshHintImpl() {
+  if (!kMeshingEnabled) {
+    GTEST_SKIP();
+  }
+
+  GlobalHeap<PageSize> &gheap = runtime<PageSize>().heap();
+
+  gheap.setMeshPeriodMs(std::chrono::milliseconds{1});
+  gheap.enableBackgroundMeshing();
+  ASSERT_TRUE(gheap.backgroundMeshing());
+
+  const int fd = gheap.meshHintFd();
+  ASSERT_GE(fd, 0);
+  ASSERT_FALSE(hintPosted(fd));
+
+  // once the mesh period has elapsed, threads only post a hint
+  usleep(20 * 1000);
+  gheap.maybeMesh();
+  gheap.maybeMesh();
+  ASSERT_TRUE(hintPosted(fd));
+
+  // ...and only the first one to notice does so
+  uint64_t hints = 0;
+  ASSERT_EQ(read(fd, &hints, sizeof(hints)), static_cast<ssize_t>(sizeof(hints)));
+  ASSERT_EQ(hints, 1UL);
+
+  // no further hints until the background thread has run a pass
+  usleep(20 * 1000);
+  gheap.maybeMesh();
+  ASSERT_FALSE(hintPosted(fd));
+
+  gheap.backgroundMesh();
+
+  usleep(20 * 1000);
+  gheap.maybeMesh();
+  ASSERT_TRUE(hintPosted(fd));
+
+  gheap.disableBackgroundMeshing();
+  ASSERT_FALSE(gheap.backgroundMeshing());
+  ASSERT_LT(gheap.meshHintFd(), 0);
+
+  gheap.setMeshPeriodMs(kMeshPeriodMs);
+}
+
+TEST(BackgroundMeshTest, PostsHintInsteadOfMeshing) {
+  if (getPageSize() == 4096) {
+    backgroundMeshHintImpl<4096>();
+  } else {
+    backgroundMeshHintImpl<16384>();
+  }
+}
+
+template <size_t PageSize>
+static void backgroundScavengeImpl() {
+  GlobalHeap<PageSize> &gheap = heapWithoutAutoMesh<PageSize>();
+  gheap.scavenge(true);
+  gheap.enableBackgroundMeshing();
+
+  const int fd = gheap.scavengeHintFd();
+  ASSERT_GE(fd, 0);
+  ASSERT_FALSE(hintPosted(fd));
+
+  // free enough large allocations to cross the dirty page threshold
+  constexpr size_t kSpanPages = 64;
+  constexpr size_t kMaxSpans = 512;
+  const size_t maxDirtyPageThreshold = (kMaxDirtyPageThreshold * kPageSize4K) / PageSize;
+  const size_t spanCount = maxDirtyPageThreshold / kSpanPages + 2;
+  ASSERT_LE(spanCount, kMaxSpans);
+
+  void *ptrs[kMaxSpans]{};
+  for (size_t i = 0; i < spanCount; i++) {
+    ptrs[i] = gheap.malloc(kSpanPages * PageSize);
+    ASSERT_NE(ptrs[i], nullptr);
+  }
+  for (size_t i = 0; i < spanCount; i++) {
+    gheap.free(ptrs[i]);
+  }
+
+  // rather than scavenging inline, the arena posts a hint
+  ASSERT_TRUE(hintPosted(fd));
+  ASSERT_GT(gheap.dirtyPageCount(), maxDirtyPageThreshold);
+
+  uint64_t hints = 0;
+  ASSERT_EQ(read(fd, &hints, sizeof(hints)), static_cast<ssize_t>(sizeof(hints)));
+  ASSERT_EQ(hints, 1UL);
+
+  const size_t slicesBefore = getStat(gheap, "stats.bg_scavenge_slices");
+
+  gheap.backgroundScavenge();
+  ASSERT_EQ(gheap.dirtyPageCount(), 0UL);
+
+  // the dirty pages were cleaned a slice at a time
+  ASSERT_GE(getStat(gheap, "stats.bg_scavenge_slices") - slicesBefore, maxDirtyPageThreshold / kScavengeSlicePages);
+
+  gheap.disableBackgroundMeshing();
+  ASSERT_LT(gheap.scavengeHintFd(), 0);
+
+  gheap.setMeshPeriodMs(kMeshPeriodMs);
+}
+
+TEST(BackgroundMeshTest, ScavengesInSlices) {
+  if (getPageSize() == 4096) {
+    backgroundScavengeImpl<4096>();
+  } else {
+    backgroundScavengeImpl<16384>();
+  }
+}
+
+#endif  // __linux__
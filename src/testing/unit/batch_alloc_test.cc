@@ -0,0 +1,76 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "internal.h"
+#include "runtime.h"
+#include "thread_local_heap.h"
+
+#include "mallctl_helpers.h"
+
+using namespace mesh;
+
+static constexpr size_t BatchCount = 1000;
+
+template <size_t PageSize>
+static void batchImpl(size_t objectSize) {
+  GlobalHeap<PageSize> &gheap = heapWithoutAutoMesh<PageSize>();
+  auto heap = ThreadLocalHeap<PageSize>::GetHeap();
+
+  heap->releaseAll();
+  const size_t miniheapCount = gheap.getAllocatedMiniheapCount();
+
+  std::vector<void *> ptrs(BatchCount);
+  ASSERT_EQ(heap->mallocBatch(objectSize, ptrs.data(), BatchCount), BatchCount);
+
+  for (size_t i = 0; i < BatchCount; i++) {
+    ASSERT_NE(ptrs[i], nullptr);
+    ASSERT_GE(heap->getSize(ptrs[i]), objectSize);
+    memset(ptrs[i], 'A' + i % 26, objectSize);
+  }
+  for (size_t i = 0; i < BatchCount; i++) {
+    ASSERT_EQ(reinterpret_cast<char *>(ptrs[i])[objectSize - 1], static_cast<char>('A' + i % 26));
+  }
+
+  // every object is distinct
+  std::vector<void *> sorted(ptrs);
+  std::sort(sorted.begin(), sorted.end());
+  ASSERT_EQ(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+  // nulls are skipped
+  ptrs.push_back(nullptr);
+  heap->freeBatch(ptrs.data(), ptrs.size());
+
+  // every free went to our own shuffle vectors, so nothing has asked
+  // for a mesh pass and mesh.compact wouldn't flush the empty bins
+  heap->releaseAll();
+  flushEmptyMiniheaps(gheap);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), miniheapCount);
+}
+
+template <size_t PageSize>
+static void batchSizes() {
+  batchImpl<PageSize>(16);
+  batchImpl<PageSize>(100);
+  batchImpl<PageSize>(kMaxSize);
+  // large objects go through the large path one at a time
+  batchImpl<PageSize>(kMaxSize + 1);
+}
+
+TEST(BatchAllocTest, AllocatesAndFreesBatches) {
+  if (getPageSize() == 4096) {
+    batchSizes<4096>();
+  } else {
+    batchSizes<16384>();
+  }
+}
@@ -78,6 +78,34 @@ TEST(BitmapTest, SetAndExchangeAll) {
   }
 }
 
+TEST(BitmapTest, UnsetMask) {
+  const auto maxCount = 256;
+
+  mesh::internal::Bitmap<4096> bitmap{maxCount};
+  bitmap.tryToSet(3);
+  bitmap.tryToSet(64);
+  bitmap.tryToSet(200);
+
+  constexpr size_t wordCount = mesh::bitmap::representationSize(4096 / mesh::kMinObjectSize) / sizeof(size_t);
+  size_t mask[wordCount] = {};
+  size_t wereSet[wordCount];
+  // 3 and 64 are set; 5 isn't
+  mask[0] = (1UL << 3) | (1UL << 5);
+  mask[1] = 1UL;
+  bitmap.unsetMask(mask, wereSet);
+
+  ASSERT_EQ(wereSet[0], 1UL << 3);
+  ASSERT_EQ(wereSet[1], 1UL);
+  for (size_t i = 2; i < wordCount; i++) {
+    ASSERT_EQ(wereSet[i], 0UL);
+  }
+  ASSERT_FALSE(bitmap.isSet(3));
+  ASSERT_FALSE(bitmap.isSet(5));
+  ASSERT_FALSE(bitmap.isSet(64));
+  ASSERT_TRUE(bitmap.isSet(200));
+  ASSERT_EQ(bitmap.inUseCount(), 1UL);
+}
+
 TEST(BitmapTest, SetAll) {
   const auto maxCount = 88;
 
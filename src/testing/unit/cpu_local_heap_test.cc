@@ -0,0 +1,105 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "cpu_local_heap.h"
+#include "internal.h"
+#include "runtime.h"
+
+#include "mallctl_helpers.h"
+
+using namespace mesh;
+
+static constexpr uint32_t StrLen = 128;
+static constexpr size_t ThreadCount = 4;
+static constexpr size_t AllocsPerThread = 1000;
+
+template <size_t PageSize>
+static bool ownedByCpuHeap(GlobalHeap<PageSize> &gheap, void *ptr) {
+  const auto mh = gheap.miniheapFor(ptr);
+  if (mh == nullptr) {
+    return false;
+  }
+  const pid_t current = mh->current();
+  return current <= CpuLocalHeap<PageSize>::OwnerFor(0) &&
+         current > CpuLocalHeap<PageSize>::OwnerFor(kMaxCpuHeaps);
+}
+
+template <size_t PageSize>
+static void cpuLocalHeapImpl() {
+  GlobalHeap<PageSize> &gheap = heapWithoutAutoMesh<PageSize>();
+
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), 0UL);
+
+  std::vector<void *> ptrs[ThreadCount];
+  std::vector<std::thread> threads{};
+  for (size_t i = 0; i < ThreadCount; i++) {
+    threads.emplace_back([&gheap, &ptrs, i]() {
+      for (size_t j = 0; j < AllocsPerThread; j++) {
+        CpuLocalHeap<PageSize> localHeap;
+        void *ptr = localHeap->malloc(StrLen);
+        ASSERT_NE(ptr, nullptr);
+        // objects come from miniheaps attached to a CPU, not a thread
+        ASSERT_TRUE(ownedByCpuHeap(gheap, ptr));
+        memset(ptr, 'A' + i, StrLen);
+        ptrs[i].push_back(ptr);
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+
+  for (size_t i = 0; i < ThreadCount; i++) {
+    ASSERT_EQ(ptrs[i].size(), AllocsPerThread);
+    for (auto ptr : ptrs[i]) {
+      for (size_t k = 0; k < StrLen; k++) {
+        ASSERT_EQ(reinterpret_cast<char *>(ptr)[k], static_cast<char>('A' + i));
+      }
+    }
+  }
+
+  {
+    // re-entering while we hold a CPU heap borrows another one rather
+    // than deadlocking
+    CpuLocalHeap<PageSize> outer;
+    CpuLocalHeap<PageSize> inner;
+    ASSERT_NE(outer.operator->(), inner.operator->());
+
+    void *ptr = inner->malloc(StrLen);
+    ASSERT_TRUE(ownedByCpuHeap(gheap, ptr));
+    outer->free(ptr);
+  }
+
+  {
+    CpuLocalHeap<PageSize> localHeap;
+    for (size_t i = 0; i < ThreadCount; i++) {
+      for (auto ptr : ptrs[i]) {
+        localHeap->free(ptr);
+      }
+    }
+  }
+
+  CpuLocalHeap<PageSize>::ReleaseAll();
+
+  // the now-empty miniheaps are flushed by the next pass
+  compact(gheap);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), 0UL);
+}
+
+TEST(CpuLocalHeapTest, AllocatesPerCpu) {
+  if (getPageSize() == 4096) {
+    cpuLocalHeapImpl<4096>();
+  } else {
+    cpuLocalHeapImpl<16384>();
+  }
+}
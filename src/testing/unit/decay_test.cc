@@ -0,0 +1,82 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "gtest/gtest.h"
+
+#include "decay.h"
+
+using namespace mesh;
+using std::chrono::milliseconds;
+
+TEST(DecayTest, DisabledByDefault) {
+  Decay decay{};
+  ASSERT_FALSE(decay.enabled());
+
+  decay.record(100);
+  ASSERT_EQ(decay.update(time::now() + milliseconds{10000}, 100), 0UL);
+}
+
+TEST(DecayTest, DrainsOverDecayPeriod) {
+  const auto start = time::now();
+  Decay decay{};
+  decay.setDecayMs(1000, start, 0);
+  ASSERT_TRUE(decay.enabled());
+  ASSERT_EQ(decay.epochLength(), milliseconds{1000 / kDecayEpochs});
+
+  const size_t kPages = 1000;
+  decay.record(kPages);
+
+  // nothing happens within an epoch
+  ASSERT_EQ(decay.update(start + milliseconds{50}, kPages), 0UL);
+
+  // pages freed in the last epoch are all allowed to stay
+  size_t remaining = kPages;
+  remaining -= decay.update(start + milliseconds{100}, remaining);
+  ASSERT_EQ(remaining, kPages);
+
+  // after that, a tenth of them leave each epoch
+  for (size_t i = 1; i < kDecayEpochs; i++) {
+    const size_t excess = decay.update(start + decay.epochLength() * (i + 1), remaining);
+    ASSERT_EQ(excess, kPages / kDecayEpochs);
+    remaining -= excess;
+  }
+
+  remaining -= decay.update(start + decay.epochLength() * (kDecayEpochs + 1), remaining);
+  ASSERT_EQ(remaining, 0UL);
+}
+
+TEST(DecayTest, CatchesUpAfterIdle) {
+  const auto start = time::now();
+  Decay decay{};
+  decay.setDecayMs(1000, start, 0);
+
+  decay.record(500);
+  ASSERT_EQ(decay.update(start + milliseconds{100}, 500), 0UL);
+
+  // halfway through the decay period, about half may stay
+  const size_t excess = decay.update(start + milliseconds{600}, 500);
+  ASSERT_EQ(excess, 250UL);
+
+  // long after the decay period, nothing may stay
+  ASSERT_EQ(decay.update(start + milliseconds{60000}, 250), 250UL);
+}
+
+TEST(DecayTest, ReconfigureKeepsCurrentPages) {
+  const auto start = time::now();
+  Decay decay{};
+  decay.setDecayMs(1000, start, 0);
+  decay.record(100);
+
+  // existing pages count as freshly freed under the new period
+  decay.setDecayMs(10000, start, 100);
+  ASSERT_EQ(decay.update(start + milliseconds{1000}, 100), 0UL);
+
+  decay.setDecayMs(0, start, 100);
+  ASSERT_FALSE(decay.enabled());
+  ASSERT_EQ(decay.update(start + milliseconds{60000}, 100), 0UL);
+}
@@ -0,0 +1,85 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <set>
+
+#include "gtest/gtest.h"
+
+#include "internal.h"
+#include "runtime.h"
+
+#include "mallctl_helpers.h"
+
+using namespace mesh;
+
+static constexpr uint32_t StrLen = 128;
+
+template <size_t PageSize>
+static void depotRefillImpl() {
+  const auto tid = gettid();
+  GlobalHeap<PageSize> &gheap = heapWithoutAutoMesh<PageSize>();
+
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), 0UL);
+
+  const int sizeClass = SizeMap::SizeClass(StrLen);
+  FixedArray<MiniHeap<PageSize>, 1> miniheaps{};
+
+  // the first refill takes the size-class lock, and tops up the depot
+  // with spare miniheaps while it is there
+  gheap.refillSmallMiniheaps(sizeClass, StrLen, miniheaps, tid);
+  ASSERT_EQ(miniheaps.size(), 1UL);
+  const size_t depotCount = gheap.getAllocatedMiniheapCount() - 1;
+  ASSERT_GT(depotCount, 1UL);
+  ASSERT_LE(depotCount, kMiniheapDepotCount);
+
+  std::set<MiniHeap<PageSize> *> seen{};
+  seen.insert(miniheaps[0]);
+
+  // fill our miniheap so that it is full when we let go of it
+  MiniHeap<PageSize> *full = miniheaps[0];
+  void *ptrs[PageSize / StrLen];
+  const size_t objCount = full->maxCount();
+  ASSERT_LE(objCount, PageSize / StrLen);
+  for (size_t i = 0; i < objCount; i++) {
+    ptrs[i] = full->mallocAt(gheap.arenaBegin(), i);
+    ASSERT_NE(ptrs[i], nullptr);
+  }
+
+  // the rest come out of the depot, without creating new miniheaps
+  for (size_t i = 0; i < depotCount; i++) {
+    gheap.refillSmallMiniheaps(sizeClass, StrLen, miniheaps, tid);
+    ASSERT_EQ(miniheaps.size(), 1UL);
+    ASSERT_EQ(miniheaps[0]->current(), tid);
+    ASSERT_TRUE(seen.insert(miniheaps[0]).second);
+  }
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), 1 + depotCount);
+
+  // the miniheap we filled was released without the lock, and a free
+  // moves it back onto the partial freelist
+  ASSERT_FALSE(full->isAttached());
+  ASSERT_EQ(full->freelistId(), list::Full);
+  gheap.free(ptrs[0]);
+
+  gheap.releaseMiniheaps(miniheaps);
+  for (size_t i = 1; i < objCount; i++) {
+    gheap.free(ptrs[i]);
+  }
+
+  // meshing returns anything left in the depot, and flushes the
+  // now-empty miniheaps
+  compact(gheap);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), 0UL);
+}
+
+TEST(DepotTest, RefillsFromDepot) {
+  if (getPageSize() == 4096) {
+    depotRefillImpl<4096>();
+  } else {
+    depotRefillImpl<16384>();
+  }
+}
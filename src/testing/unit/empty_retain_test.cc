@@ -0,0 +1,78 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "gtest/gtest.h"
+
+#include "internal.h"
+#include "runtime.h"
+
+#include "mallctl_helpers.h"
+
+using namespace mesh;
+
+static constexpr uint32_t StrLen = 128;
+
+template <size_t PageSize>
+static void flushBin(GlobalHeap<PageSize> &gheap, int sizeClass) {
+  gheap.lock();
+  gheap.flushBinLocked(sizeClass);
+  gheap.unlock();
+}
+
+template <size_t PageSize>
+static void emptyRetainImpl() {
+  const auto tid = gettid();
+  GlobalHeap<PageSize> &gheap = heapWithoutAutoMesh<PageSize>();
+
+  const int sizeClass = SizeMap::SizeClass(StrLen);
+  ASSERT_EQ(getStat(gheap, "stats.empty_bytes"), 0UL);
+
+  FixedArray<MiniHeap<PageSize>, 2> miniheaps{};
+  gheap.allocSmallMiniheaps(sizeClass, StrLen, miniheaps, tid);
+  ASSERT_EQ(miniheaps.size(), 2UL);
+  MiniHeap<PageSize> *second = miniheaps[1];
+  const size_t spanSize = second->spanSize();
+  const size_t miniheapCount = gheap.getAllocatedMiniheapCount();
+
+  // a budget of one span per size class
+  const size_t oldRetain = setKnob(gheap, "mesh.empty_retain_bytes", spanSize);
+
+  gheap.releaseMiniheaps(miniheaps);
+  ASSERT_EQ(getStat(gheap, "stats.empty_bytes"), 2 * spanSize);
+
+  // flushing keeps the most recently emptied miniheap
+  flushBin(gheap, sizeClass);
+  ASSERT_EQ(getStat(gheap, "stats.empty_bytes"), spanSize);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), miniheapCount - 1);
+
+  // which the next refill hands out as is
+  FixedArray<MiniHeap<PageSize>, 1> reused{};
+  gheap.allocSmallMiniheaps(sizeClass, StrLen, reused, tid);
+  ASSERT_EQ(reused.size(), 1UL);
+  ASSERT_EQ(reused[0], second);
+  ASSERT_EQ(getStat(gheap, "stats.empty_bytes"), 0UL);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), miniheapCount - 1);
+
+  gheap.releaseMiniheaps(reused);
+
+  // with no budget, flushing returns everything to the arena
+  setKnob(gheap, "mesh.empty_retain_bytes", oldRetain);
+  flushBin(gheap, sizeClass);
+  ASSERT_EQ(getStat(gheap, "stats.empty_bytes"), 0UL);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), miniheapCount - 2);
+
+  gheap.setMeshPeriodMs(kMeshPeriodMs);
+}
+
+TEST(EmptyRetainTest, KeepsRecentlyEmptiedMiniheaps) {
+  if (getPageSize() == 4096) {
+    emptyRetainImpl<4096>();
+  } else {
+    emptyRetainImpl<16384>();
+  }
+}
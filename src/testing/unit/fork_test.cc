@@ -0,0 +1,88 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+#include "internal.h"
+#include "runtime.h"
+
+#include "mallctl_helpers.h"
+
+using namespace mesh;
+
+static constexpr uint32_t StrLen = 128;
+
+template <size_t PageSize>
+static void forkImpl() {
+  if (!kMeshingEnabled) {
+    GTEST_SKIP();
+  }
+
+  const uint32_t ObjCount = std::min(static_cast<uint32_t>(PageSize / StrLen), 1024U);
+
+  const auto tid = gettid();
+  GlobalHeap<PageSize> &gheap = heapWithoutAutoMesh<PageSize>();
+
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), 0UL);
+
+  FixedArray<MiniHeap<PageSize>, 2> array{};
+  gheap.allocSmallMiniheaps(SizeMap::SizeClass(StrLen), StrLen, array, tid);
+  ASSERT_EQ(array.size(), 2UL);
+  MiniHeap<PageSize> *mh1 = array[0];
+  MiniHeap<PageSize> *mh2 = array[1];
+
+  char *s1 = reinterpret_cast<char *>(mh1->mallocAt(gheap.arenaBegin(), 0));
+  char *s2 = reinterpret_cast<char *>(mh2->mallocAt(gheap.arenaBegin(), ObjCount - 1));
+  memset(s1, 'A', StrLen);
+  memset(s2, 'Z', StrLen);
+  gheap.releaseMiniheaps(array);
+
+  gheap.meshLocked(mh1, mh2);
+
+  const size_t forkCount = getStat(gheap, "stats.fork_count");
+
+  const pid_t pid = fork();
+  ASSERT_NE(pid, -1);
+  if (pid == 0) {
+    // the child has a fresh copy of the arena: both the plain and the
+    // meshed span have to still show the objects, and still alias.
+    bool ok = s1[0] == 'A' && s1[StrLen - 1] == 'A' && s2[0] == 'Z' && s2[StrLen - 1] == 'Z';
+    char *alias = s1 + (ObjCount - 1) * StrLen;
+    s2[0] = 'b';
+    ok = ok && alias[0] == 'b';
+    _exit(ok ? 0 : 1);
+  }
+
+  int status = 0;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(WEXITSTATUS(status), 0);
+
+  // the child's writes went to its own copy
+  ASSERT_EQ(s2[0], 'Z');
+
+  ASSERT_EQ(getStat(gheap, "stats.fork_count"), forkCount + 1);
+  ASSERT_GE(getStat(gheap, "stats.fork_max_us"), getStat(gheap, "stats.fork_us") / (forkCount + 1));
+
+  gheap.free(s1);
+  gheap.free(s2);
+
+  // the now-empty miniheap is flushed by the next pass
+  compact(gheap);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), 0UL);
+}
+
+TEST(ForkTest, ChildSeesMeshedArena) {
+  if (getPageSize() == 4096) {
+    forkImpl<4096>();
+  } else {
+    forkImpl<16384>();
+  }
+}
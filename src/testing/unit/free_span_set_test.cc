@@ -0,0 +1,162 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "gtest/gtest.h"
+
+#include "free_span_set.h"
+
+using namespace mesh;
+
+TEST(FreeSpanSetTest, TakesBestFit) {
+  FreeSpanSet spans{};
+  Span result(0, 0);
+
+  ASSERT_FALSE(spans.take(1, result));
+
+  spans.add(Span(100, 8));
+  spans.add(Span(0, 2));
+  spans.add(Span(50, 4));
+  spans.add(Span(200, 4));
+  ASSERT_EQ(spans.size(), 4UL);
+  ASSERT_EQ(spans.pageCount(), 18UL);
+
+  // the smallest span that fits, lowest address first on a tie
+  ASSERT_TRUE(spans.take(3, result));
+  ASSERT_EQ(result.offset, 50UL);
+  ASSERT_EQ(result.length, 3UL);
+  ASSERT_EQ(spans.pageCount(), 15UL);
+
+  // the leftover page is still free
+  ASSERT_TRUE(spans.take(1, result));
+  ASSERT_EQ(result.offset, 53UL);
+  ASSERT_EQ(result.length, 1UL);
+
+  ASSERT_TRUE(spans.take(5, result));
+  ASSERT_EQ(result.offset, 100UL);
+  ASSERT_FALSE(spans.take(5, result));
+  ASSERT_EQ(spans.pageCount(), 9UL);
+}
+
+TEST(FreeSpanSetTest, CoalescesNeighbours) {
+  FreeSpanSet spans{};
+  Span result(0, 0);
+
+  spans.add(Span(0, 4));
+  spans.add(Span(8, 4));
+  ASSERT_EQ(spans.size(), 2UL);
+  ASSERT_FALSE(spans.take(5, result));
+
+  // filling the hole merges all three into one span
+  spans.add(Span(4, 4));
+  ASSERT_EQ(spans.size(), 1UL);
+  ASSERT_EQ(spans.pageCount(), 12UL);
+
+  ASSERT_TRUE(spans.take(12, result));
+  ASSERT_EQ(result.offset, 0UL);
+  ASSERT_EQ(result.length, 12UL);
+  ASSERT_TRUE(spans.empty());
+}
+
+TEST(FreeSpanSetTest, BoundedCoalescing) {
+  FreeSpanSet spans{};
+
+  // two adjacent 8-page chunks must stay separate
+  spans.add(Span(0, 4), 0, 8);
+  spans.add(Span(8, 4), 8, 16);
+  spans.add(Span(4, 4), 0, 8);
+  ASSERT_EQ(spans.size(), 2UL);
+
+  spans.add(Span(12, 4), 8, 16);
+  ASSERT_EQ(spans.size(), 2UL);
+
+  size_t seen = 0;
+  spans.forEach([&](const Span &span) {
+    ASSERT_EQ(span.offset, seen * 8);
+    ASSERT_EQ(span.length, 8UL);
+    seen++;
+  });
+  ASSERT_EQ(seen, 2UL);
+
+  spans.removeRange(0, 8);
+  ASSERT_EQ(spans.size(), 1UL);
+  ASSERT_EQ(spans.pageCount(), 8UL);
+}
+
+TEST(FreeSpanSetTest, ManySpans) {
+  FreeSpanSet spans{};
+  Span result(0, 0);
+
+  // every other page free: nothing coalesces
+  constexpr size_t kCount = 10000;
+  for (size_t i = 0; i < kCount; i++) {
+    spans.add(Span(i * 2, 1));
+  }
+  ASSERT_EQ(spans.size(), kCount);
+  ASSERT_FALSE(spans.take(2, result));
+
+  // freeing the pages in between leaves a single span
+  for (size_t i = 0; i < kCount - 1; i++) {
+    spans.add(Span(i * 2 + 1, 1));
+  }
+  ASSERT_EQ(spans.size(), 1UL);
+  ASSERT_TRUE(spans.take(kCount * 2 - 1, result));
+  ASSERT_EQ(result.offset, 0UL);
+  ASSERT_TRUE(spans.empty());
+}
+
+TEST(FreeSpanSetTest, PopsInAddressOrder) {
+  FreeSpanSet spans{};
+  Span result(0, 0);
+
+  spans.add(Span(40, 2));
+  spans.add(Span(10, 8));
+  spans.add(Span(20, 1));
+
+  ASSERT_TRUE(spans.pop(result));
+  ASSERT_EQ(result.offset, 10UL);
+  ASSERT_EQ(result.length, 8UL);
+  ASSERT_EQ(spans.pageCount(), 3UL);
+
+  ASSERT_TRUE(spans.pop(result));
+  ASSERT_EQ(result.offset, 20UL);
+  ASSERT_TRUE(spans.pop(result));
+  ASSERT_EQ(result.offset, 40UL);
+
+  ASSERT_FALSE(spans.pop(result));
+  ASSERT_TRUE(spans.empty());
+}
+
+TEST(FreeSpanSetTest, KeepsNodesApart) {
+  NodeSpanSets spans{};
+  Span result(0, 0);
+  size_t node = 0;
+
+  ASSERT_TRUE(spans.empty());
+  ASSERT_FALSE(spans.pop(result, node));
+
+  // adjacent, but on different nodes
+  spans[1].add(Span(0, 4));
+  spans[0].add(Span(4, 4));
+  ASSERT_EQ(spans.pageCount(), 8UL);
+  ASSERT_EQ(spans[0].size(), 1UL);
+  ASSERT_EQ(spans[1].size(), 1UL);
+
+  ASSERT_FALSE(spans[0].take(8, result));
+  ASSERT_TRUE(spans[1].take(2, result));
+  ASSERT_EQ(result.offset, 0UL);
+  ASSERT_EQ(spans.pageCount(), 6UL);
+
+  // node by node
+  ASSERT_TRUE(spans.pop(result, node));
+  ASSERT_EQ(node, 0UL);
+  ASSERT_EQ(result.offset, 4UL);
+  ASSERT_TRUE(spans.pop(result, node));
+  ASSERT_EQ(node, 1UL);
+  ASSERT_EQ(result.offset, 2UL);
+  ASSERT_TRUE(spans.empty());
+}
@@ -0,0 +1,121 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <set>
+
+#include "gtest/gtest.h"
+
+#include "internal.h"
+#include "meshing.h"
+#include "runtime.h"
+
+#include "mallctl_helpers.h"
+
+using namespace mesh;
+
+static constexpr uint32_t StrLen = 128;
+static constexpr size_t MiniheapCount = 8;
+
+template <size_t PageSize>
+static void greedyMeshImpl() {
+  if (!kMeshingEnabled) {
+    GTEST_SKIP();
+  }
+
+  const uint32_t ObjCount = std::min(static_cast<uint32_t>(PageSize / StrLen), 1024U);
+  ASSERT_GE(ObjCount, 2 * MiniheapCount);
+
+  const auto tid = gettid();
+  GlobalHeap<PageSize> &gheap = heapWithoutAutoMesh<PageSize>();
+
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), 0UL);
+
+  // unknown algorithms are rejected
+  size_t unused = 0;
+  size_t unusedLen = sizeof(unused);
+  size_t bogus = algorithm::Max;
+  ASSERT_EQ(gheap.mallctl("mesh.algorithm", &unused, &unusedLen, &bogus, sizeof(bogus)), -1);
+
+  const size_t oldAlgorithm = setKnob(gheap, "mesh.algorithm", algorithm::Greedy);
+  ASSERT_EQ(getStat(gheap, "mesh.algorithm"), algorithm::Greedy);
+
+  const size_t passesBefore = getStat(gheap, "stats.greedy_mesh_passes");
+  const size_t pagesBefore = getStat(gheap, "stats.greedy_mesh_pages_freed");
+
+  const int sizeClass = SizeMap::SizeClass(StrLen);
+  FixedArray<MiniHeap<PageSize>, MiniheapCount> miniheaps{};
+  char *strs[MiniheapCount][2];
+  size_t pagesPerSpan = 0;
+
+  // the first half of the miniheaps have two objects and the second
+  // half one, all at distinct offsets, so every pair is meshable and
+  // greedy matching pairs each fuller span with an emptier one
+  for (size_t i = 0; i < MiniheapCount; i++) {
+    FixedArray<MiniHeap<PageSize>, 1> array{};
+    gheap.allocSmallMiniheaps(sizeClass, StrLen, array, tid);
+    MiniHeap<PageSize> *mh = array[0];
+    array.clear();
+    miniheaps.append(mh);
+    pagesPerSpan = mh->spanSize() / PageSize;
+
+    const size_t objCount = i < MiniheapCount / 2 ? 2 : 1;
+    for (size_t j = 0; j < 2; j++) {
+      strs[i][j] = nullptr;
+      if (j < objCount) {
+        strs[i][j] = reinterpret_cast<char *>(mh->mallocAt(gheap.arenaBegin(), 2 * i + j));
+        ASSERT_NE(strs[i][j], nullptr);
+        memset(strs[i][j], 'A' + i, StrLen);
+      }
+    }
+  }
+
+  // an extra object we free through the global heap, which marks the
+  // heap as worth meshing
+  char *extra = reinterpret_cast<char *>(miniheaps[0]->mallocAt(gheap.arenaBegin(), ObjCount - 1));
+  ASSERT_NE(extra, nullptr);
+
+  // detach the miniheaps so that they land on the partial freelist
+  gheap.releaseMiniheaps(miniheaps);
+  gheap.free(extra);
+
+  compact(gheap);
+
+  std::set<MiniHeap<PageSize> *> owners{};
+  for (size_t i = 0; i < MiniheapCount; i++) {
+    for (size_t j = 0; j < 2 && strs[i][j] != nullptr; j++) {
+      for (size_t k = 0; k < StrLen; k++) {
+        ASSERT_EQ(strs[i][j][k], static_cast<char>('A' + i));
+      }
+      owners.insert(gheap.miniheapFor(strs[i][j]));
+    }
+  }
+  ASSERT_EQ(owners.size(), MiniheapCount / 2);
+
+  ASSERT_EQ(getStat(gheap, "stats.greedy_mesh_passes"), passesBefore + 1);
+  ASSERT_EQ(getStat(gheap, "stats.greedy_mesh_pages_freed"), pagesBefore + MiniheapCount / 2 * pagesPerSpan);
+
+  for (size_t i = 0; i < MiniheapCount; i++) {
+    for (size_t j = 0; j < 2 && strs[i][j] != nullptr; j++) {
+      gheap.free(strs[i][j]);
+    }
+  }
+
+  // the now-empty miniheaps are flushed by the next pass
+  compact(gheap);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), 0UL);
+
+  setKnob(gheap, "mesh.algorithm", oldAlgorithm);
+}
+
+TEST(GreedyMeshTest, MeshesFullestWithEmptiest) {
+  if (getPageSize() == 4096) {
+    greedyMeshImpl<4096>();
+  } else {
+    greedyMeshImpl<16384>();
+  }
+}
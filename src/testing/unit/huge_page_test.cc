@@ -0,0 +1,81 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "gtest/gtest.h"
+
+#include "internal.h"
+#include "runtime.h"
+
+#include "mallctl_helpers.h"
+
+using namespace mesh;
+
+static constexpr uint32_t StrLen = 128;
+
+template <size_t PageSize>
+static void hugePageImpl() {
+  const auto tid = gettid();
+  GlobalHeap<PageSize> &gheap = heapWithoutAutoMesh<PageSize>();
+
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), 0UL);
+  ASSERT_EQ(getStat(gheap, "stats.huge_bytes"), 0UL);
+
+  const size_t oldHugePages = setKnob(gheap, "mesh.huge_pages", 1);
+  ASSERT_EQ(getStat(gheap, "mesh.huge_pages"), 1UL);
+
+  const int sizeClass = SizeMap::SizeClass(StrLen);
+
+  // with no sparse spans around, the size class counts as dense and
+  // its new span is packed into a hugepage chunk
+  FixedArray<MiniHeap<PageSize>, 1> dense{};
+  gheap.allocSmallMiniheaps(sizeClass, StrLen, dense, tid);
+  ASSERT_EQ(dense.size(), 1UL);
+  MiniHeap<PageSize> *hugeMh = dense[0];
+  ASSERT_TRUE(hugeMh->isHuge());
+  ASSERT_TRUE(gheap.isHugeOffset(hugeMh->span().offset));
+  ASSERT_EQ(getStat(gheap, "stats.huge_bytes"), hugeMh->spanSize());
+  ASSERT_GE(getStat(gheap, "stats.span_bytes"), hugeMh->spanSize());
+
+  void *ptr = hugeMh->mallocAt(gheap.arenaBegin(), 0);
+  ASSERT_NE(ptr, nullptr);
+  ASSERT_EQ(gheap.miniheapFor(ptr), hugeMh);
+
+  // once released, a nearly-empty hugepage span is still not meshable
+  gheap.releaseMiniheaps(dense);
+  ASSERT_FALSE(hugeMh->isMeshingCandidate());
+  ASSERT_TRUE(gheap.meshingCandidatesLocked(sizeClass).empty());
+
+  // but it makes the size class sparse, so further new spans stay on
+  // the meshable region
+  FixedArray<MiniHeap<PageSize>, 2> sparse{};
+  gheap.allocSmallMiniheaps(sizeClass, StrLen, sparse, tid);
+  ASSERT_EQ(sparse.size(), 2UL);
+  ASSERT_EQ(sparse[0], hugeMh);
+  ASSERT_FALSE(sparse[1]->isHuge());
+  ASSERT_FALSE(gheap.isHugeOffset(sparse[1]->span().offset));
+  ASSERT_EQ(getStat(gheap, "stats.huge_bytes"), hugeMh->spanSize());
+
+  gheap.releaseMiniheaps(sparse);
+  gheap.free(ptr);
+
+  // the now-empty miniheaps are flushed by the next pass, returning
+  // the hugepage chunk to the arena
+  compact(gheap);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), 0UL);
+  ASSERT_EQ(getStat(gheap, "stats.huge_bytes"), 0UL);
+
+  setKnob(gheap, "mesh.huge_pages", oldHugePages);
+}
+
+TEST(HugePageTest, DenseSpansUseHugePages) {
+  if (getPageSize() == 4096) {
+    hugePageImpl<4096>();
+  } else {
+    hugePageImpl<16384>();
+  }
+}
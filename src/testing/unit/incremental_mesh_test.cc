@@ -0,0 +1,132 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <set>
+
+#include "gtest/gtest.h"
+
+#include "internal.h"
+#include "meshing.h"
+#include "runtime.h"
+
+#include "mallctl_helpers.h"
+
+using namespace mesh;
+
+static constexpr uint32_t StrLen = 128;
+static constexpr size_t MiniheapCount = 8;
+
+template <size_t PageSize>
+static void incrementalMeshImpl() {
+  if (!kMeshingEnabled) {
+    GTEST_SKIP();
+  }
+
+  const uint32_t ObjCount = std::min(static_cast<uint32_t>(PageSize / StrLen), 1024U);
+  ASSERT_GE(ObjCount, MiniheapCount + 1);
+
+  const auto tid = gettid();
+  GlobalHeap<PageSize> &gheap = heapWithoutAutoMesh<PageSize>();
+
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), 0UL);
+
+  // a zero pause budget means every slice meshes a single pair before
+  // dropping its locks
+  const size_t oldIncremental = setKnob(gheap, "mesh.incremental", 1);
+  const size_t oldMaxPause = setKnob(gheap, "mesh.max_pause_us", 0);
+  ASSERT_EQ(getStat(gheap, "mesh.incremental"), 1UL);
+
+  const int sizeClass = SizeMap::SizeClass(StrLen);
+  FixedArray<MiniHeap<PageSize>, MiniheapCount> miniheaps{};
+  char *strs[MiniheapCount];
+  char *expected[MiniheapCount];
+
+  // every miniheap gets a single object at a distinct offset, so all
+  // of them are pairwise meshable
+  for (size_t i = 0; i < MiniheapCount; i++) {
+    FixedArray<MiniHeap<PageSize>, 1> array{};
+    gheap.allocSmallMiniheaps(sizeClass, StrLen, array, tid);
+    MiniHeap<PageSize> *mh = array[0];
+    array.clear();
+    miniheaps.append(mh);
+
+    strs[i] = reinterpret_cast<char *>(mh->mallocAt(gheap.arenaBegin(), i));
+    ASSERT_NE(strs[i], nullptr);
+    memset(strs[i], 'A' + i, StrLen);
+    strs[i][StrLen - 1] = 0;
+    expected[i] = strdup(strs[i]);
+  }
+
+  // an extra object we free through the global heap, which marks the
+  // heap as worth meshing
+  char *extra = reinterpret_cast<char *>(miniheaps[0]->mallocAt(gheap.arenaBegin(), ObjCount - 1));
+  ASSERT_NE(extra, nullptr);
+
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), MiniheapCount);
+
+  // detach the miniheaps so that they land on the partial freelist
+  gheap.releaseMiniheaps(miniheaps);
+  gheap.free(extra);
+
+  compact(gheap);
+
+  std::set<MiniHeap<PageSize> *> owners{};
+  for (size_t i = 0; i < MiniheapCount; i++) {
+    ASSERT_STREQ(strs[i], expected[i]);
+    owners.insert(gheap.miniheapFor(strs[i]));
+  }
+  // each slice meshed one pair, halving the number of physical spans
+  ASSERT_EQ(owners.size(), MiniheapCount / 2);
+
+  for (size_t i = 0; i < MiniheapCount; i++) {
+    gheap.free(strs[i]);
+    ::free(expected[i]);
+  }
+
+  // the now-empty miniheaps are flushed by the next pass
+  compact(gheap);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), 0UL);
+
+  setKnob(gheap, "mesh.max_pause_us", oldMaxPause);
+  setKnob(gheap, "mesh.incremental", oldIncremental);
+}
+
+TEST(IncrementalMeshTest, MeshesInSlices) {
+  if (getPageSize() == 4096) {
+    incrementalMeshImpl<4096>();
+  } else {
+    incrementalMeshImpl<16384>();
+  }
+}
+
+template <size_t PageSize>
+static void maxPauseImpl() {
+  if (!kMeshingEnabled) {
+    GTEST_SKIP();
+  }
+
+  GlobalHeap<PageSize> &gheap = runtime<PageSize>().heap();
+
+  const size_t before = getStat(gheap, "stats.max_mesh_pause_us");
+  compact(gheap);
+  // the reported pause is a high-water mark
+  ASSERT_GE(getStat(gheap, "stats.max_mesh_pause_us"), before);
+
+  const size_t oldIncremental = setKnob(gheap, "mesh.incremental", 1);
+  compact(gheap);
+  ASSERT_GE(getStat(gheap, "stats.max_mesh_pause_us"), before);
+  setKnob(gheap, "mesh.incremental", oldIncremental);
+}
+
+TEST(IncrementalMeshTest, ReportsMaxPause) {
+  if (getPageSize() == 4096) {
+    maxPauseImpl<4096>();
+  } else {
+    maxPauseImpl<16384>();
+  }
+}
@@ -0,0 +1,156 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "internal.h"
+#include "runtime.h"
+#include "thread_local_heap.h"
+
+#include "mallctl_helpers.h"
+
+using namespace mesh;
+
+template <size_t PageSize>
+static void largeCacheImpl() {
+  GlobalHeap<PageSize> &gheap = heapWithoutAutoMesh<PageSize>();
+  auto heap = ThreadLocalHeap<PageSize>::GetHeap();
+
+  // start from an empty cache
+  heap->releaseAll();
+
+  const size_t LargeSize = kMaxSize + 1;
+  ASSERT_LE(PageCount(LargeSize) * PageSize, kMaxFastLargeSize);
+
+  const size_t hits = getStat(gheap, "stats.large_cache_hits");
+  const size_t misses = getStat(gheap, "stats.large_cache_misses");
+  const size_t miniheapCount = gheap.getAllocatedMiniheapCount();
+
+  void *ptr = heap->malloc(LargeSize);
+  ASSERT_NE(ptr, nullptr);
+  memset(ptr, 'A', LargeSize);
+  ASSERT_EQ(getStat(gheap, "stats.large_cache_misses"), misses + 1);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), miniheapCount + 1);
+
+  // the freed span stays with this thread, still backed by its miniheap
+  heap->free(ptr);
+  ASSERT_EQ(getStat(gheap, "stats.large_cached_bytes"), PageCount(LargeSize) * PageSize);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), miniheapCount + 1);
+
+  // and is handed back out to the next allocation with that page count
+  void *reused = heap->malloc(LargeSize);
+  ASSERT_EQ(reused, ptr);
+  ASSERT_EQ(getStat(gheap, "stats.large_cache_hits"), hits + 1);
+  ASSERT_EQ(getStat(gheap, "stats.large_cached_bytes"), 0UL);
+  ASSERT_EQ(heap->getSize(reused), PageCount(LargeSize) * PageSize);
+
+  // allocations bigger than kMaxFastLargeSize bypass the cache
+  void *big = heap->malloc(kMaxFastLargeSize + 1);
+  heap->free(big);
+  ASSERT_EQ(getStat(gheap, "stats.large_cached_bytes"), 0UL);
+  ASSERT_EQ(getStat(gheap, "stats.large_cache_misses"), misses + 1);
+
+  // as does everything once the per-thread budget is zero
+  const size_t oldBudget = setKnob(gheap, "mesh.large_cache_bytes", 0);
+  heap->free(reused);
+  ASSERT_EQ(getStat(gheap, "stats.large_cached_bytes"), 0UL);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), miniheapCount);
+  setKnob(gheap, "mesh.large_cache_bytes", oldBudget);
+
+  // releasing the heap's miniheaps empties the cache too
+  ptr = heap->malloc(LargeSize);
+  heap->free(ptr);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), miniheapCount + 1);
+  heap->releaseAll();
+  ASSERT_EQ(getStat(gheap, "stats.large_cached_bytes"), 0UL);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), miniheapCount);
+}
+
+TEST(LargeCacheTest, ReusesFreedSpans) {
+  if (getPageSize() == 4096) {
+    largeCacheImpl<4096>();
+  } else {
+    largeCacheImpl<16384>();
+  }
+}
+
+template <size_t PageSize>
+static void largeCacheCompactImpl() {
+  GlobalHeap<PageSize> &gheap = heapWithoutAutoMesh<PageSize>();
+  auto heap = ThreadLocalHeap<PageSize>::GetHeap();
+  heap->releaseAll();
+
+  const size_t LargeSize = kMaxSize + 1;
+  const size_t miniheapCount = gheap.getAllocatedMiniheapCount();
+
+  void *ptr = heap->malloc(LargeSize);
+  heap->free(ptr);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), miniheapCount + 1);
+
+  // the global heap can't see this thread's cache, so compacting
+  // through the runtime flushes it first
+  size_t unused = 0;
+  size_t len = sizeof(unused);
+  ASSERT_EQ(runtime<PageSize>().mallctl("mesh.compact", &unused, &len, nullptr, 0), 0);
+  ASSERT_EQ(getStat(gheap, "stats.large_cached_bytes"), 0UL);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), miniheapCount);
+
+  ptr = heap->malloc(LargeSize);
+  heap->free(ptr);
+  ASSERT_EQ(runtime<PageSize>().mallctl("mesh.scavenge", &unused, &len, nullptr, 0), 0);
+  ASSERT_EQ(getStat(gheap, "stats.large_cached_bytes"), 0UL);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), miniheapCount);
+}
+
+TEST(LargeCacheTest, CompactFlushesCache) {
+  if (getPageSize() == 4096) {
+    largeCacheCompactImpl<4096>();
+  } else {
+    largeCacheCompactImpl<16384>();
+  }
+}
+
+template <size_t PageSize>
+static void largeCacheIdleImpl() {
+  GlobalHeap<PageSize> &gheap = heapWithoutAutoMesh<PageSize>();
+  auto heap = ThreadLocalHeap<PageSize>::GetHeap();
+  heap->releaseAll();
+
+  const size_t LargeSize = kMaxSize + 1;
+  const size_t OtherSize = LargeSize + PageSize;
+  ASSERT_LE(PageCount(OtherSize) * PageSize, kMaxFastLargeSize);
+  const size_t miniheapCount = gheap.getAllocatedMiniheapCount();
+
+  void *ptr = heap->malloc(LargeSize);
+  heap->free(ptr);
+  ASSERT_EQ(getStat(gheap, "stats.large_cached_bytes"), PageCount(LargeSize) * PageSize);
+
+  // a cache miss for another page count is what sweeps the cache, and
+  // a span is only released once a whole sweep interval has passed
+  // without its page count being used
+  for (size_t i = 0; i < 2; i++) {
+    std::this_thread::sleep_for(kLargeCacheIdleInterval + std::chrono::milliseconds{100});
+    void *other = heap->malloc(OtherSize);
+    ASSERT_NE(other, nullptr);
+    gheap.free(other);
+  }
+
+  ASSERT_EQ(getStat(gheap, "stats.large_cached_bytes"), 0UL);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), miniheapCount);
+}
+
+TEST(LargeCacheTest, ReleasesIdleSpans) {
+  if (getPageSize() == 4096) {
+    largeCacheIdleImpl<4096>();
+  } else {
+    largeCacheIdleImpl<16384>();
+  }
+}
@@ -0,0 +1,73 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#pragma once
+#ifndef MESH_TESTING_UNIT_MALLCTL_HELPERS_H
+#define MESH_TESTING_UNIT_MALLCTL_HELPERS_H
+
+#include <stddef.h>
+
+#include "gtest/gtest.h"
+
+#include "runtime.h"
+
+// helpers shared by the unit tests for poking the global heap, mostly
+// through its mallctl interface.  All of the knobs and stats are size_t.
+
+// the runtime's global heap, with automatic meshing disabled so that
+// tests only mesh when they ask to
+template <size_t PageSize>
+static mesh::GlobalHeap<PageSize> &heapWithoutAutoMesh() {
+  mesh::GlobalHeap<PageSize> &gheap = mesh::runtime<PageSize>().heap();
+  gheap.setMeshPeriodMs(mesh::kZeroMs);
+  return gheap;
+}
+
+// returns the mallctl's result, for tests that expect it to fail
+template <size_t PageSize>
+static int readMallctl(mesh::GlobalHeap<PageSize> &gheap, const char *name, size_t &val) {
+  size_t len = sizeof(val);
+  return gheap.mallctl(name, &val, &len, nullptr, 0);
+}
+
+template <size_t PageSize>
+static size_t getStat(mesh::GlobalHeap<PageSize> &gheap, const char *name) {
+  size_t val = 0;
+  EXPECT_EQ(readMallctl(gheap, name, val), 0);
+  return val;
+}
+
+// sets a knob, returning its old value
+template <size_t PageSize>
+static size_t setKnob(mesh::GlobalHeap<PageSize> &gheap, const char *name, size_t value) {
+  size_t old = 0;
+  size_t oldLen = sizeof(old);
+  EXPECT_EQ(gheap.mallctl(name, &old, &oldLen, &value, sizeof(value)), 0);
+  return old;
+}
+
+template <size_t PageSize>
+static void compact(mesh::GlobalHeap<PageSize> &gheap) {
+  size_t unused = 0;
+  size_t len = sizeof(unused);
+  ASSERT_EQ(gheap.mallctl("mesh.compact", &unused, &len, nullptr, 0), 0);
+}
+
+// hands every depot and empty miniheap back to the arena.  Unlike
+// mesh.compact, this doesn't depend on the last mesh pass having been
+// worthwhile, so tests that never free remotely can use it to get back
+// to where they started.
+template <size_t PageSize>
+static void flushEmptyMiniheaps(mesh::GlobalHeap<PageSize> &gheap) {
+  gheap.lock();
+  for (int sizeClass = 0; sizeClass < mesh::kNumBins; sizeClass++) {
+    gheap.drainDepotLocked(sizeClass);
+    gheap.drainPendingPartialLocked(sizeClass);
+    gheap.flushBinLocked(sizeClass, false);
+  }
+  gheap.unlock();
+}
+
+#endif  // MESH_TESTING_UNIT_MALLCTL_HELPERS_H
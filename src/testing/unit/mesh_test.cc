@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <thread>
+
 #include "gtest/gtest.h"
 
 #include "internal.h"
@@ -151,3 +153,305 @@ TEST(MeshTest, TryMesh) {
 TEST(MeshTest, TryMeshInverse) {
   meshTest(true);
 }
+
+template <size_t PageSize>
+static size_t meshSyscalls(GlobalHeap<PageSize> &gheap) {
+  size_t val = 0;
+  size_t len = sizeof(val);
+  EXPECT_EQ(gheap.mallctl("stats.mesh_syscalls", &val, &len, nullptr, 0), 0);
+  return val;
+}
+
+template <size_t PageSize>
+static void batchedMeshImpl() {
+  if (!kMeshingEnabled) {
+    GTEST_SKIP();
+  }
+
+  constexpr size_t PairCount = 2;
+  const uint32_t ObjCount = std::min(static_cast<uint32_t>(PageSize / StrLen), 1024U);
+
+  const auto tid = gettid();
+  GlobalHeap<PageSize> &gheap = runtime<PageSize>().heap();
+
+  // disable automatic meshing for this test
+  gheap.setMeshPeriodMs(kZeroMs);
+
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), 0UL);
+
+  FixedArray<MiniHeap<PageSize>, 2 * PairCount> array{};
+  gheap.allocSmallMiniheaps(SizeMap::SizeClass(StrLen), StrLen, array, tid);
+  ASSERT_EQ(array.size(), 2 * PairCount);
+
+  // the first half of the miniheaps are kept, and the second half are
+  // meshed into them
+  MiniHeap<PageSize> *mhs[2 * PairCount];
+  char *strs[2 * PairCount];
+  for (size_t i = 0; i < 2 * PairCount; i++) {
+    mhs[i] = array[i];
+    const size_t off = i < PairCount ? 0 : ObjCount - 1;
+    strs[i] = reinterpret_cast<char *>(mhs[i]->mallocAt(gheap.arenaBegin(), off));
+    ASSERT_NE(strs[i], nullptr);
+    memset(strs[i], 'A' + i, StrLen);
+    strs[i][StrLen - 1] = 0;
+  }
+  gheap.releaseMiniheaps(array);
+
+  std::pair<MiniHeap<PageSize> *, MiniHeap<PageSize> *> pairs[PairCount];
+  for (size_t i = 0; i < PairCount; i++) {
+    pairs[i] = {mhs[i], mhs[PairCount + i]};
+  }
+
+  auto adjacent = [](const MiniHeap<PageSize> *a, const MiniHeap<PageSize> *b) {
+    return a->span().offset + a->span().length == b->span().offset;
+  };
+  const bool coalescable = adjacent(mhs[0], mhs[1]) && adjacent(mhs[2], mhs[3]);
+
+  const size_t syscallsBefore = meshSyscalls(gheap);
+  gheap.meshLocked(pairs, PairCount);
+  const size_t syscalls = meshSyscalls(gheap) - syscallsBefore;
+
+  // an mprotect, remap and hole punch per run of adjacent spans
+  ASSERT_LE(syscalls, 3 * PairCount);
+  if (coalescable) {
+    ASSERT_EQ(syscalls, 3UL);
+  }
+
+  for (size_t i = 0; i < PairCount; i++) {
+    ASSERT_EQ(mhs[i]->meshCount(), 2UL);
+    ASSERT_EQ(mhs[i]->inUseCount(), 2UL);
+    ASSERT_EQ(gheap.miniheapFor(strs[PairCount + i]), mhs[i]);
+
+    // the src objects are now aliases of objects in dst's span
+    char *alias = strs[i] + (ObjCount - 1) * StrLen;
+    ASSERT_EQ(alias[0], static_cast<char>('A' + PairCount + i));
+    strs[PairCount + i][0] = 'z';
+    ASSERT_EQ(alias[0], 'z');
+    ASSERT_EQ(strs[i][0], static_cast<char>('A' + i));
+  }
+
+  for (size_t i = 0; i < 2 * PairCount; i++) {
+    gheap.free(strs[i]);
+  }
+
+  // the now-empty miniheaps are flushed by the next pass
+  size_t unused = 0;
+  size_t len = sizeof(unused);
+  ASSERT_EQ(gheap.mallctl("mesh.compact", &unused, &len, nullptr, 0), 0);
+
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), 0UL);
+}
+
+TEST(MeshTest, BatchedMesh) {
+  if (getPageSize() == 4096) {
+    batchedMeshImpl<4096>();
+  } else {
+    batchedMeshImpl<16384>();
+  }
+}
+
+template <size_t PageSize>
+static void meshGroupImpl() {
+  if (!kMeshingEnabled) {
+    GTEST_SKIP();
+  }
+
+  constexpr size_t Count = 4;
+  const size_t sizeClass = SizeMap::SizeClass(StrLen);
+
+  const auto tid = gettid();
+  GlobalHeap<PageSize> &gheap = runtime<PageSize>().heap();
+
+  // disable automatic meshing for this test
+  gheap.setMeshPeriodMs(kZeroMs);
+
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), 0UL);
+
+  FixedArray<MiniHeap<PageSize>, Count> array{};
+  gheap.allocSmallMiniheaps(sizeClass, StrLen, array, tid);
+  ASSERT_EQ(array.size(), Count);
+
+  // one object per miniheap, each at a different offset
+  MiniHeap<PageSize> *mhs[Count];
+  char *strs[Count];
+  for (size_t i = 0; i < Count; i++) {
+    mhs[i] = array[i];
+    strs[i] = reinterpret_cast<char *>(mhs[i]->mallocAt(gheap.arenaBegin(), i));
+    ASSERT_NE(strs[i], nullptr);
+    memset(strs[i], 'A' + i, StrLen);
+    strs[i][StrLen - 1] = 0;
+  }
+  gheap.releaseMiniheaps(array);
+
+  // mesh two pairs, and then the two resulting groups together
+  MiniHeap<PageSize> *src = mhs[1];
+  gheap.meshLocked(mhs[0], src);
+  src = mhs[3];
+  gheap.meshLocked(mhs[2], src);
+  ASSERT_EQ(gheap.meshGroupSize(mhs[0]), 2UL);
+  ASSERT_EQ(gheap.meshGroupSize(mhs[2]), 2UL);
+
+  size_t histogram[kMeshGroupBuckets];
+  gheap.meshGroupHistogram(sizeClass, histogram);
+  ASSERT_EQ(histogram[0], 2UL);
+
+  src = mhs[2];
+  gheap.meshLocked(mhs[0], src);
+  ASSERT_EQ(gheap.meshGroupSize(mhs[0]), Count);
+  ASSERT_EQ(mhs[0]->meshCount(), Count);
+  ASSERT_EQ(mhs[0]->inUseCount(), Count);
+
+  gheap.meshGroupHistogram(sizeClass, histogram);
+  ASSERT_EQ(histogram[0], 0UL);
+  ASSERT_EQ(histogram[1], 1UL);
+
+  // the ring visits every member exactly once
+  size_t visited = 0;
+  mhs[0]->forEachMeshed([&](const MiniHeap<PageSize> *mh) {
+    for (size_t i = 0; i < Count; i++) {
+      if (mh == mhs[i]) {
+        visited |= 1 << i;
+      }
+    }
+    return false;
+  });
+  ASSERT_EQ(visited, (1UL << Count) - 1);
+
+  for (size_t i = 0; i < Count; i++) {
+    ASSERT_EQ(gheap.miniheapFor(strs[i]), mhs[0]);
+    ASSERT_EQ(strs[i][0], static_cast<char>('A' + i));
+    gheap.free(strs[i]);
+  }
+
+  // the now-empty group is flushed by the next pass
+  size_t unused = 0;
+  size_t len = sizeof(unused);
+  ASSERT_EQ(gheap.mallctl("mesh.compact", &unused, &len, nullptr, 0), 0);
+
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), 0UL);
+  gheap.meshGroupHistogram(sizeClass, histogram);
+  for (size_t i = 0; i < kMeshGroupBuckets; i++) {
+    ASSERT_EQ(histogram[i], 0UL);
+  }
+}
+
+TEST(MeshTest, MeshGroups) {
+  if (getPageSize() == 4096) {
+    meshGroupImpl<4096>();
+  } else {
+    meshGroupImpl<16384>();
+  }
+}
+
+template <size_t PageSize>
+static void uffdBarrierImpl() {
+  if (!kMeshingEnabled) {
+    GTEST_SKIP();
+  }
+
+  GlobalHeap<PageSize> &gheap = runtime<PageSize>().heap();
+
+  size_t old = 0;
+  size_t len = sizeof(old);
+  size_t enable = 1;
+  if (gheap.mallctl("mesh.uffd_barrier", &old, &len, &enable, sizeof(enable)) != 0) {
+    GTEST_SKIP() << "userfaultfd write-protect unavailable";
+  }
+
+  const uint32_t ObjCount = std::min(static_cast<uint32_t>(PageSize / StrLen), 1024U);
+  const auto tid = gettid();
+
+  // disable automatic meshing for this test
+  gheap.setMeshPeriodMs(kZeroMs);
+
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), 0UL);
+
+  FixedArray<MiniHeap<PageSize>, 2> array{};
+  gheap.allocSmallMiniheaps(SizeMap::SizeClass(StrLen), StrLen, array, tid);
+  ASSERT_EQ(array.size(), 2UL);
+  MiniHeap<PageSize> *mh1 = array[0];
+  MiniHeap<PageSize> *mh2 = array[1];
+
+  char *s1 = reinterpret_cast<char *>(mh1->mallocAt(gheap.arenaBegin(), 0));
+  char *s2 = reinterpret_cast<char *>(mh2->mallocAt(gheap.arenaBegin(), ObjCount - 1));
+  memset(s1, 'A', StrLen);
+  memset(s2, 0, StrLen);
+  gheap.releaseMiniheaps(array);
+
+  // a writer that keeps storing to the span being meshed away: any
+  // store that lands mid-mesh has to wait for the mesh, not get lost
+  std::atomic_bool stop{false};
+  std::atomic<uint8_t> lastWritten{0};
+  std::thread writer([&]() {
+    volatile char *target = s2;
+    for (uint8_t i = 1; !stop.load(); i = i % 200 + 1) {
+      *target = i;
+      lastWritten.store(i);
+    }
+  });
+
+  while (lastWritten.load() == 0) {
+  }
+
+  gheap.lock();
+  gheap.meshLocked(mh1, mh2);
+  gheap.unlock();
+
+  stop = true;
+  writer.join();
+
+  ASSERT_EQ(mh1->meshCount(), 2UL);
+  ASSERT_EQ(s2[0], static_cast<char>(lastWritten.load()));
+  ASSERT_EQ(s1[(ObjCount - 1) * StrLen], s2[0]);
+  ASSERT_EQ(s1[0], 'A');
+
+  gheap.free(s1);
+  gheap.free(s2);
+
+  // the now-empty miniheap is flushed by the next pass
+  size_t unused = 0;
+  len = sizeof(unused);
+  ASSERT_EQ(gheap.mallctl("mesh.compact", &unused, &len, nullptr, 0), 0);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), 0UL);
+
+  len = sizeof(enable);
+  ASSERT_EQ(gheap.mallctl("mesh.uffd_barrier", &enable, &len, &old, sizeof(old)), 0);
+}
+
+TEST(MeshTest, UffdBarrier) {
+  if (getPageSize() == 4096) {
+    uffdBarrierImpl<4096>();
+  } else {
+    uffdBarrierImpl<16384>();
+  }
+}
+
+TEST(MeshTest, BatchMeshableMatchesScalar) {
+  // 32 and 128 bytes are the 4K and 16K page bitmap sizes; 16 bytes
+  // exercises the scalar fallback
+  for (size_t byteLen : {16UL, 32UL, 64UL, 128UL}) {
+    const size_t wordCount = byteLen / sizeof(uint64_t);
+    alignas(64) uint64_t left[16]{};
+    alignas(64) uint64_t right[kMeshableBatchMax][16]{};
+    const uint64_t *rights[kMeshableBatchMax];
+
+    // leave one bit of the left bitmap set, and give each right bitmap
+    // at most one bit that may collide with it
+    left[wordCount - 1] = 1ULL << 63;
+    for (size_t i = 0; i < kMeshableBatchMax; i++) {
+      right[i][i % wordCount] = 1ULL << (i % 64);
+      if (i % 3 == 0) {
+        right[i][wordCount - 1] |= 1ULL << 63;
+      }
+      rights[i] = right[i];
+    }
+
+    for (size_t count : {1UL, 7UL, kMeshableBatchMax}) {
+      uint64_t expected = 0;
+      for (size_t i = 0; i < count; i++) {
+        expected |= static_cast<uint64_t>(bitmapsMeshable(left, right[i], byteLen)) << i;
+      }
+      ASSERT_EQ(bitmapsMeshableBatch(left, rights, count, byteLen), expected) << byteLen << " " << count;
+    }
+  }
+}
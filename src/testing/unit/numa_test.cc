@@ -0,0 +1,69 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "gtest/gtest.h"
+
+#include "internal.h"
+#include "runtime.h"
+
+#include "mallctl_helpers.h"
+
+using namespace mesh;
+
+static constexpr uint32_t StrLen = 128;
+
+template <size_t PageSize>
+static void nodeStatsImpl() {
+  const auto tid = gettid();
+  GlobalHeap<PageSize> &gheap = heapWithoutAutoMesh<PageSize>();
+
+  const size_t nodeCount = internal::numaNodeCount();
+  ASSERT_GE(nodeCount, 1UL);
+  ASSERT_LE(nodeCount, kMaxNumaNodes);
+  const size_t node = internal::currentNumaNode();
+  ASSERT_LT(node, nodeCount);
+  const size_t miniheapCount = gheap.getAllocatedMiniheapCount();
+
+  ASSERT_EQ(getStat(gheap, "stats.numa_nodes"), nodeCount);
+
+  // spans are handed out on the allocating thread's node (which we
+  // may have migrated off of since asking)
+  FixedArray<MiniHeap<PageSize>, 1> array{};
+  gheap.allocSmallMiniheaps(SizeMap::SizeClass(StrLen), StrLen, array, tid);
+  ASSERT_EQ(array.size(), 1UL);
+  MiniHeap<PageSize> *mh = array[0];
+  const size_t spanNode = gheap.spanNode(mh->span());
+  ASSERT_LT(spanNode, nodeCount);
+  if (nodeCount == 1) {
+    ASSERT_EQ(spanNode, node);
+  }
+
+  char name[64];
+  snprintf(name, sizeof(name), "stats.numa.%zu.active_bytes", spanNode);
+  ASSERT_GE(getStat(gheap, name), mh->spanSize());
+
+  gheap.releaseMiniheaps(array);
+
+  // unknown nodes and stats are rejected
+  size_t val = 0;
+  snprintf(name, sizeof(name), "stats.numa.%zu.active_bytes", nodeCount);
+  ASSERT_EQ(readMallctl(gheap, name, val), -1);
+  ASSERT_EQ(readMallctl(gheap, "stats.numa.0.bogus", val), -1);
+
+  flushEmptyMiniheaps(gheap);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), miniheapCount);
+  gheap.setMeshPeriodMs(kMeshPeriodMs);
+}
+
+TEST(NumaTest, NodeStats) {
+  if (getPageSize() == 4096) {
+    nodeStatsImpl<4096>();
+  } else {
+    nodeStatsImpl<16384>();
+  }
+}
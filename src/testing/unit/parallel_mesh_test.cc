@@ -0,0 +1,111 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <set>
+
+#include "gtest/gtest.h"
+
+#include "internal.h"
+#include "meshing.h"
+#include "runtime.h"
+
+#include "mallctl_helpers.h"
+
+using namespace mesh;
+
+static constexpr size_t MiniheapCount = 8;
+static constexpr size_t SizeClassCount = 2;
+static constexpr uint32_t StrLens[SizeClassCount] = {128, 256};
+
+template <size_t PageSize>
+static void parallelMeshImpl() {
+  if (!kMeshingEnabled) {
+    GTEST_SKIP();
+  }
+
+  const auto tid = gettid();
+  GlobalHeap<PageSize> &gheap = heapWithoutAutoMesh<PageSize>();
+
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), 0UL);
+
+  const size_t oldThreads = setKnob(gheap, "mesh.mesh_threads", 4);
+  ASSERT_EQ(gheap.meshThreads(), 4UL);
+
+  char *strs[SizeClassCount][MiniheapCount];
+  char *expected[SizeClassCount][MiniheapCount];
+
+  for (size_t c = 0; c < SizeClassCount; c++) {
+    const uint32_t strLen = StrLens[c];
+    const uint32_t objCount = std::min(static_cast<uint32_t>(PageSize / strLen), 1024U);
+    ASSERT_GE(objCount, MiniheapCount + 1);
+
+    const int sizeClass = SizeMap::SizeClass(strLen);
+    FixedArray<MiniHeap<PageSize>, MiniheapCount> miniheaps{};
+
+    // every miniheap gets a single object at a distinct offset, so all
+    // of them are pairwise meshable
+    for (size_t i = 0; i < MiniheapCount; i++) {
+      FixedArray<MiniHeap<PageSize>, 1> array{};
+      gheap.allocSmallMiniheaps(sizeClass, strLen, array, tid);
+      MiniHeap<PageSize> *mh = array[0];
+      array.clear();
+      miniheaps.append(mh);
+
+      strs[c][i] = reinterpret_cast<char *>(mh->mallocAt(gheap.arenaBegin(), i));
+      ASSERT_NE(strs[c][i], nullptr);
+      memset(strs[c][i], 'A' + i, strLen);
+      strs[c][i][strLen - 1] = 0;
+      expected[c][i] = strdup(strs[c][i]);
+    }
+
+    // an extra object we free through the global heap, which marks the
+    // heap as worth meshing
+    char *extra = reinterpret_cast<char *>(miniheaps[0]->mallocAt(gheap.arenaBegin(), objCount - 1));
+    ASSERT_NE(extra, nullptr);
+
+    // detach the miniheaps so that they land on the partial freelist
+    gheap.releaseMiniheaps(miniheaps);
+    gheap.free(extra);
+  }
+
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), MiniheapCount * SizeClassCount);
+
+  compact(gheap);
+
+  for (size_t c = 0; c < SizeClassCount; c++) {
+    std::set<MiniHeap<PageSize> *> owners{};
+    for (size_t i = 0; i < MiniheapCount; i++) {
+      ASSERT_STREQ(strs[c][i], expected[c][i]);
+      owners.insert(gheap.miniheapFor(strs[c][i]));
+    }
+    // both size classes were meshed, halving the number of spans
+    ASSERT_LE(owners.size(), MiniheapCount / 2);
+  }
+
+  for (size_t c = 0; c < SizeClassCount; c++) {
+    for (size_t i = 0; i < MiniheapCount; i++) {
+      gheap.free(strs[c][i]);
+      ::free(expected[c][i]);
+    }
+  }
+
+  // the now-empty miniheaps are flushed by the next pass
+  compact(gheap);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), 0UL);
+
+  setKnob(gheap, "mesh.mesh_threads", oldThreads);
+  ASSERT_EQ(gheap.meshThreads(), oldThreads);
+}
+
+TEST(ParallelMeshTest, MeshesSizeClassesConcurrently) {
+  if (getPageSize() == 4096) {
+    parallelMeshImpl<4096>();
+  } else {
+    parallelMeshImpl<16384>();
+  }
+}
@@ -0,0 +1,97 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "internal.h"
+#include "runtime.h"
+
+#include "mallctl_helpers.h"
+
+using namespace mesh;
+
+static constexpr uint32_t StrLen = 128;
+static constexpr size_t MiniheapCount = 4;
+
+// how full (in 32nds) each miniheap is, deliberately out of order.
+// These land in occupancy buckets 1, 3, 0 and 2.
+static constexpr size_t Fill32nds[MiniheapCount] = {10, 30, 1, 20};
+
+template <size_t PageSize>
+static void partialBucketImpl() {
+  const uint32_t ObjCount = std::min(static_cast<uint32_t>(PageSize / StrLen), 1024U);
+  ASSERT_EQ(ObjCount % 32, 0U);
+
+  const auto tid = gettid();
+  GlobalHeap<PageSize> &gheap = heapWithoutAutoMesh<PageSize>();
+
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), 0UL);
+
+  const int sizeClass = SizeMap::SizeClass(StrLen);
+  FixedArray<MiniHeap<PageSize>, MiniheapCount> miniheaps{};
+  std::vector<void *> ptrs{};
+
+  for (size_t i = 0; i < MiniheapCount; i++) {
+    FixedArray<MiniHeap<PageSize>, 1> array{};
+    gheap.allocSmallMiniheaps(sizeClass, StrLen, array, tid);
+    MiniHeap<PageSize> *mh = array[0];
+    array.clear();
+    miniheaps.append(mh);
+
+    for (size_t j = 0; j < ObjCount * Fill32nds[i] / 32; j++) {
+      void *ptr = mh->mallocAt(gheap.arenaBegin(), j);
+      ASSERT_NE(ptr, nullptr);
+      ptrs.push_back(ptr);
+    }
+  }
+
+  // detach the miniheaps so that they land on the partial freelist
+  gheap.releaseMiniheaps(miniheaps);
+
+  // meshing looks at the emptiest miniheaps first (and skips the one
+  // above the occupancy cutoff)
+  const auto candidates = gheap.meshingCandidatesLocked(sizeClass);
+  ASSERT_EQ(candidates.size(), MiniheapCount - 1);
+  for (size_t i = 1; i < candidates.size(); i++) {
+    ASSERT_LT(candidates[i - 1]->inUseCount(), candidates[i]->inUseCount());
+  }
+
+  // while allocation reuses the fullest first
+  size_t lastInUse = ObjCount;
+  FixedArray<MiniHeap<PageSize>, 1> attached[MiniheapCount]{};
+  for (size_t i = 0; i < MiniheapCount; i++) {
+    gheap.allocSmallMiniheaps(sizeClass, StrLen, attached[i], tid);
+    ASSERT_EQ(attached[i].size(), 1UL);
+    const size_t inUse = attached[i][0]->inUseCount();
+    ASSERT_LT(inUse, lastInUse);
+    lastInUse = inUse;
+  }
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), MiniheapCount);
+
+  for (size_t i = 0; i < MiniheapCount; i++) {
+    gheap.releaseMiniheaps(attached[i]);
+  }
+
+  for (auto ptr : ptrs) {
+    gheap.free(ptr);
+  }
+
+  // the now-empty miniheaps are flushed by the next pass
+  compact(gheap);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), 0UL);
+}
+
+TEST(PartialBucketTest, FullestReusedFirst) {
+  if (getPageSize() == 4096) {
+    partialBucketImpl<4096>();
+  } else {
+    partialBucketImpl<16384>();
+  }
+}
@@ -0,0 +1,144 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "internal.h"
+#include "runtime.h"
+#include "thread_local_heap.h"
+
+#include "mallctl_helpers.h"
+
+using namespace mesh;
+
+static constexpr size_t ObjectSize = 64;
+static constexpr size_t ObjectCount = kRemoteFreeBatch * 3;
+
+template <size_t PageSize>
+static void remoteFreeImpl() {
+  GlobalHeap<PageSize> &gheap = heapWithoutAutoMesh<PageSize>();
+  auto heap = ThreadLocalHeap<PageSize>::GetHeap();
+
+  // start with nothing buffered
+  heap->releaseAll();
+  ASSERT_EQ(getStat(gheap, "mesh.remote_free_batch"), kRemoteFreeBatch);
+
+  // with no empty miniheaps left over from earlier tests
+  flushEmptyMiniheaps(gheap);
+  const size_t miniheapCount = gheap.getAllocatedMiniheapCount();
+
+  std::vector<void *> ptrs;
+  std::thread([&ptrs]() {
+    auto owner = ThreadLocalHeap<PageSize>::GetHeap();
+    for (size_t i = 0; i < ObjectCount; i++) {
+      void *ptr = owner->malloc(ObjectSize);
+      ASSERT_NE(ptr, nullptr);
+      memset(ptr, 'A', ObjectSize);
+      ptrs.push_back(ptr);
+    }
+    owner->releaseAll();
+  }).join();
+  ASSERT_EQ(ptrs.size(), ObjectCount);
+
+  const size_t frees = getStat(gheap, "stats.batched_frees");
+  const size_t batches = getStat(gheap, "stats.free_batches");
+
+  // frees of another thread's objects wait for a full batch
+  size_t i = 0;
+  for (; i < kRemoteFreeBatch - 1; i++) {
+    heap->free(ptrs[i]);
+  }
+  ASSERT_EQ(getStat(gheap, "stats.batched_frees"), frees);
+  heap->free(ptrs[i++]);
+  ASSERT_EQ(getStat(gheap, "stats.batched_frees"), frees + kRemoteFreeBatch);
+  ASSERT_EQ(getStat(gheap, "stats.free_batches"), batches + 1);
+
+  // releasing the heap flushes a partial batch
+  heap->free(ptrs[i++]);
+  heap->releaseAll();
+  ASSERT_EQ(getStat(gheap, "stats.batched_frees"), frees + kRemoteFreeBatch + 1);
+  ASSERT_EQ(getStat(gheap, "stats.free_batches"), batches + 2);
+
+  // with batching off, each free goes straight to the global heap
+  setKnob(gheap, "mesh.remote_free_batch", 0);
+  for (; i < ObjectCount; i++) {
+    heap->free(ptrs[i]);
+  }
+  ASSERT_EQ(getStat(gheap, "stats.batched_frees"), frees + kRemoteFreeBatch + 1);
+  setKnob(gheap, "mesh.remote_free_batch", kRemoteFreeBatch);
+
+  // every miniheap the other thread used is now empty
+  compact(gheap);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), miniheapCount);
+}
+
+TEST(RemoteFreeTest, BatchesFreesOfOtherThreadsObjects) {
+  if (getPageSize() == 4096) {
+    remoteFreeImpl<4096>();
+  } else {
+    remoteFreeImpl<16384>();
+  }
+}
+
+template <size_t PageSize>
+static void remoteFreeFlushImpl() {
+  GlobalHeap<PageSize> &gheap = heapWithoutAutoMesh<PageSize>();
+  auto heap = ThreadLocalHeap<PageSize>::GetHeap();
+
+  heap->releaseAll();
+  flushEmptyMiniheaps(gheap);
+  const size_t miniheapCount = gheap.getAllocatedMiniheapCount();
+
+  std::vector<void *> ptrs;
+  std::thread([&ptrs]() {
+    auto owner = ThreadLocalHeap<PageSize>::GetHeap();
+    for (size_t i = 0; i < 2; i++) {
+      ptrs.push_back(owner->malloc(ObjectSize));
+    }
+    owner->releaseAll();
+  }).join();
+  // all but the miniheap holding our two objects were left empty
+  flushEmptyMiniheaps(gheap);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), miniheapCount + 1);
+
+  const size_t frees = getStat(gheap, "stats.batched_frees");
+
+  // a local free ends a run of remote frees.  Use another size class,
+  // so we aren't handed the other thread's partly-full miniheap.
+  void *local = heap->malloc(ObjectSize * 2);
+  heap->free(ptrs[0]);
+  ASSERT_EQ(getStat(gheap, "stats.batched_frees"), frees);
+  heap->free(local);
+  ASSERT_EQ(getStat(gheap, "stats.batched_frees"), frees + 1);
+
+  heap->releaseAll();
+  flushEmptyMiniheaps(gheap);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), miniheapCount + 1);
+
+  // and compacting through the runtime flushes the calling thread's
+  // buffer, so the other thread's now-empty miniheap is returned
+  heap->free(ptrs[1]);
+  ASSERT_EQ(getStat(gheap, "stats.batched_frees"), frees + 1);
+  size_t unused = 0;
+  size_t len = sizeof(unused);
+  ASSERT_EQ(runtime<PageSize>().mallctl("mesh.compact", &unused, &len, nullptr, 0), 0);
+  ASSERT_EQ(getStat(gheap, "stats.batched_frees"), frees + 2);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), miniheapCount);
+}
+
+TEST(RemoteFreeTest, FlushesBufferedFrees) {
+  if (getPageSize() == 4096) {
+    remoteFreeFlushImpl<4096>();
+  } else {
+    remoteFreeFlushImpl<16384>();
+  }
+}
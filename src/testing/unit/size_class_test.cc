@@ -11,6 +11,8 @@
 #include "internal.h"
 #include "size_class_reciprocals.h"
 
+#include "plasma/mesh.h"
+
 using namespace mesh;
 
 #define roundtrip(n) ASSERT_TRUE(n == SizeMap::ByteSizeForClass(SizeMap::SizeClass(n)))
@@ -90,3 +92,18 @@ TEST(SizeClass, ReciprocalTable) {
     }
   }
 }
+
+TEST(SizeClass, CompileTimeClasses) {
+  static_assert(mesh::detail::sizeClassFor(0) == 1, "0-byte objects get 16 bytes");
+  static_assert(mesh::detail::sizeClassFor(17) == 2, "");
+  static_assert(mesh::detail::sizeClassFor(kMaxSize + 1) == mesh::detail::kSizeClassCount, "");
+
+  // the public header's table must agree with the allocator's
+  ASSERT_EQ(static_cast<size_t>(MESH_SIZE_CLASS_COUNT), kClassSizesMax);
+  for (size_t i = 0; i < kClassSizesMax; i++) {
+    ASSERT_EQ(mesh::detail::kClassSizes[i], static_cast<size_t>(SizeMap::class_to_size(i)));
+  }
+  for (size_t sz = 0; sz <= kMaxSize; sz++) {
+    ASSERT_EQ(mesh::detail::sizeClassFor(sz), static_cast<unsigned>(SizeMap::SizeClass(sz))) << "size " << sz;
+  }
+}
@@ -0,0 +1,78 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "internal.h"
+#include "runtime.h"
+#include "thread_local_heap.h"
+
+#include "mallctl_helpers.h"
+
+using namespace mesh;
+
+static constexpr size_t ObjectSize = 64;
+static constexpr size_t ObjectCount = 1000;
+
+template <size_t PageSize>
+static void sizedFreeImpl() {
+  GlobalHeap<PageSize> &gheap = heapWithoutAutoMesh<PageSize>();
+  auto heap = ThreadLocalHeap<PageSize>::GetHeap();
+
+  heap->releaseAll();
+  const size_t miniheapCount = gheap.getAllocatedMiniheapCount();
+
+  // objects in our own attached miniheaps go back to the shuffle vector
+  void *ptr = heap->malloc(ObjectSize);
+  ASSERT_NE(ptr, nullptr);
+  const auto mh = gheap.miniheapFor(ptr);
+  ASSERT_TRUE(mh->isAttached());
+  const size_t inUse = mh->inUseCount();
+  heap->sizedFree(ptr, ObjectSize);
+  ASSERT_EQ(mh->inUseCount(), inUse);
+  heap->releaseAll();
+
+  std::vector<void *> ptrs;
+  for (size_t i = 0; i < ObjectCount; i++) {
+    ptrs.push_back(heap->malloc(ObjectSize));
+    memset(ptrs.back(), 'A', ObjectSize);
+  }
+
+  // a size from another size class misses every attached span of
+  // that class, and falls back to a regular free
+  for (size_t i = 0; i < ObjectCount; i += 2) {
+    heap->sizedFree(ptrs[i], i % 4 == 0 ? ObjectSize : ObjectSize * 4);
+  }
+
+  // and another heap's objects are freed remotely
+  const size_t batchedFrees = getStat(gheap, "stats.batched_frees");
+  std::thread([&]() {
+    auto other = ThreadLocalHeap<PageSize>::GetHeap();
+    for (size_t i = 1; i < ObjectCount; i += 2) {
+      other->sizedFree(ptrs[i], ObjectSize);
+    }
+    other->releaseAll();
+  }).join();
+  ASSERT_GT(getStat(gheap, "stats.batched_frees"), batchedFrees);
+
+  heap->releaseAll();
+  compact(gheap);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), miniheapCount);
+}
+
+TEST(SizedFreeTest, FreesByAttachedSpan) {
+  if (getPageSize() == 4096) {
+    sizedFreeImpl<4096>();
+  } else {
+    sizedFreeImpl<16384>();
+  }
+}
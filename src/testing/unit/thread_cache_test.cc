@@ -0,0 +1,131 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "internal.h"
+#include "runtime.h"
+#include "thread_local_heap.h"
+
+#include "mallctl_helpers.h"
+
+using namespace mesh;
+
+static constexpr size_t ObjectSize = 64;
+static constexpr size_t ObjectCount = 100000;
+
+// allocates enough objects back to back that every refill after the
+// first comes well within kRefillHotInterval of the last one
+template <size_t PageSize>
+static void allocBurst(ThreadLocalHeap<PageSize> *heap) {
+  std::vector<void *> ptrs;
+  ptrs.reserve(ObjectCount);
+  for (size_t i = 0; i < ObjectCount; i++) {
+    ptrs.push_back(heap->malloc(ObjectSize));
+    ASSERT_NE(ptrs.back(), nullptr);
+  }
+  for (auto ptr : ptrs) {
+    heap->free(ptr);
+  }
+}
+
+template <size_t PageSize>
+static void threadCacheImpl() {
+  GlobalHeap<PageSize> &gheap = heapWithoutAutoMesh<PageSize>();
+  auto heap = ThreadLocalHeap<PageSize>::GetHeap();
+
+  uint32_t sizeClass = 0;
+  ASSERT_TRUE(SizeMap::GetSizeClass(ObjectSize, &sizeClass));
+
+  heap->releaseAll();
+  flushEmptyMiniheaps(gheap);
+  const size_t miniheapCount = gheap.getAllocatedMiniheapCount();
+  ASSERT_EQ(getStat(gheap, "mesh.thread_cache_bytes"), kDefaultThreadCacheBytes);
+  ASSERT_EQ(heap->refillGoal(sizeClass), kMiniheapRefillGoalSize);
+  const size_t inUse = getStat(gheap, "stats.thread_cache_bytes");
+
+  // a hot size class grows its refill goal, out of the global budget
+  allocBurst(heap);
+  const size_t goal = heap->refillGoal(sizeClass);
+  ASSERT_GT(goal, kMiniheapRefillGoalSize);
+  ASSERT_LE(goal, kMaxRefillGoalSize);
+  ASSERT_GE(getStat(gheap, "stats.thread_cache_bytes"), inUse + goal - kMiniheapRefillGoalSize);
+
+  // releasing the heap returns its share of the budget
+  heap->releaseAll();
+  ASSERT_EQ(heap->refillGoal(sizeClass), kMiniheapRefillGoalSize);
+  ASSERT_EQ(getStat(gheap, "stats.thread_cache_bytes"), inUse);
+
+  // with no budget left, goals stay at the default
+  setKnob(gheap, "mesh.thread_cache_bytes", inUse);
+  allocBurst(heap);
+  ASSERT_EQ(heap->refillGoal(sizeClass), kMiniheapRefillGoalSize);
+  ASSERT_EQ(getStat(gheap, "stats.thread_cache_bytes"), inUse);
+  setKnob(gheap, "mesh.thread_cache_bytes", kDefaultThreadCacheBytes);
+
+  heap->releaseAll();
+  flushEmptyMiniheaps(gheap);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), miniheapCount);
+}
+
+TEST(ThreadCacheTest, AdaptsRefillGoalToRefillRate) {
+  if (getPageSize() == 4096) {
+    threadCacheImpl<4096>();
+  } else {
+    threadCacheImpl<16384>();
+  }
+}
+
+template <size_t PageSize>
+static void coldClassImpl() {
+  GlobalHeap<PageSize> &gheap = heapWithoutAutoMesh<PageSize>();
+  auto heap = ThreadLocalHeap<PageSize>::GetHeap();
+
+  uint32_t hotClass = 0;
+  uint32_t coldClass = 0;
+  ASSERT_TRUE(SizeMap::GetSizeClass(ObjectSize, &hotClass));
+  ASSERT_TRUE(SizeMap::GetSizeClass(ObjectSize * 4, &coldClass));
+  ASSERT_NE(hotClass, coldClass);
+
+  heap->releaseAll();
+  flushEmptyMiniheaps(gheap);
+  const size_t miniheapCount = gheap.getAllocatedMiniheapCount();
+
+  void *cold = heap->malloc(ObjectSize * 4);
+  ASSERT_NE(cold, nullptr);
+  MiniHeap<PageSize> *coldMh = gheap.miniheapFor(cold);
+  ASSERT_TRUE(coldMh->isAttached());
+
+  // a refill of another class after the cold class has been idle for
+  // a while takes the cold class's miniheaps back
+  std::this_thread::sleep_for(kRefillColdInterval + std::chrono::milliseconds{100});
+  void *hot = heap->malloc(ObjectSize);
+  ASSERT_NE(hot, nullptr);
+  ASSERT_FALSE(coldMh->isAttached());
+  ASSERT_EQ(heap->refillGoal(coldClass), kMiniheapRefillGoalSize / 2);
+  ASSERT_EQ(heap->refillGoal(hotClass), kMiniheapRefillGoalSize);
+
+  heap->free(hot);
+  heap->free(cold);
+  heap->releaseAll();
+  flushEmptyMiniheaps(gheap);
+  ASSERT_EQ(gheap.getAllocatedMiniheapCount(), miniheapCount);
+}
+
+TEST(ThreadCacheTest, ReleasesColdClasses) {
+  if (getPageSize() == 4096) {
+    coldClassImpl<4096>();
+  } else {
+    coldClassImpl<16384>();
+  }
+}
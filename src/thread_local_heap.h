@@ -47,8 +47,10 @@ public:
   using ShuffleVectorT = ShuffleVector<PageSize>;
   using MiniHeapT = MiniHeap<PageSize>;
 
-  ThreadLocalHeap(GlobalHeapT *global, pthread_t pthreadCurrent)
-      : _current(gettid()),
+  // current is the owner id attached miniheaps are tagged with: the
+  // thread's tid, or a per-CPU id for heaps from cpu_local_heap.h
+  ThreadLocalHeap(GlobalHeapT *global, pthread_t pthreadCurrent, pid_t current)
+      : _current(current),
         _global(global),
         _pthreadCurrent(pthreadCurrent),
         _prng(internal::seed(), internal::seed()),
@@ -74,6 +76,20 @@ public:
   void releaseAll();
 
   void *ATTRIBUTE_NEVER_INLINE CACHELINE_ALIGNED_FN smallAllocSlowpath(size_t sizeClass);
+  void *ATTRIBUTE_NEVER_INLINE largeAlloc(size_t pageCount);
+  // returns false if ptr should be freed to the global heap instead
+  bool ATTRIBUTE_NEVER_INLINE largeCacheFree(MiniHeapT *mh, void *ptr);
+  // hands every cached large span back to the global heap
+  void flushLargeCache();
+  // hands back the spans of page counts that haven't been used since
+  // the last sweep
+  void releaseIdleLargeSpans(time::time_point now);
+  // frees the buffered frees of objects in miniheaps we don't own
+  void ATTRIBUTE_NEVER_INLINE flushRemoteFrees();
+  // bytes of free space the next global refill of sizeClass asks for
+  size_t refillGoal(size_t sizeClass) const {
+    return _refill[sizeClass].goal;
+  }
   void *ATTRIBUTE_NEVER_INLINE CACHELINE_ALIGNED_FN smallAllocGlobalRefill(ShuffleVectorT &shuffleVector,
                                                                            size_t sizeClass);
 
@@ -109,6 +125,9 @@ public:
     // fall back to page-aligned allocation
     const size_t pageAlignment = (alignment + PageSize - 1) / PageSize;
     const size_t pageCount = PageCount(size);
+    if (pageAlignment == 1) {
+      return largeAlloc(pageCount);
+    }
     return _global->pageAlignedAlloc(pageAlignment, pageCount);
   }
 
@@ -181,9 +200,15 @@ public:
 
     // if the size isn't in our sizemap it is a large alloc
     if (unlikely(!SizeMap::GetSizeClass(sz, &sizeClass))) {
-      return _global->malloc(sz);
+      return largeAlloc(PageCount(sz));
     }
 
+    return mallocSizeClass(sizeClass);
+  }
+
+  // malloc for callers that already know the size class
+  inline void *ATTRIBUTE_ALWAYS_INLINE ATTRIBUTE_MALLOC mallocSizeClass(uint32_t sizeClass) {
+    d_assert(sizeClass > 0 && sizeClass < kNumBins);
     ShuffleVectorT &shuffleVector = _shuffleVector[sizeClass];
     if (unlikely(shuffleVector.isExhausted())) {
       return smallAllocSlowpath(sizeClass);
@@ -201,13 +226,114 @@ public:
     if (likely(mh && mh->current() == _current && !mh->hasMeshed())) {
       ShuffleVectorT &shuffleVector = _shuffleVector[mh->sizeClass()];
       shuffleVector.free(mh, ptr);
+      // the run of remote frees (if any) is over, so don't sit on it
+      if (unlikely(_remoteFreeCount > 0)) {
+        flushRemoteFrees();
+      }
+      return;
+    }
+
+    if (mh != nullptr && mh->isLargeAlloc() && largeCacheFree(mh, ptr)) {
+      return;
+    }
+
+    // another heap's object: rather than paying for a bitmap update
+    // (and maybe a size-class lock) per free, batch it up with others
+    const size_t remoteFreeBatch = _global->remoteFreeBatch();
+    if (mh != nullptr && !mh->isLargeAlloc() && remoteFreeBatch > 0) {
+      _remoteFrees[_remoteFreeCount++] = ptr;
+      if (unlikely(_remoteFreeCount >= remoteFreeBatch)) {
+        flushRemoteFrees();
+      }
       return;
     }
 
     _global->freeFor(mh, ptr, startEpoch);
   }
 
+  // allocates count objects of sz bytes into ptrs, looking up the
+  // size class once and taking runs of objects from the shuffle
+  // vector.  Returns how many were allocated.
+  size_t mallocBatch(size_t sz, void **ptrs, size_t count) {
+    uint32_t sizeClass = 0;
+    if (unlikely(!SizeMap::GetSizeClass(sz, &sizeClass))) {
+      for (size_t i = 0; i < count; i++) {
+        ptrs[i] = largeAlloc(PageCount(sz));
+        if (unlikely(ptrs[i] == nullptr)) {
+          return i;
+        }
+      }
+      return count;
+    }
+
+    ShuffleVectorT &shuffleVector = _shuffleVector[sizeClass];
+    size_t i = 0;
+    while (i < count) {
+      if (unlikely(shuffleVector.isExhausted())) {
+        ptrs[i] = smallAllocSlowpath(sizeClass);
+        if (unlikely(ptrs[i] == nullptr)) {
+          return i;
+        }
+        i++;
+        continue;
+      }
+      const size_t want = std::min(count - i, static_cast<size_t>(kMaxShuffleVectorLength));
+      i += shuffleVector.mallocBatch(&ptrs[i], static_cast<uint32_t>(want));
+    }
+
+    return count;
+  }
+
+  // frees count objects (skipping nulls).  Our own objects go back to
+  // their shuffle vectors as in free(); everything else goes to the
+  // global heap in batches grouped by miniheap.
+  void freeBatch(void *const *ptrs, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+      void *ptr = ptrs[i];
+      if (unlikely(ptr == nullptr)) {
+        continue;
+      }
+
+      auto mh = _global->miniheapFor(ptr);
+      if (likely(mh && mh->current() == _current && !mh->hasMeshed())) {
+        ShuffleVectorT &shuffleVector = _shuffleVector[mh->sizeClass()];
+        shuffleVector.free(mh, ptr);
+        continue;
+      }
+
+      if (unlikely(mh == nullptr) || (mh->isLargeAlloc() && largeCacheFree(mh, ptr))) {
+        continue;
+      }
+
+      _remoteFrees[_remoteFreeCount++] = ptr;
+      if (_remoteFreeCount == kRemoteFreeBatch) {
+        flushRemoteFrees();
+      }
+    }
+
+    flushRemoteFrees();
+  }
+
+  // with the size the object was allocated with we know which shuffle
+  // vector it would belong to, and can find its miniheap among that
+  // vector's attached spans without the arena index lookup in free().
+  // Anything else (another heap's object, a meshed miniheap, a large
+  // object or a wrong size) takes the regular path.
   inline void ATTRIBUTE_ALWAYS_INLINE sizedFree(void *ptr, size_t sz) {
+    uint32_t sizeClass = 0;
+    if (likely(ptr != nullptr && SizeMap::GetSizeClass(sz, &sizeClass))) {
+      ShuffleVectorT &shuffleVector = _shuffleVector[sizeClass];
+      auto mh = shuffleVector.attachedMiniheapFor(ptr);
+      if (likely(mh != nullptr && !mh->hasMeshed())) {
+        d_assert(mh->current() == _current);
+        shuffleVector.free(mh, ptr);
+        if (unlikely(_remoteFreeCount > 0)) {
+          flushRemoteFrees();
+        }
+        return;
+      }
+    }
+
     this->free(ptr);
   }
 
@@ -258,6 +384,55 @@ protected:
   LocalHeapStats _stats{};
   bool _inSetSpecific{false};
 
+  // freed large allocations, by page count
+  static constexpr size_t kLargeCacheBins = kMaxFastLargeSize / kPageSize4K;
+  struct LargeCacheBin {
+    MiniHeapT *miniheaps[kLargeCacheDepth];
+    uint32_t count;
+    // set on every hit or free, and cleared by each idle sweep
+    bool recentlyUsed;
+  };
+  LargeCacheBin _largeCache[kLargeCacheBins]{};
+  size_t _largeCacheBytes{0};
+  time::time_point _lastLargeCacheSweep{};
+
+  // only called from slow paths, so the hit and free paths never
+  // read the clock
+  inline void maybeReleaseIdleLargeSpans() {
+    if (_largeCacheBytes == 0) {
+      return;
+    }
+    const auto now = time::now();
+    if (now - _lastLargeCacheSweep > kLargeCacheIdleInterval) {
+      releaseIdleLargeSpans(now);
+    }
+  }
+
+  void releaseLargeCacheBin(LargeCacheBin &bin);
+
+  // freed objects from miniheaps we don't own, not yet handed to the
+  // global heap.  Flushed when full, on the next local free or
+  // allocation slow path, and from releaseAll.
+  void *_remoteFrees[kRemoteFreeBatch];
+  size_t _remoteFreeCount{0};
+
+  // per size class refill goals, adapted to how often each class
+  // goes back to the global heap
+  struct RefillState {
+    time::time_point last{};
+    uint32_t goal{kMiniheapRefillGoalSize};
+  };
+  RefillState _refill[kNumBins]{};
+  // sum of our goals above kMiniheapRefillGoalSize, reserved from the
+  // global heap's thread cache budget
+  size_t _refillGoalExtra{0};
+  // when we last looked for size classes that have gone cold
+  time::time_point _lastColdSweep{};
+
+  size_t adaptRefillGoal(size_t sizeClass, time::time_point now);
+  void setRefillGoal(size_t sizeClass, size_t goal);
+  void releaseColdClasses(size_t sizeClass, time::time_point now);
+
 #ifdef MESH_HAVE_TLS
   static __thread ThreadLocalHeap *_threadLocalHeap CACHELINE_ALIGNED ATTR_INITIAL_EXEC;
 #endif
@@ -305,7 +480,7 @@ ThreadLocalHeap<PageSize> *ThreadLocalHeap<PageSize>::NewHeap(pthread_t current)
   hard_assert(buf != nullptr);
   hard_assert(reinterpret_cast<uintptr_t>(buf) % CACHELINE_SIZE == 0);
 
-  auto heap = new (buf) ThreadLocalHeap(&mesh::runtime<PageSize>().heap(), current);
+  auto heap = new (buf) ThreadLocalHeap(&mesh::runtime<PageSize>().heap(), current, gettid());
 
   heap->_prev = nullptr;
   heap->_next = _threadLocalHeaps;
@@ -396,9 +571,162 @@ void ThreadLocalHeap<PageSize>::DeleteHeap(ThreadLocalHeap *heap) {
 
 template <size_t PageSize>
 void ThreadLocalHeap<PageSize>::releaseAll() {
+  flushRemoteFrees();
+  for (size_t i = 1; i < kNumBins; i++) {
+    _shuffleVector[i].refillMiniheaps();
+    _global->releaseMiniheaps(_shuffleVector[i].miniheaps());
+    // with nothing attached, start over from the default goal and
+    // hand our share of the thread cache budget back
+    _refill[i].last = time::time_point{};
+    setRefillGoal(i, kMiniheapRefillGoalSize);
+  }
+  d_assert(_refillGoalExtra == 0);
+  flushLargeCache();
+}
+
+template <size_t PageSize>
+void *ThreadLocalHeap<PageSize>::largeAlloc(size_t pageCount) {
+  if (pageCount > 0 && pageCount * PageSize <= kMaxFastLargeSize) {
+    LargeCacheBin &bin = _largeCache[pageCount - 1];
+    const bool hit = bin.count > 0;
+    _global->recordLargeCacheLookup(hit);
+    if (hit) {
+      MiniHeapT *mh = bin.miniheaps[--bin.count];
+      const size_t bytes = mh->spanSize();
+      bin.recentlyUsed = true;
+      _largeCacheBytes -= bytes;
+      _global->recordLargeCached(-static_cast<ssize_t>(bytes));
+      return reinterpret_cast<void *>(mh->getSpanStart(_global->arenaBegin()));
+    }
+  }
+
+  maybeReleaseIdleLargeSpans();
+
+  return _global->pageAlignedAlloc(1, pageCount);
+}
+
+template <size_t PageSize>
+bool ThreadLocalHeap<PageSize>::largeCacheFree(MiniHeapT *mh, void *ptr) {
+  const size_t bytes = mh->spanSize();
+  if (bytes > kMaxFastLargeSize || _largeCacheBytes + bytes > _global->largeCacheBytes()) {
+    return false;
+  }
+
+  // only the start of the span is a valid pointer to free
+  if (reinterpret_cast<uintptr_t>(ptr) != mh->getSpanStart(_global->arenaBegin())) {
+    return false;
+  }
+
+  LargeCacheBin &bin = _largeCache[bytes / PageSize - 1];
+  if (bin.count == kLargeCacheDepth) {
+    return false;
+  }
+
+  bin.miniheaps[bin.count++] = mh;
+  bin.recentlyUsed = true;
+  _largeCacheBytes += bytes;
+  _global->recordLargeCached(bytes);
+  return true;
+}
+
+template <size_t PageSize>
+void ThreadLocalHeap<PageSize>::flushLargeCache() {
+  for (auto &bin : _largeCache) {
+    releaseLargeCacheBin(bin);
+  }
+  d_assert(_largeCacheBytes == 0);
+}
+
+template <size_t PageSize>
+void ThreadLocalHeap<PageSize>::releaseIdleLargeSpans(time::time_point now) {
+  _lastLargeCacheSweep = now;
+  for (auto &bin : _largeCache) {
+    if (!bin.recentlyUsed) {
+      releaseLargeCacheBin(bin);
+    }
+    bin.recentlyUsed = false;
+  }
+}
+
+template <size_t PageSize>
+void ThreadLocalHeap<PageSize>::releaseLargeCacheBin(LargeCacheBin &bin) {
+  while (bin.count > 0) {
+    MiniHeapT *mh = bin.miniheaps[--bin.count];
+    const size_t bytes = mh->spanSize();
+    _largeCacheBytes -= bytes;
+    _global->recordLargeCached(-static_cast<ssize_t>(bytes));
+    _global->freeFor(mh, reinterpret_cast<void *>(mh->getSpanStart(_global->arenaBegin())), 0);
+  }
+}
+
+template <size_t PageSize>
+void ThreadLocalHeap<PageSize>::flushRemoteFrees() {
+  const size_t count = _remoteFreeCount;
+  _remoteFreeCount = 0;
+  if (count > 0) {
+    _global->freeBatch(_remoteFrees, count);
+  }
+}
+
+template <size_t PageSize>
+void ThreadLocalHeap<PageSize>::setRefillGoal(size_t sizeClass, size_t goal) {
+  RefillState &state = _refill[sizeClass];
+  const size_t oldExtra = state.goal > kMiniheapRefillGoalSize ? state.goal - kMiniheapRefillGoalSize : 0;
+  const size_t newExtra = goal > kMiniheapRefillGoalSize ? goal - kMiniheapRefillGoalSize : 0;
+  if (newExtra > oldExtra) {
+    if (!_global->reserveThreadCache(newExtra - oldExtra)) {
+      return;
+    }
+    _refillGoalExtra += newExtra - oldExtra;
+  } else if (newExtra < oldExtra) {
+    _global->releaseThreadCache(oldExtra - newExtra);
+    _refillGoalExtra -= oldExtra - newExtra;
+  }
+  state.goal = goal;
+}
+
+// doubles sizeClass's refill goal if it is back within
+// kRefillHotInterval of its last refill, and halves it if it has
+// been idle for longer than kRefillColdInterval.  Growth past
+// kMiniheapRefillGoalSize is only allowed while the global thread
+// cache budget has room.
+template <size_t PageSize>
+size_t ThreadLocalHeap<PageSize>::adaptRefillGoal(size_t sizeClass, time::time_point now) {
+  RefillState &state = _refill[sizeClass];
+  const auto last = state.last;
+  state.last = now;
+
+  if (last != time::time_point{}) {
+    const auto interval = now - last;
+    if (interval < kRefillHotInterval && state.goal < kMaxRefillGoalSize) {
+      setRefillGoal(sizeClass, std::min(state.goal * 2, static_cast<uint32_t>(kMaxRefillGoalSize)));
+    } else if (interval > kRefillColdInterval && state.goal > kMinRefillGoalSize) {
+      setRefillGoal(sizeClass, std::max(state.goal / 2, static_cast<uint32_t>(kMinRefillGoalSize)));
+    }
+  }
+
+  return state.goal;
+}
+
+// a class that stops allocating never refills again, so its goal
+// can't shrink in adaptRefillGoal.  Instead, refills of any other
+// class look (at most once per kRefillColdInterval) for classes that
+// haven't refilled in that long, hand their attached miniheaps back
+// to the global heap where they can be meshed, and halve their goal.
+template <size_t PageSize>
+void ThreadLocalHeap<PageSize>::releaseColdClasses(size_t sizeClass, time::time_point now) {
+  _lastColdSweep = now;
   for (size_t i = 1; i < kNumBins; i++) {
+    RefillState &state = _refill[i];
+    if (i == sizeClass || state.last == time::time_point{} || now - state.last <= kRefillColdInterval) {
+      continue;
+    }
+
     _shuffleVector[i].refillMiniheaps();
     _global->releaseMiniheaps(_shuffleVector[i].miniheaps());
+    // the next refill starts over, rather than counting as cold again
+    state.last = time::time_point{};
+    setRefillGoal(i, std::max(state.goal / 2, static_cast<uint32_t>(kMinRefillGoalSize)));
   }
 }
 
@@ -407,6 +735,13 @@ template <size_t PageSize>
 void *CACHELINE_ALIGNED_FN ThreadLocalHeap<PageSize>::smallAllocSlowpath(size_t sizeClass) {
   ShuffleVectorT &shuffleVector = _shuffleVector[sizeClass];
 
+  // otherwise a thread that has gone back to only allocating would
+  // sit on its buffered remote frees.  This also lets the global heap
+  // see what we've freed before it picks our next miniheaps.
+  if (unlikely(_remoteFreeCount > 0)) {
+    flushRemoteFrees();
+  }
+
   // we grab multiple MiniHeaps at a time from the global heap.  often
   // it is possible to refill the freelist from a not-yet-used
   // MiniHeap we already have, without global cross-thread
@@ -423,7 +758,21 @@ void *CACHELINE_ALIGNED_FN ThreadLocalHeap<PageSize>::smallAllocGlobalRefill(Shu
                                                                              size_t sizeClass) {
   const size_t sizeMax = SizeMap::ByteSizeForClass(sizeClass);
 
-  _global->allocSmallMiniheaps(sizeClass, sizeMax, shuffleVector.miniheaps(), _current);
+  maybeReleaseIdleLargeSpans();
+
+  // goals below the default also attach proportionally fewer reused
+  // miniheaps, whose free space the global heap doesn't count
+  const auto now = time::now();
+  if (now - _lastColdSweep > kRefillColdInterval) {
+    releaseColdClasses(sizeClass, now);
+  }
+  const size_t goal = adaptRefillGoal(sizeClass, now);
+  const size_t maxMiniheaps =
+      goal >= kMiniheapRefillGoalSize
+          ? kMaxMiniheapsPerShuffleVector
+          : std::max(kMaxMiniheapsPerShuffleVector * goal / kMiniheapRefillGoalSize, static_cast<size_t>(1));
+
+  _global->refillSmallMiniheaps(sizeClass, sizeMax, shuffleVector.miniheaps(), _current, goal, maxMiniheaps);
   shuffleVector.reinit();
 
   d_assert(!shuffleVector.isExhausted());
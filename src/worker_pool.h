@@ -0,0 +1,119 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil -*-
+// Copyright 2024 The Mesh Authors. All rights reserved.
+// Use of this source code is governed by the Apache License,
+// Version 2.0, that can be found in the LICENSE file.
+
+#pragma once
+#ifndef MESH_WORKER_POOL_H
+#define MESH_WORKER_POOL_H
+
+#include <pthread.h>
+
+#include <condition_variable>
+#include <mutex>
+
+#include "common.h"
+
+namespace mesh {
+
+// A small, fixed set of threads that run a function in parallel.
+// Used to mesh independent size classes concurrently while the
+// global heap is locked, so neither the pool nor its workers may
+// allocate once constructed.
+class WorkerPool {
+private:
+  DISALLOW_COPY_AND_ASSIGN(WorkerPool);
+
+public:
+  // the calling thread of run() acts as worker 0, so this spawns
+  // threadCount - 1 threads.
+  explicit WorkerPool(size_t threadCount)
+      : _threadCount(std::min(std::max(threadCount, static_cast<size_t>(1)), kMaxMeshThreads)) {
+    for (size_t i = 1; i < _threadCount; i++) {
+      _args[i].pool = this;
+      _args[i].index = i;
+      int err = pthread_create(&_threads[i], nullptr, workerMain, &_args[i]);
+      hard_assert(err == 0);
+    }
+  }
+
+  ~WorkerPool() {
+    {
+      lock_guard<mutex> lock(_mutex);
+      _shutdown = true;
+    }
+    _workCv.notify_all();
+
+    for (size_t i = 1; i < _threadCount; i++) {
+      pthread_join(_threads[i], nullptr);
+    }
+  }
+
+  size_t size() const {
+    return _threadCount;
+  }
+
+  // runs fn(i) for every i in [0, size()), and returns once all of
+  // them have finished.
+  void run(const function<void(size_t)> &fn) {
+    {
+      lock_guard<mutex> lock(_mutex);
+      _fn = &fn;
+      _pending = _threadCount - 1;
+      _generation++;
+    }
+    _workCv.notify_all();
+
+    fn(0);
+
+    unique_lock<mutex> lock(_mutex);
+    _doneCv.wait(lock, [&] { return _pending == 0; });
+    _fn = nullptr;
+  }
+
+private:
+  struct WorkerArgs {
+    WorkerPool *pool{nullptr};
+    size_t index{0};
+  };
+
+  static void *workerMain(void *arg) {
+    auto args = reinterpret_cast<WorkerArgs *>(arg);
+    WorkerPool *pool = args->pool;
+    size_t seen = 0;
+
+    unique_lock<mutex> lock(pool->_mutex);
+    while (true) {
+      pool->_workCv.wait(lock, [&] { return pool->_shutdown || pool->_generation != seen; });
+      if (pool->_shutdown) {
+        return nullptr;
+      }
+      seen = pool->_generation;
+
+      const function<void(size_t)> *fn = pool->_fn;
+      lock.unlock();
+      (*fn)(args->index);
+      lock.lock();
+
+      if (--pool->_pending == 0) {
+        pool->_doneCv.notify_one();
+      }
+    }
+  }
+
+  const size_t _threadCount;
+
+  mutex _mutex{};
+  condition_variable _workCv{};
+  condition_variable _doneCv{};
+  const function<void(size_t)> *_fn{nullptr};
+  size_t _generation{0};
+  size_t _pending{0};
+  bool _shutdown{false};
+
+  pthread_t _threads[kMaxMeshThreads]{};
+  WorkerArgs _args[kMaxMeshThreads]{};
+};
+}  // namespace mesh
+
+#endif  // MESH_WORKER_POOL_H